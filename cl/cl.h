@@ -46,12 +46,19 @@ typedef struct _cl_private {
         enum {                  /* Terminal initialization strings. */
             TE_SENT=0, TI_SENT } ti_te;
 
+        u_long  *rgen;          /* Per-row write generations. */
+        size_t   rgen_rows;     /* Rows in the generation array. */
+        u_long   wgen;          /* Last write generation. */
+        u_long   obytes;        /* Bytes added since the last refresh. */
+        struct timespec frame_ts;/* Time of the last terminal update. */
+
 #define CL_IN_EX        0x0001  /* Currently running ex. */
 #define CL_RENAME       0x0002  /* X11 xterm icon/window renamed. */
 #define CL_RENAME_OK    0x0004  /* User wants the windows renamed. */
 #define CL_SCR_EX_INIT  0x0008  /* Ex screen initialized. */
 #define CL_SCR_VI_INIT  0x0010  /* Vi screen initialized. */
 #define CL_STDIN_TTY    0x0020  /* Talking to a terminal. */
+#define CL_REFRESH      0x0040  /* Terminal update put off. */
         u_int32_t flags;
 } CL_PRIVATE;
 
@@ -45,11 +45,16 @@ int cl_insertln(SCR *);
 int cl_keyval(SCR *, scr_keyval_t, CHAR_T *, int *);
 int cl_move(SCR *, size_t, size_t);
 int cl_refresh(SCR *, int);
+int cl_frame(SCR *, int);
 int cl_rename(SCR *, char *, int);
+int cl_rowgen(SCR *, size_t, u_long *);
+void cl_rowtouch(CL_PRIVATE *, size_t, size_t);
+int cl_scroll(SCR *, size_t, size_t, int);
 int cl_suspend(SCR *, int *);
 void cl_usage(void);
 int sig_init(GS *, SCR *);
 int cl_event(SCR *, EVENT *, u_int32_t, int);
+int cl_pending(SCR *);
 int cl_screen(SCR *, u_int32_t);
 int cl_quit(GS *);
 int cl_getcap(SCR *, char *, char **);
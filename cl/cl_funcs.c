@@ -25,6 +25,7 @@
 #include <bsd_stdlib.h>
 #include <bsd_string.h>
 #include <term.h>
+#include <time.h>
 #ifdef __solaris__
 # define _XPG7
 # undef __EXTENSIONS__
@@ -44,6 +45,8 @@
 #include "../vi/vi.h"
 #include "cl.h"
 
+static int      cl_frame_due(SCR *);
+
 /*
  * cl_addstr --
  *      Add len bytes from the string at the cursor, advancing the cursor.
@@ -53,7 +56,8 @@
 int
 cl_addstr(SCR *sp, const char *str, size_t len)
 {
-        size_t oldy, oldx;
+        CL_PRIVATE *clp;
+        size_t oldy, oldx, y, x;
         int iv;
 
         (void)oldx;
@@ -76,6 +80,13 @@ cl_addstr(SCR *sp, const char *str, size_t len)
 
         if (iv)
                 (void)standend();
+
+        /* The string may have wrapped onto the following rows. */
+        clp = CLP(sp);
+        clp->obytes += len;
+        getyx(stdscr, y, x);
+        (void)x;
+        cl_rowtouch(clp, oldy, y < oldy ? oldy : y);
         return (0);
 }
 
@@ -246,6 +257,11 @@ cl_bell(SCR *sp)
 int
 cl_clrtoeol(SCR *sp)
 {
+        size_t y, x;
+
+        getyx(stdscr, y, x);
+        (void)x;
+        cl_rowtouch(CLP(sp), y, y);
         return (clrtoeol() == ERR);
 }
 
@@ -279,7 +295,7 @@ cl_cursor(SCR *sp, size_t *yp, size_t *xp)
 int
 cl_deleteln(SCR *sp)
 {
-        size_t oldy, oldx;
+        size_t oldy, oldx, y, x;
 
         /*
          * This clause is required because the curses screen uses reverse
@@ -305,6 +321,11 @@ cl_deleteln(SCR *sp)
                 (void)move(oldy, oldx);
         }
 
+        /* Every row from here to the bottom of the terminal moves. */
+        getyx(stdscr, y, x);
+        (void)x;
+        cl_rowtouch(CLP(sp), y, LINES - 1);
+
         /*
          * The bottom line is expected to be blank after this operation,
          * and other screens must support that semantic.
@@ -410,6 +431,12 @@ cl_imctrl(SCR *sp, imctrl_t action)
 int
 cl_insertln(SCR *sp)
 {
+        size_t y, x;
+
+        getyx(stdscr, y, x);
+        (void)x;
+        cl_rowtouch(CLP(sp), y, LINES - 1);
+
         /*
          * The current line is expected to be blank after this operation,
          * and the screen must support that semantic.
@@ -483,9 +510,9 @@ int
 cl_refresh(SCR *sp, int repaint)
 {
         CL_PRIVATE *clp;
+        int rval;
 
         clp = CLP(sp);
-        (void)clp;
 
         /*
          * If we received a killer signal, we're done, there's no point
@@ -494,6 +521,49 @@ cl_refresh(SCR *sp, int repaint)
         if (cl_sigterm)
                 return (0);
 
+        /*
+         * If more input is already waiting, e.g., text is being pasted or
+         * a key is repeating, the screen is about to change again.  Put
+         * off updating the terminal until the input drains (cl_event does
+         * the update before it waits for more), but no longer than the
+         * frametime option allows.  A frame that's due is finished even
+         * if input arrives while curses is writing it.
+         */
+        if (!repaint && O_VAL(sp, O_FRAMETIME) != 0 &&
+            (KEYS_WAITING(sp) || cl_pending(sp))) {
+                if (!cl_frame_due(sp)) {
+                        F_SET(clp, CL_REFRESH);
+                        return (0);
+                }
+                (void)typeahead(-1);
+                rval = cl_frame(sp, 0);
+                (void)typeahead(STDIN_FILENO);
+                return (rval);
+        }
+        return (cl_frame(sp, repaint));
+}
+
+/*
+ * cl_frame --
+ *      Update the terminal.
+ *
+ * PUBLIC: int cl_frame(SCR *, int);
+ */
+int
+cl_frame(SCR *sp, int repaint)
+{
+        CL_PRIVATE *clp;
+
+        clp = CLP(sp);
+        F_CLR(clp, CL_REFRESH);
+        (void)clock_gettime(CLOCK_MONOTONIC, &clp->frame_ts);
+
+#ifdef DEBUG
+        TRACE(sp, "cl_refresh: %lu bytes%s\n",
+            clp->obytes, repaint ? ", repaint" : "");
+#endif /* ifdef DEBUG */
+        clp->obytes = 0;
+
         /*
          * If repaint is set, the editor is telling us that we don't know
          * what's on the screen, so we have to repaint from scratch.
@@ -507,6 +577,32 @@ cl_refresh(SCR *sp, int repaint)
         return (refresh() == ERR);
 }
 
+/*
+ * cl_frame_due --
+ *      Return if the frametime option's interval has passed since the
+ *      terminal was last updated.
+ */
+static int
+cl_frame_due(SCR *sp)
+{
+        struct timespec ts;
+        CL_PRIVATE *clp;
+        u_long ms;
+
+        clp = CLP(sp);
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec -= clp->frame_ts.tv_sec;
+        ts.tv_nsec -= clp->frame_ts.tv_nsec;
+        if (ts.tv_nsec < 0) {
+                ts.tv_sec--;
+                ts.tv_nsec += 1000000000;
+        }
+        ms = O_VAL(sp, O_FRAMETIME) * 100;
+        if (ts.tv_sec < 0 || (u_long)ts.tv_sec > ms / 1000)
+                return (1);
+        return ((u_long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 >= ms);
+}
+
 /*
  * cl_rename --
  *      Rename the file.
@@ -545,6 +641,103 @@ cl_rename(SCR *sp, char *name, int on)
         return (0);
 }
 
+/*
+ * cl_rowgen --
+ *      Return the write generation of a screen row.  The generation
+ *      changes whenever anything is written to, cleared from or scrolled
+ *      through the row, so the editor can tell if the row still holds
+ *      what it last put there.
+ *
+ * PUBLIC: int cl_rowgen(SCR *, size_t, u_long *);
+ */
+int
+cl_rowgen(SCR *sp, size_t lno, u_long *genp)
+{
+        CL_PRIVATE *clp;
+
+        clp = CLP(sp);
+        lno = RLNO(sp, lno);
+        if (clp->rgen == NULL ||
+            clp->rgen_rows != (size_t)LINES || lno >= clp->rgen_rows)
+                return (1);
+        *genp = clp->rgen[lno];
+        return (0);
+}
+
+/*
+ * cl_rowtouch --
+ *      Give the absolute screen rows from through to a new write
+ *      generation.  If the terminal changed size, all of the rows
+ *      get one.
+ *
+ * PUBLIC: void cl_rowtouch(CL_PRIVATE *, size_t, size_t);
+ */
+void
+cl_rowtouch(CL_PRIVATE *clp, size_t from, size_t to)
+{
+        u_long *gp;
+        size_t rows;
+
+        if (LINES <= 0)
+                return;
+        rows = LINES;
+        if (clp->rgen_rows != rows) {
+                if ((gp = reallocarray(clp->rgen,
+                    rows, sizeof(u_long))) == NULL) {
+                        free(clp->rgen);
+                        clp->rgen = NULL;
+                        clp->rgen_rows = 0;
+                        return;
+                }
+                clp->rgen = gp;
+                clp->rgen_rows = rows;
+                from = 0;
+                to = rows - 1;
+        }
+        if (to >= rows)
+                to = rows - 1;
+        for (++clp->wgen; from <= to; ++from)
+                clp->rgen[from] = clp->wgen;
+}
+
+/*
+ * cl_scroll --
+ *      Scroll the lines from top through bot up cnt lines, or down if
+ *      cnt is negative, blanking the lines scrolled in.
+ *
+ * Curses turns the scroll into a terminal scroll region change and
+ * scroll sequences, or line inserts and deletes, when it refreshes the
+ * screen, so the lines outside of the range are never touched.
+ *
+ * PUBLIC: int cl_scroll(SCR *, size_t, size_t, int);
+ */
+int
+cl_scroll(SCR *sp, size_t top, size_t bot, int cnt)
+{
+        size_t oldy, oldx;
+        int rval;
+
+        getyx(stdscr, oldy, oldx);
+
+        /*
+         * Terminals ignore a scroll region of a single line and scroll the
+         * whole screen, so simply blank the line.
+         */
+        if (top == bot) {
+                (void)move(RLNO(sp, top), 0);
+                rval = clrtoeol() == ERR;
+        } else {
+                (void)scrollok(stdscr, TRUE);
+                (void)setscrreg(RLNO(sp, top), RLNO(sp, bot));
+                rval = scrl(cnt) == ERR;
+                (void)setscrreg(0, LINES - 1);
+                (void)scrollok(stdscr, FALSE);
+        }
+        (void)move(oldy, oldx);
+        cl_rowtouch(CLP(sp), RLNO(sp, top), RLNO(sp, bot));
+        return (rval);
+}
+
 /*
  * cl_suspend --
  *      Suspend a screen.
@@ -150,6 +150,7 @@ main(int argc, char *argv[])
 
         /* Free the global and CL private areas. */
 #if defined(DEBUG) || defined(PURIFY)
+        free(clp->rgen);
         free(clp);
         free(gp);
 #endif /* if defined(DEBUG) || defined(PURIFY) */
@@ -365,9 +366,12 @@ cl_func_std(GS *gp)
         gp->scr_move      = cl_move;
         gp->scr_msg       = NULL;
         gp->scr_optchange = cl_optchange;
+        gp->scr_pending   = cl_pending;
         gp->scr_refresh   = cl_refresh;
         gp->scr_rename    = cl_rename;
+        gp->scr_rowgen    = cl_rowgen;
         gp->scr_screen    = cl_screen;
+        gp->scr_scroll    = cl_scroll;
         gp->scr_suspend   = cl_suspend;
         gp->scr_usage     = cl_usage;
 }
@@ -114,6 +114,13 @@ retest: if (LF_ISSET(EC_INTERRUPT) || cl_sigint) {
                 /* No real change, ignore the signal. */
         }
 
+        /*
+         * Finish any terminal update cl_refresh put off, unless there's
+         * still input to read.
+         */
+        if (F_ISSET(clp, CL_REFRESH) && !cl_pending(sp) && cl_frame(sp, 0))
+                return (1);
+
         /* Set timer. */
         if (ms == 0)
                 tp = NULL;
@@ -148,6 +155,24 @@ retest: if (LF_ISSET(EC_INTERRUPT) || cl_sigint) {
         return (0);
 }
 
+/*
+ * cl_pending --
+ *      Return if input is waiting to be read from the terminal.
+ *
+ * PUBLIC: int cl_pending(SCR *);
+ */
+int
+cl_pending(SCR *sp)
+{
+        struct pollfd pfd[1];
+
+        if (!F_ISSET(CLP(sp), CL_STDIN_TTY))
+                return (0);
+        pfd[0].fd = STDIN_FILENO;
+        pfd[0].events = POLLIN;
+        return (poll(pfd, 1, 0) > 0);
+}
+
 /*
  * cl_read --
  *      Read characters from the input.
@@ -203,6 +228,18 @@ tty_retry:
                 default:
                         break;
                 }
+        } else if (!F_ISSET(gp, G_SCRWIN)) {
+                /*
+                 * Read ahead in the file until there's input or there's
+                 * nothing left to read.  Return after each chunk as if
+                 * interrupted, so cl_event() checks for signals before
+                 * reading the next one.  Scripting windows are waited on
+                 * below, so there's no reading ahead while they're open.
+                 */
+                pfd[0].fd = STDIN_FILENO;
+                pfd[0].events = POLLIN;
+                if (poll(pfd, 1, 0) == 0 && db_idle(sp))
+                        return (INP_INTR);
         }
 
         /*
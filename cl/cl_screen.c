@@ -67,6 +67,8 @@ cl_screen(SCR *sp, u_int32_t flags)
                     resizeterm(O_VAL(sp, O_LINES), O_VAL(sp, O_COLUMNS))) &&
                     cl_quit(gp))
                         return (1);
+                if (F_ISSET(sp, SC_SCR_EX | SC_SCR_VI))
+                        cl_rowtouch(clp, 0, LINES - 1);
                 F_CLR(gp, G_SRESTART);
         }
 
@@ -103,9 +105,11 @@ cl_screen(SCR *sp, u_int32_t flags)
                 if (TAILQ_NEXT(sp, q)) {
                         (void)move(RLNO(sp, sp->rows), 0);
                         clrtobot();
+                        cl_rowtouch(clp, RLNO(sp, sp->rows), LINES - 1);
                 }
                 (void)move(RLNO(sp, sp->rows) - 1, 0);
                 refresh();
+                F_CLR(clp, CL_REFRESH);
         }
 
         /* Enter the requested mode. */
@@ -254,6 +258,9 @@ cl_vi_init(SCR *sp)
                 return (1);
         }
 
+        /* The new screen is blank, nothing painted before is on it. */
+        cl_rowtouch(clp, 0, LINES - 1);
+
         if (o_term == NULL)
                 unsetenv("TERM");
         if (o_lines == NULL)
@@ -36,6 +36,9 @@ typedef struct _mark            MARK;
 typedef struct _msg             MSGS;
 typedef struct _option          OPTION;
 typedef struct _optlist         OPTLIST;
+typedef struct _par             PAR;
+typedef struct _parthr          PARTHR;
+typedef struct _recache         RECACHE;
 typedef struct _scr             SCR;
 typedef struct _script          SCRIPT;
 typedef struct _seq             SEQ;
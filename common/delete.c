@@ -24,6 +24,14 @@
 
 #include "common.h"
 
+static int      del_lines(SCR *, recno_t, recno_t);
+
+/*
+ * Lines are deleted DEL_CHUNK at a time, checking for interrupts between
+ * the chunks.
+ */
+#define DEL_CHUNK       1024
+
 /*
  * del --
  *      Delete a range of text.
@@ -43,13 +51,8 @@ del(SCR *sp, MARK *fm, MARK *tm, int lmode)
 
         /* Case 1 -- delete in line mode. */
         if (lmode) {
-                for (lno = tm->lno; lno >= fm->lno; --lno) {
-                        if (db_delete(sp, lno))
-                                return (1);
-                        ++sp->rptlines[L_DELETED];
-                        if (lno % INTERRUPT_CHECK == 0 && INTERRUPTED(sp))
-                                break;
-                }
+                if (del_lines(sp, fm->lno, tm->lno))
+                        return (1);
                 goto done;
         }
 
@@ -68,14 +71,8 @@ del(SCR *sp, MARK *fm, MARK *tm, int lmode)
                 } else
                         eof = 1;
                 if (eof) {
-                        for (lno = tm->lno; lno > fm->lno; --lno) {
-                                if (db_delete(sp, lno))
-                                        return (1);
-                                ++sp->rptlines[L_DELETED];
-                                if (lno %
-                                    INTERRUPT_CHECK == 0 && INTERRUPTED(sp))
-                                        break;
-                        }
+                        if (del_lines(sp, fm->lno + 1, tm->lno))
+                                return (1);
                         if (db_get(sp, fm->lno, DBG_FATAL, &p, &len))
                                 return (1);
                         GET_SPACE_RET(sp, bp, blen, fm->cno);
@@ -146,13 +143,8 @@ del(SCR *sp, MARK *fm, MARK *tm, int lmode)
                 goto err;
 
         /* Delete the last and intermediate lines. */
-        for (lno = tm->lno; lno > fm->lno; --lno) {
-                if (db_delete(sp, lno))
-                        goto err;
-                ++sp->rptlines[L_DELETED];
-                if (lno % INTERRUPT_CHECK == 0 && INTERRUPTED(sp))
-                        break;
-        }
+        if (del_lines(sp, fm->lno + 1, tm->lno))
+                goto err;
 
 done:   rval = 0;
         if (0)
@@ -161,3 +153,25 @@ err:            rval = 1;
                 FREE_SPACE(sp, bp, blen);
         return (rval);
 }
+
+/*
+ * del_lines --
+ *      Delete the lines from fl to tl.  The lines are deleted from the end
+ *      of the range, so if interrupted, the start of the range remains.
+ */
+
+static int
+del_lines(SCR *sp, recno_t fl, recno_t tl)
+{
+        recno_t cnt;
+
+        for (; tl >= fl; tl -= cnt) {
+                cnt = tl - fl + 1 > DEL_CHUNK ? DEL_CHUNK : tl - fl + 1;
+                if (db_delete_range(sp, tl - cnt + 1, cnt))
+                        return (1);
+                sp->rptlines[L_DELETED] += cnt;
+                if (INTERRUPTED(sp))
+                        break;
+        }
+        return (0);
+}
@@ -55,6 +55,7 @@ static int      file_backup(SCR *, char *, char *);
 static void     file_cinit(SCR *);
 static void     file_comment(SCR *);
 static int      file_spath(SCR *, FREF *, struct stat *, int *);
+static int      file_wtemp(SCR *, char *, char **);
 
 /*
  * file_add --
@@ -168,7 +169,7 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
          *      Set initial EXF flag bits.
          */
         CALLOC_RET(sp, ep, 1, sizeof(EXF));
-        ep->c_lno = ep->c_nlines = OOBLNO;
+        ep->c_nlines = OOBLNO;
         ep->rcv_fd = ep->fcntl_fd = -1;
         F_SET(ep, F_FIRSTMODIFY);
 
@@ -259,7 +260,12 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
         memset(&oinfo, 0, sizeof(RECNOINFO));
         oinfo.bval = '\n';                      /* Always set. */
         oinfo.psize = psize;
-        oinfo.flags = F_ISSET(sp->gp, G_SNAPSHOT) ? R_SNAPSHOT : 0;
+        /*
+         * Unless the file is snapshotted, unmodified lines can reference
+         * the file instead of being copied into the database.  A snapshot
+         * has to survive the file changing underneath us.
+         */
+        oinfo.flags = F_ISSET(sp->gp, G_SNAPSHOT) ? R_SNAPSHOT : R_NOCOPY;
 #ifndef NO_BFNAME
         if (rcv_name == NULL) {
                 if (!rcv_tmp(sp, ep, frp->name))
@@ -292,6 +298,14 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
                 goto oerr;
         }
 
+        /*
+         * If the file wasn't read when the database was opened, lines are
+         * read as they're needed, and the rest of the file is read ahead
+         * while waiting for input.  See db_idle().
+         */
+        if (rcv_name == NULL && !F_ISSET(sp->gp, G_SNAPSHOT))
+                F_SET(ep, F_PARTIAL);
+
         /*
          * Do the remaining things that can cause failure of the new file,
          * mark and logging initialization.
@@ -452,6 +466,7 @@ oerr:   if (F_ISSET(ep, F_RCV_ON))
         ep->rcv_path = NULL;
         if (ep->db != NULL)
                 (void)ep->db->close(ep->db);
+        db_cache_end(ep);
         free(ep);
 
         return (open_err ?
@@ -650,6 +665,12 @@ file_end(SCR *sp, EXF *ep, int force)
          */
         if (ep == NULL)
                 ep = sp->ep;
+
+        /* The screen's match list is for the lines it's leaving. */
+        free(sp->ml);
+        sp->ml = NULL;
+        sp->ml_cnt = 0;
+
         if (--ep->refcnt != 0)
                 return (0);
 
@@ -731,6 +752,7 @@ file_end(SCR *sp, EXF *ep, int force)
                 (void)close(ep->rcv_fd);
         free(ep->rcv_path);
         free(ep->rcv_mpath);
+        db_cache_end(ep);
         free(ep);
         return (0);
 }
@@ -747,15 +769,16 @@ int
 file_write(SCR *sp, MARK *fm, MARK *tm, char *name, int flags)
 {
         enum { NEWFILE, OLDFILE } mtype;
-        struct stat sb;
+        struct stat osb, sb;
+        struct timespec ts1, ts2;
         EXF *ep;
-        FILE *fp;
         FREF *frp;
         MARK from, to;
         size_t len;
         unsigned long nlno, nch;
+        double secs;
         int fd, nf, noname, oflags, rval;
-        char *p, *s, *t, buf[PATH_MAX + 64];
+        char *p, *s, *t, *tname, buf[PATH_MAX + 64];
         const char *msgstr;
 
         ep = sp->ep;
@@ -839,8 +862,43 @@ file_write(SCR *sp, MARK *fm, MARK *tm, char *name, int flags)
             file_backup(sp, name, O_STR(sp, O_BACKUP)) && !LF_ISSET(FS_FORCE))
                 return (1);
 
+        /* Build fake addresses, if necessary. */
+        if (fm == NULL) {
+                from.lno = 1;
+                from.cno = 0;
+                fm = &from;
+                if (db_last(sp, &to.lno))
+                        return (1);
+                to.cno = 0;
+                tm = &to;
+        }
+
+        /*
+         * If the safewrite option is set, write a temporary file and rename
+         * it over the original, so a failed write leaves the original alone.
+         */
+        tname = NULL;
+        if (O_ISSET(sp, O_SAFEWRITE) &&
+            mtype == OLDFILE && !LF_ISSET(FS_APPEND)) {
+                if ((fd = file_wtemp(sp, name, &tname)) == -2)
+                        return (1);
+        } else
+                fd = -1;
+
+        /*
+         * Lines that haven't been changed may still reference the file
+         * we're about to truncate, copy them into the database first.
+         */
+        if (fd == -1 && mtype == OLDFILE && !LF_ISSET(FS_APPEND) &&
+            (fd = ep->db->fd(ep->db)) != -1 && !fstat(fd, &osb) &&
+            sb.st_dev == osb.st_dev && sb.st_ino == osb.st_ino &&
+            ep->db->sync(ep->db, R_RECNOSYNC)) {
+                msgq_str(sp, M_SYSERR, name, "%s");
+                return (1);
+        }
+
         /* Open the file. */
-        if ((fd = open(name, oflags,
+        if (tname == NULL && (fd = open(name, oflags,
             S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)) < 0) {
                 msgq_str(sp, M_SYSERR, name, "%s");
                 return (1);
@@ -851,31 +909,38 @@ file_write(SCR *sp, MARK *fm, MARK *tm, char *name, int flags)
                 msgq_str(sp, M_ERR, name,
                     "%s: write lock was unavailable");
 
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts1);
+        rval = ex_writefd(sp, name, fd, fm, tm, &nlno, &nch, 0);
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts2);
+
         /*
-         * Use stdio for buffering.
-         *
-         * XXX
-         * SVR4.2 requires the fdopen mode exactly match the original open
-         * mode, i.e. you have to open with "a" if appending.
+         * Replace the original file.  If it's the file being edited, the
+         * lock went away with it, lock the new one and keep it open.
          */
-        if ((fp = fdopen(fd, LF_ISSET(FS_APPEND) ? "a" : "w")) == NULL) {
-                msgq_str(sp, M_SYSERR, name, "%s");
-                (void)close(fd);
-                return (1);
-        }
-
-        /* Build fake addresses, if necessary. */
-        if (fm == NULL) {
-                from.lno = 1;
-                from.cno = 0;
-                fm = &from;
-                if (db_last(sp, &to.lno))
+        if (tname != NULL) {
+                if (!rval && rename(tname, name)) {
+                        msgq_str(sp, M_SYSERR, name, "%s");
+                        rval = 1;
+                }
+                if (rval) {
+                        (void)unlink(tname);
+                        free(tname);
+                        (void)close(fd);
                         return (1);
-                to.cno = 0;
-                tm = &to;
+                }
+                free(tname);
+                if (noname && O_ISSET(sp, O_LOCKFILES) &&
+                    file_lock(sp, NULL, NULL, fd, 0) == LOCK_SUCCESS) {
+                        if (ep->fcntl_fd != -1)
+                                (void)close(ep->fcntl_fd);
+                        ep->fcntl_fd = fd;
+                        fd = -1;
+                }
+        }
+        if (fd != -1 && close(fd) && !rval) {
+                msgq_str(sp, M_SYSERR, name, "%s");
+                rval = 1;
         }
-
-        rval = ex_writefp(sp, name, fp, fm, tm, &nlno, &nch, 0);
 
         /*
          * Save the new last modification time -- even if the write fails
@@ -949,6 +1014,17 @@ file_write(SCR *sp, MARK *fm, MARK *tm, char *name, int flags)
                 abort();
         }
 
+        /* If verbose, report the write rate. */
+        if (O_ISSET(sp, O_VERBOSE)) {
+                secs = (ts2.tv_sec - ts1.tv_sec) +
+                    (ts2.tv_nsec - ts1.tv_nsec) / 1e9;
+                if (secs > 0) {
+                        (void)snprintf(buf + len, sizeof(buf) - len,
+                            ", %'lu KB/s", (unsigned long)(nch / 1024.0 / secs));
+                        len += strlen(buf + len);
+                }
+        }
+
         /*
          * There's a nasty problem with long path names.  Tags files
          * can result in long paths and vi will request a continuation key from
@@ -974,6 +1050,49 @@ file_write(SCR *sp, MARK *fm, MARK *tm, char *name, int flags)
         return (0);
 }
 
+/*
+ * file_wtemp --
+ *      Create a temporary file to replace a file with, in the same
+ *      directory, with the same owner, group and mode.  Returns -1 if the
+ *      file shouldn't be replaced, e.g., it's a symbolic link or has other
+ *      links, or its owner can't be kept, and -2 on error.
+ */
+static int
+file_wtemp(SCR *sp, char *name, char **tnamep)
+{
+        struct stat sb;
+        size_t len;
+        int fd;
+        char *p, *tname;
+
+        if (lstat(name, &sb) || !S_ISREG(sb.st_mode) || sb.st_nlink != 1)
+                return (-1);
+
+        /* The file name, with the last component prefixed with a dot. */
+        p = strrchr(name, '/');
+        len = p == NULL ? 0 : (size_t)(p - name) + 1;
+        if ((tname = malloc(strlen(name) + sizeof(".XXXXXXXXXX") + 1)) == NULL) {
+                msgq(sp, M_SYSERR, NULL);
+                return (-2);
+        }
+        (void)sprintf(tname,
+            "%.*s.%s.XXXXXXXXXX", (int)len, name, name + len);
+
+        if ((fd = mkstemp(tname)) == -1) {
+                free(tname);
+                return (-1);
+        }
+        if (fchown(fd, sb.st_uid, sb.st_gid) ||
+            fchmod(fd, sb.st_mode & ALLPERMS)) {
+                (void)unlink(tname);
+                (void)close(fd);
+                free(tname);
+                return (-1);
+        }
+        *tnamep = tname;
+        return (fd);
+}
+
 /*
  * file_backup --
  *      Backup the about-to-be-written file.
@@ -23,6 +23,23 @@
 # undef open
 #endif /* ifdef _AIX */
 
+/*
+ * lcache --
+ *      A cached line.  Lines are cached in a set associative cache in the
+ *      file structure, indexed by line number; see db_get().
+ */
+#define DB_CACHESETS    64              /* Line cache sets, a power of 2. */
+#define DB_CACHEWAYS    4               /* Lines per line cache set. */
+#define DB_CACHESIZE    (DB_CACHESETS * DB_CACHEWAYS)
+
+struct _lcache {
+        recno_t  lno;                   /* Line number, or OOBLNO. */
+        char    *lp;                    /* Line. */
+        size_t   len;                   /* Line length. */
+        size_t   blen;                  /* Line buffer length. */
+        u_long   used;                  /* Last use. */
+};
+
 /*
  * exf --
  *      The file structure.
@@ -33,20 +50,30 @@ struct _exf {
 
                                         /* Underlying database state. */
         DB      *db;                    /* File db structure. */
-        char    *c_lp;                  /* Cached line. */
-        size_t   c_len;                 /* Cached line length. */
-        recno_t  c_lno;                 /* Cached line number. */
+                                        /* Cached lines. */
+        struct _lcache c_line[DB_CACHESIZE];
+        u_long   c_clock;               /* Line cache use clock. */
+        u_long   c_hits;                /* Line cache hits. */
+        u_long   c_misses;              /* Line cache misses. */
         recno_t  c_nlines;              /* Cached lines in the file. */
+        u_long   c_chg;                 /* Line changes, ever. */
+#define DB_IDLECHUNK    16384           /* Lines read ahead at a time. */
+        recno_t  i_lno;                 /* Lines read ahead while idle. */
 
         DB      *log;                   /* Log db structure. */
         char    *l_lp;                  /* Log buffer. */
         size_t   l_len;                 /* Log buffer length. */
         recno_t  l_high;                /* Log last + 1 record number. */
         recno_t  l_cur;                 /* Log current record number. */
+        recno_t  l_sets;                /* Log change sets before l_cur. */
         MARK     l_cursor;              /* Log cursor position. */
         dir_t    lundo;                 /* Last undo direction. */
 
         LIST_HEAD(_markh, _lmark) marks;/* Linked list of file MARK's. */
+        LMARK  **m_line;                /* Marks, sorted by line. */
+        recno_t *m_off;                 /* Mark line offsets (Fenwick). */
+        size_t   m_cnt;                 /* Marks in m_line. */
+        size_t   m_len;                 /* Length of m_line and m_off. */
 
         dev_t    mdev;                  /* Device. */
         ino_t    minode;                /* Inode. */
@@ -75,6 +102,8 @@ struct _exf {
 #define F_RCV_ON        0x040           /* Recovery is possible. */
 #define F_UNDO          0x080           /* No change since last undo. */
 #define F_RCV_SYNC      0x100           /* Recovery file sync needed. */
+#define F_PARTIAL       0x200           /* File not yet completely read. */
+#define F_MARKLINE      0x400           /* Mark line index is valid. */
         u_int16_t flags;
 };
 
@@ -116,6 +116,10 @@ struct _gs {
         LIST_HEAD(_seqh, _seq) seqq;    /* Linked list of maps, abbrevs. */
         bitstr_t bit_decl(seqb, MAX_BIT_SEQ);
 
+        TAILQ_HEAD(_recacheh, _recache) recq; /* Compiled RE cache. */
+        u_long   re_hits;               /* RE cache hits.   */
+        u_long   re_misses;             /* RE cache misses. */
+
 #define MAX_FAST_KEY    254             /* Max fast check character.*/
 
 #define KEY_LEN(sp, ch)                                                 \
@@ -188,12 +192,18 @@ struct _gs {
         int     (*scr_move)(SCR *, size_t, size_t);
                                         /* Message or ex output.             */
         void    (*scr_msg)(SCR *, mtype_t, char *, size_t);
+                                        /* Return if input is waiting.       */
+        int     (*scr_pending)(SCR *);
                                         /* Refresh the screen.               */
         int     (*scr_refresh)(SCR *, int);
                                         /* Rename the file.                  */
         int     (*scr_rename)(SCR *, char *, int);
+                                        /* Return a row's write generation.  */
+        int     (*scr_rowgen)(SCR *, size_t, u_long *);
                                         /* Set the screen type.              */
         int     (*scr_screen)(SCR *, u_int32_t);
+                                        /* Scroll a range of lines.          */
+        int     (*scr_scroll)(SCR *, size_t, size_t, int);
                                         /* Suspend the editor.               */
         int     (*scr_suspend)(SCR *, int *);
                                         /* Print usage message.              */
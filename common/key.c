@@ -802,6 +802,40 @@ v_event_flush(SCR *sp, unsigned int flags)
         return (rval);
 }
 
+/*
+ * v_event_run --
+ *      Remove a run of plain characters from the front of the queue and
+ *      return it: characters that v_event_get would return unchanged and
+ *      that have no special meaning as keys.  The returned events are only
+ *      valid until the queue is next changed.
+ *
+ * PUBLIC: EVENT *v_event_run(SCR *, size_t *, u_int32_t);
+ */
+EVENT *
+v_event_run(SCR *sp, size_t *lenp, u_int32_t flags)
+{
+        EVENT *evp;
+        GS *gp;
+        size_t len;
+
+        gp = sp->gp;
+        for (len = 0; len < gp->i_cnt; ++len) {
+                evp = &gp->i_event[gp->i_next + len];
+                if (evp->e_event != E_CHARACTER ||
+                    evp->e_value != K_NOTUSED || iscntrl(evp->e_c) ||
+                    F_ISSET(&evp->e_ch, CH_ABBREVIATED | CH_QUOTED))
+                        break;
+                if (!F_ISSET(&evp->e_ch, CH_NOMAP) &&
+                    LF_ISSET(EC_MAPCOMMAND | EC_MAPINPUT) &&
+                    (evp->e_c >= MAX_BIT_SEQ || bit_test(gp->seqb, evp->e_c)))
+                        break;
+        }
+        evp = &gp->i_event[gp->i_next];
+        if ((*lenp = len) != 0)
+                QREM(len);
+        return (evp);
+}
+
 /*
  * v_event_grow --
  *      Grow the terminal queue.
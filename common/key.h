@@ -136,6 +136,10 @@ extern KEYLIST keylist[];
 #define MAPPED_KEYS_WAITING(sp)                                            \
         (KEYS_WAITING(sp) &&                                               \
             F_ISSET(&(sp)->gp->i_event[(sp)->gp->i_next].e_ch, CH_MAPPED))
+                                        /* Return if keys in queue or unread. */
+#define INPUT_WAITING(sp)                                                  \
+        (KEYS_WAITING(sp) || ((sp)->gp->scr_pending != NULL &&             \
+            (sp)->gp->scr_pending(sp)))
 
 /* The "standard" tab width, for displaying things to users. */
 #define STANDARD_TAB    6
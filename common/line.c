@@ -20,12 +20,20 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <bsd_stdlib.h>
 #include <bsd_string.h>
 
 #include "common.h"
 #include "../vi/vi.h"
 
-static int scr_update(SCR *, recno_t, lnop_t, int);
+#define DB_CSET(lno)    ((lno) & (DB_CACHESETS - 1))
+
+static struct _lcache *db_cfill(EXF *, recno_t, char *, size_t);
+static struct _lcache *db_cfind(EXF *, recno_t);
+static void db_cinval(EXF *, recno_t, recno_t);
+static void db_crenum(EXF *, recno_t, int);
+static struct _lcache *db_cvictim(EXF *, recno_t);
+static int scr_update(SCR *, recno_t, lnop_t, recno_t, int);
 
 /*
  * db_eget --
@@ -81,6 +89,7 @@ db_get(SCR *sp, recno_t lno, u_int32_t flags, char **pp, size_t *lenp)
         DBT data, key;
         EXF *ep;
         TEXT *tp;
+        struct _lcache *cp;
         recno_t l1, l2;
 
         /*
@@ -131,14 +140,16 @@ db_get(SCR *sp, recno_t lno, u_int32_t flags, char **pp, size_t *lenp)
         }
 
         /* Look-aside into the cache, and see if the line we want is there. */
-        if (lno == ep->c_lno) {
+        if ((cp = db_cfind(ep, lno)) != NULL) {
+                ++ep->c_hits;
+                cp->used = ++ep->c_clock;
                 if (lenp != NULL)
-                        *lenp = ep->c_len;
+                        *lenp = cp->len;
                 if (pp != NULL)
-                        *pp = ep->c_lp;
+                        *pp = cp->lp;
                 return (0);
         }
-        ep->c_lno = OOBLNO;
+        ++ep->c_misses;
 
 nocache:
         /* Get the line from the underlying database. */
@@ -157,15 +168,74 @@ err3:           if (lenp != NULL)
                 return (1);
         }
 
-        /* Reset the cache. */
-        ep->c_lno = lno;
-        ep->c_len = data.size;
-        ep->c_lp = data.data;
+        /*
+         * Fill the cache.  If that fails, return the line from the database,
+         * it's only good until the next database call.
+         */
+        if ((cp = db_cfill(ep, lno, data.data, data.size)) != NULL)
+                data.data = cp->lp;
 
         if (lenp != NULL)
                 *lenp = data.size;
         if (pp != NULL)
-                *pp = ep->c_lp;
+                *pp = data.data;
+        return (0);
+}
+
+/*
+ * db_getv --
+ *      Get a vector of lines: the line and the lines after (FORWARD) or
+ *      before (BACKWARD) it that are on the same database page.  On entry,
+ *      *cntp is the size of the vector, on return, the lines are in order
+ *      starting with line *firstp, and *cntp is the number of lines.  The
+ *      lines aren't cached, and are only good until the next database call.
+ *
+ * PUBLIC: int db_getv(SCR *, recno_t, dir_t, DBT *, recno_t *, recno_t *);
+ */
+
+int
+db_getv(SCR *sp, recno_t lno, dir_t dir, DBT *lines, recno_t *firstp,
+    recno_t *cntp)
+{
+        DBT data, key;
+        EXF *ep;
+        size_t len;
+        char *p;
+
+        /* Check for no underlying file. */
+        if ((ep = sp->ep) == NULL) {
+                ex_emsg(sp, NULL, EXM_NOFILEYET);
+                return (1);
+        }
+
+        /* The text buffers may hide lines, get them one at a time. */
+        if (lno == 0 || F_ISSET(sp, SC_TINPUT)) {
+                if (db_get(sp, lno, 0, &p, &len))
+                        return (1);
+                lines[0].data = p;
+                lines[0].size = len;
+                *firstp = lno;
+                *cntp = 1;
+                return (0);
+        }
+
+        key.data = &lno;
+        key.size = sizeof(lno);
+        data.data = lines;
+        data.size = *cntp;
+        switch (ep->db->seq(ep->db,
+            &key, &data, dir == BACKWARD ? R_PREVV : R_NEXTV)) {
+        case -1:
+                db_err(sp, lno);
+                /* FALLTHROUGH */
+        case 1:
+                *cntp = 0;
+                return (1);
+        default:
+                break;
+        }
+        memcpy(firstp, key.data, sizeof(recno_t));
+        *cntp = data.size;
         return (0);
 }
 
@@ -189,9 +259,9 @@ db_delete(SCR *sp, recno_t lno)
         }
 
         /* Update marks, @ and global commands. */
-        if (mark_insdel(sp, LINE_DELETE, lno))
+        if (mark_insdel(sp, LINE_DELETE, lno, 1))
                 return (1);
-        if (ex_g_insdel(sp, LINE_DELETE, lno))
+        if (ex_g_insdel(sp, LINE_DELETE, lno, 1))
                 return (1);
 
         /* Log change. */
@@ -206,9 +276,9 @@ db_delete(SCR *sp, recno_t lno)
                 return (1);
         }
 
-        /* Flush the cache, update line count, before screen update. */
-        if (lno <= ep->c_lno)
-                ep->c_lno = OOBLNO;
+        /* Update the cache and line count, before screen update. */
+        db_cinval(ep, lno, 1);
+        db_crenum(ep, lno + 1, -1);
         if (ep->c_nlines != OOBLNO)
                 --ep->c_nlines;
 
@@ -218,7 +288,75 @@ db_delete(SCR *sp, recno_t lno)
         F_SET(ep, F_MODIFIED | F_RCV_SYNC);
 
         /* Update screen. */
-        return (scr_update(sp, lno, LINE_DELETE, 1));
+        return (scr_update(sp, lno, LINE_DELETE, 1, 1));
+}
+
+/*
+ * db_delete_range --
+ *      Delete a range of lines from the file.
+ *
+ * PUBLIC: int db_delete_range(SCR *, recno_t, recno_t);
+ */
+
+int
+db_delete_range(SCR *sp, recno_t lno, recno_t cnt)
+{
+        DBT key;
+        EXF *ep;
+        recno_t n;
+        int rval;
+
+        /* Check for no underlying file. */
+        if ((ep = sp->ep) == NULL) {
+                ex_emsg(sp, NULL, EXM_NOFILEYET);
+                return (1);
+        }
+
+        if (cnt == 0)
+                return (0);
+        if (cnt == 1)
+                return (db_delete(sp, lno));
+
+        /* Update marks, @ and global commands. */
+        if (mark_insdel(sp, LINE_DELETE, lno, cnt))
+                return (1);
+        if (ex_g_insdel(sp, LINE_DELETE, lno, cnt))
+                return (1);
+
+        /* Log change. */
+        log_lines(sp, lno, cnt, NULL, LOG_LINES_DELETE);
+
+        /*
+         * Update file.  Each deletion moves the next line of the range
+         * to lno.  If one fails, account for the lines that are gone.
+         * The DB may reset the key, so set it every time.
+         */
+        for (rval = 0, n = 0; n < cnt; ++n) {
+                key.data = &lno;
+                key.size = sizeof(lno);
+                if (ep->db->del(ep->db, &key, 0) != 0) {
+                        msgq(sp, M_SYSERR, "unable to delete line %'lu",
+                            (unsigned long)(lno + n));
+                        rval = 1;
+                        break;
+                }
+        }
+        if ((cnt = n) == 0)
+                return (rval);
+
+        /* Update the cache and line count, before screen update. */
+        db_cinval(ep, lno, cnt);
+        db_crenum(ep, lno + cnt, -(int)cnt);
+        if (ep->c_nlines != OOBLNO)
+                ep->c_nlines -= cnt;
+
+        /* File now modified. */
+        if (F_ISSET(ep, F_FIRSTMODIFY))
+                (void)rcv_init(sp);
+        F_SET(ep, F_MODIFIED | F_RCV_SYNC);
+
+        /* Update screen. */
+        return (scr_update(sp, lno, LINE_DELETE, cnt, 1) || rval);
 }
 
 /*
@@ -252,9 +390,8 @@ db_append(SCR *sp, int update, recno_t lno, char *p, size_t len)
                 return (1);
         }
 
-        /* Flush the cache, update line count, before screen update. */
-        if (lno < ep->c_lno)
-                ep->c_lno = OOBLNO;
+        /* Update the cache and line count, before screen update. */
+        db_crenum(ep, lno + 1, 1);
         if (ep->c_nlines != OOBLNO)
                 ++ep->c_nlines;
 
@@ -268,9 +405,9 @@ db_append(SCR *sp, int update, recno_t lno, char *p, size_t len)
 
         /* Update marks, @ and global commands. */
         rval = 0;
-        if (mark_insdel(sp, LINE_INSERT, lno + 1))
+        if (mark_insdel(sp, LINE_INSERT, lno + 1, 1))
                 rval = 1;
-        if (ex_g_insdel(sp, LINE_INSERT, lno + 1))
+        if (ex_g_insdel(sp, LINE_INSERT, lno + 1, 1))
                 rval = 1;
 
         /*
@@ -284,7 +421,77 @@ db_append(SCR *sp, int update, recno_t lno, char *p, size_t len)
          * it has to know not to update the screen again.
          */
 
-        return (scr_update(sp, lno, LINE_APPEND, update) || rval);
+        return (scr_update(sp, lno, LINE_APPEND, 1, update) || rval);
+}
+
+/*
+ * db_append_range --
+ *      Append a vector of lines into the file.  The lines are logged,
+ *      and the marks, @ and global commands and screens are updated,
+ *      once for the whole vector.
+ *
+ * PUBLIC: int db_append_range(SCR *, int, recno_t, DBT *, recno_t);
+ */
+
+int
+db_append_range(SCR *sp, int update, recno_t lno, DBT *lines, recno_t cnt)
+{
+        DBT data, key;
+        EXF *ep;
+        recno_t tl;
+        int rval;
+
+        /* Check for no underlying file. */
+        if ((ep = sp->ep) == NULL) {
+                ex_emsg(sp, NULL, EXM_NOFILEYET);
+                return (1);
+        }
+
+        if (cnt == 0)
+                return (0);
+        if (cnt == 1)
+                return (db_append(sp,
+                    update, lno, lines[0].data, lines[0].size));
+
+        /*
+         * Update file.  If the append fails part way, the key is the last
+         * line that was appended.
+         */
+        tl = lno;
+        key.data = &tl;
+        key.size = sizeof(tl);
+        data.data = lines;
+        data.size = cnt;
+        rval = 0;
+        if (ep->db->put(ep->db, &key, &data, R_IAFTERV) == -1) {
+                msgq(sp, M_SYSERR,
+                    "unable to append to line %'lu", (unsigned long)lno);
+                rval = 1;
+        }
+        if ((cnt = *(recno_t *)key.data - lno) == 0)
+                return (rval);
+
+        /* Update the cache and line count, before screen update. */
+        db_crenum(ep, lno + 1, (int)cnt);
+        if (ep->c_nlines != OOBLNO)
+                ep->c_nlines += cnt;
+
+        /* File now dirty. */
+        if (F_ISSET(ep, F_FIRSTMODIFY))
+                (void)rcv_init(sp);
+        F_SET(ep, F_MODIFIED | F_RCV_SYNC);
+
+        /* Log change. */
+        log_lines(sp, lno + 1, cnt, lines, LOG_LINES_APPEND);
+
+        /* Update marks, @ and global commands. */
+        if (mark_insdel(sp, LINE_INSERT, lno + 1, cnt))
+                rval = 1;
+        if (ex_g_insdel(sp, LINE_INSERT, lno + 1, cnt))
+                rval = 1;
+
+        /* Update screen, see the comment in db_append. */
+        return (scr_update(sp, lno, LINE_APPEND, cnt, update) || rval);
 }
 
 /*
@@ -318,9 +525,8 @@ db_insert(SCR *sp, recno_t lno, char *p, size_t len)
                 return (1);
         }
 
-        /* Flush the cache, update line count, before screen update. */
-        if (lno >= ep->c_lno)
-                ep->c_lno = OOBLNO;
+        /* Update the cache and line count, before screen update. */
+        db_crenum(ep, lno, 1);
         if (ep->c_nlines != OOBLNO)
                 ++ep->c_nlines;
 
@@ -334,13 +540,13 @@ db_insert(SCR *sp, recno_t lno, char *p, size_t len)
 
         /* Update marks, @ and global commands. */
         rval = 0;
-        if (mark_insdel(sp, LINE_INSERT, lno))
+        if (mark_insdel(sp, LINE_INSERT, lno, 1))
                 rval = 1;
-        if (ex_g_insdel(sp, LINE_INSERT, lno))
+        if (ex_g_insdel(sp, LINE_INSERT, lno, 1))
                 rval = 1;
 
         /* Update screen. */
-        return (scr_update(sp, lno, LINE_INSERT, 1) || rval);
+        return (scr_update(sp, lno, LINE_INSERT, 1, 1) || rval);
 }
 
 /*
@@ -362,8 +568,8 @@ db_set(SCR *sp, recno_t lno, char *p, size_t len)
                 return (1);
         }
 
-        /* Log before change. */
-        log_line(sp, lno, LOG_LINE_RESET_B);
+        /* Log the change. */
+        log_reset(sp, lno, p, len);
 
         /* Update file. */
         key.data = &lno;
@@ -377,19 +583,15 @@ db_set(SCR *sp, recno_t lno, char *p, size_t len)
         }
 
         /* Flush the cache, before logging or screen update. */
-        if (lno == ep->c_lno)
-                ep->c_lno = OOBLNO;
+        db_cinval(ep, lno, 1);
 
         /* File now dirty. */
         if (F_ISSET(ep, F_FIRSTMODIFY))
                 (void)rcv_init(sp);
         F_SET(ep, F_MODIFIED | F_RCV_SYNC);
 
-        /* Log after change. */
-        log_line(sp, lno, LOG_LINE_RESET_F);
-
         /* Update screen. */
-        return (scr_update(sp, lno, LINE_RESET, 1));
+        return (scr_update(sp, lno, LINE_RESET, 1, 1));
 }
 
 /*
@@ -475,11 +677,13 @@ db_last(SCR *sp, recno_t *lnop)
                 break;
         }
 
+        /* The whole file has been read. */
+        F_CLR(ep, F_PARTIAL);
+
         /* Fill the cache. */
         memcpy(&lno, key.data, sizeof(lno));
-        ep->c_nlines = ep->c_lno = lno;
-        ep->c_len = data.size;
-        ep->c_lp = data.data;
+        ep->c_nlines = lno;
+        (void)db_cfill(ep, lno, data.data, data.size);
 
         /* Return the value. */
         *lnop = (F_ISSET(sp, SC_TINPUT) &&
@@ -488,6 +692,80 @@ db_last(SCR *sp, recno_t *lnop)
         return (0);
 }
 
+/*
+ * db_partial --
+ *      Return if the file hasn't been completely read, that is, if
+ *      db_last() may have to read the rest of the file.
+ *
+ * PUBLIC: int db_partial(SCR *);
+ */
+
+int
+db_partial(SCR *sp)
+{
+        return (sp->ep != NULL && F_ISSET(sp->ep, F_PARTIAL));
+}
+
+/*
+ * db_idle --
+ *      Read ahead in a partially read file, a chunk of lines at a time.
+ *      Called while waiting for input, returns if there's more to read.
+ *
+ * PUBLIC: int db_idle(SCR *);
+ */
+
+int
+db_idle(SCR *sp)
+{
+        DBT data, key;
+        EXF *ep;
+        recno_t lno;
+
+        if ((ep = sp->ep) == NULL || !F_ISSET(ep, F_PARTIAL))
+                return (0);
+
+        /*
+         * Getting a line reads the file up to and past it.  The line number
+         * is only a hint, it doesn't matter if lines were added or deleted.
+         */
+        lno = ep->i_lno + DB_IDLECHUNK;
+        key.data = &lno;
+        key.size = sizeof(lno);
+        switch (ep->db->get(ep->db, &key, &data, 0)) {
+        case -1:
+                msgq(sp, M_SYSERR, "unable to read file");
+                /* FALLTHROUGH */
+        case 1:
+                F_CLR(ep, F_PARTIAL);
+                return (0);
+        default:
+                break;
+        }
+
+        ep->i_lno = lno;
+        return (1);
+}
+
+/*
+ * db_cache_end --
+ *      Discard the line cache.
+ *
+ * PUBLIC: void db_cache_end(EXF *);
+ */
+
+void
+db_cache_end(EXF *ep)
+{
+        struct _lcache *cp;
+
+        for (cp = ep->c_line; cp < ep->c_line + DB_CACHESIZE; ++cp) {
+                free(cp->lp);
+                cp->lp = NULL;
+                cp->blen = 0;
+                cp->lno = OOBLNO;
+        }
+}
+
 /*
  * db_err --
  *      Report a line error.
@@ -509,19 +787,152 @@ db_err(SCR *sp, recno_t lno)
  */
 
 static int
-scr_update(SCR *sp, recno_t lno, lnop_t op, int current)
+scr_update(SCR *sp, recno_t lno, lnop_t op, recno_t cnt, int current)
 {
         EXF *ep;
         SCR *tsp;
 
+        ep = sp->ep;
+        ++ep->c_chg;
+
         if (F_ISSET(sp, SC_EX))
                 return (0);
 
-        ep = sp->ep;
         if (ep->refcnt != 1)
                 TAILQ_FOREACH(tsp, &sp->gp->dq, q)
                         if (sp != tsp && tsp->ep == ep)
-                                if (vs_change(tsp, lno, op))
+                                if (vs_change_range(tsp, lno, cnt, op))
                                         return (1);
-        return (current ? vs_change(sp, lno, op) : 0);
+        return (current ? vs_change_range(sp, lno, cnt, op) : 0);
+}
+
+/*
+ * db_cfind --
+ *      Return the cached copy of a line, if any.
+ */
+
+static struct _lcache *
+db_cfind(EXF *ep, recno_t lno)
+{
+        struct _lcache *cp, *ecp;
+
+        cp = &ep->c_line[DB_CSET(lno) * DB_CACHEWAYS];
+        for (ecp = cp + DB_CACHEWAYS; cp < ecp; ++cp)
+                if (cp->lno == lno)
+                        return (cp);
+        return (NULL);
+}
+
+/*
+ * db_cvictim --
+ *      Return the entry to replace in a line's cache set: an empty entry,
+ *      an entry for a line that belongs in another set, or the least
+ *      recently used entry.
+ */
+
+static struct _lcache *
+db_cvictim(EXF *ep, recno_t lno)
+{
+        struct _lcache *cp, *ecp, *vp;
+        size_t set;
+
+        set = DB_CSET(lno);
+        cp = &ep->c_line[set * DB_CACHEWAYS];
+        for (vp = cp, ecp = cp + DB_CACHEWAYS; cp < ecp; ++cp) {
+                if (cp->lno == OOBLNO || DB_CSET(cp->lno) != set)
+                        return (cp);
+                if (cp->used < vp->used)
+                        vp = cp;
+        }
+        return (vp);
+}
+
+/*
+ * db_cfill --
+ *      Copy a line into the cache.
+ */
+
+static struct _lcache *
+db_cfill(EXF *ep, recno_t lno, char *p, size_t len)
+{
+        struct _lcache *cp;
+        char *bp;
+
+        if ((cp = db_cfind(ep, lno)) == NULL)
+                cp = db_cvictim(ep, lno);
+        cp->lno = OOBLNO;
+        if (len >= cp->blen) {
+                /* Use +1 so empty lines have a buffer. */
+                if ((bp = realloc(cp->lp, len + 1)) == NULL)
+                        return (NULL);
+                cp->lp = bp;
+                cp->blen = len + 1;
+        }
+        if (len != 0)
+                memcpy(cp->lp, p, len);
+        cp->len = len;
+        cp->lno = lno;
+        cp->used = ++ep->c_clock;
+        return (cp);
+}
+
+/*
+ * db_cinval --
+ *      Discard the cached copies of a range of lines.
+ */
+
+static void
+db_cinval(EXF *ep, recno_t lno, recno_t cnt)
+{
+        struct _lcache *cp;
+
+        if (cnt == 1) {
+                if ((cp = db_cfind(ep, lno)) != NULL)
+                        cp->lno = OOBLNO;
+                return;
+        }
+        for (cp = ep->c_line; cp < ep->c_line + DB_CACHESIZE; ++cp)
+                if (cp->lno != OOBLNO && cp->lno >= lno && cp->lno - lno < cnt)
+                        cp->lno = OOBLNO;
+}
+
+/*
+ * db_crenum --
+ *      Renumber the cached copies of a line and the lines after it, after
+ *      lines were inserted or deleted, and move them to their new sets.
+ */
+
+static void
+db_crenum(EXF *ep, recno_t lno, int delta)
+{
+        struct _lcache *cp, *vp, tmp;
+        size_t cnt;
+        int moved;
+
+        for (moved = 0, cp = ep->c_line; cp < ep->c_line + DB_CACHESIZE; ++cp)
+                if (cp->lno != OOBLNO && cp->lno >= lno) {
+                        cp->lno += delta;
+                        moved = 1;
+                }
+        if (!moved)
+                return;
+
+        /*
+         * Swap each entry that's now in the wrong set with the victim in the
+         * right one.  If the victim belongs in that set, it's discarded,
+         * otherwise it's the next entry to move.  Entries don't move out of
+         * the right set except to be discarded, so this terminates.
+         */
+        for (cnt = 0, cp = ep->c_line; cnt < DB_CACHESIZE; ++cnt, ++cp)
+                while (cp->lno != OOBLNO &&
+                    DB_CSET(cp->lno) != cnt / DB_CACHEWAYS) {
+                        vp = db_cvictim(ep, cp->lno);
+                        tmp = *vp;
+                        *vp = *cp;
+                        *cp = tmp;
+                        if (cp->lno != OOBLNO &&
+                            DB_CSET(cp->lno) == (size_t)(vp - ep->c_line) /
+                            DB_CACHEWAYS)
+                                cp->lno = OOBLNO;
+                }
 }
@@ -43,24 +43,34 @@
  *      LOG_LINE_APPEND         recno_t         char *
  *      LOG_LINE_DELETE         recno_t         char *
  *      LOG_LINE_INSERT         recno_t         char *
- *      LOG_LINE_RESET_F        recno_t         char *
- *      LOG_LINE_RESET_B        recno_t         char *
+ *      LOG_LINE_RESET          recno_t         size_t[4]       char *
  *      LOG_MARK                LMARK
+ *      LOG_LINES_APPEND        recno_t         recno_t         lines
+ *      LOG_LINES_DELETE        recno_t         recno_t         lines
  *
- * We do before image physical logging.  This means that the editor layer
- * MAY NOT modify records in place, even if simply deleting or overwriting
- * characters.  Since the smallest unit of logging is a line, we're using
- * up lots of space.  This may eventually have to be reduced, probably by
- * doing logical logging, which is a much cooler database phrase.
+ * The LOG_LINES records are the first line number and the count of a range
+ * of lines that were appended or deleted together, followed by each line as
+ * a size_t length and the bytes.  Large ranges are split into several
+ * records, see log_lines.
+ *
+ * We do before image physical logging of inserted and deleted lines.  This
+ * means that the editor layer MAY NOT modify records in place, even if
+ * simply deleting or overwriting characters.  Changed lines are logged as
+ * a delta instead, because logging a long line twice to change a single
+ * character of it uses up lots of space.  The LOG_LINE_RESET record is the
+ * length of the prefix and the suffix the line had in common before and
+ * after the change, and the lengths of the old and new text between them,
+ * followed by the old text and the new text.  Rolling the change back or
+ * forward replaces the text between the prefix and suffix of the current
+ * line, so the deltas for a line have to be applied in order.
  *
  * The implementation of the historic vi 'u' command, using roll-forward and
  * roll-back, is simple.  Each set of changes has a LOG_CURSOR_INIT record,
  * followed by a number of other records, followed by a LOG_CURSOR_END record.
- * LOG_LINE_RESET records come in pairs.  The first is a LOG_LINE_RESET_B
- * record, and is the line before the change.  The second is LOG_LINE_RESET_F,
- * and is the line after the change.  Roll-back is done by backing up to the
- * first LOG_CURSOR_INIT record before a change.  Roll-forward is done in a
- * similar fashion.
+ * Roll-back is done by backing up to the first LOG_CURSOR_INIT record before
+ * a change.  Roll-forward is done in a similar fashion.  If the undolimit
+ * option is set, the oldest sets of changes are discarded from the front of
+ * the log when a new one is started, see log_trim.
  *
  * The 'U' command is implemented by rolling backward to a LOG_CURSOR_END
  * record for a line different from the current one.  It should be noted that
@@ -71,6 +81,19 @@
 
 static int      log_cursor1(SCR *, int);
 static void     log_err(SCR *, char *, int);
+static int      log_lines1(SCR *, unsigned char *, int);
+static int      log_reset1(SCR *, unsigned char *, int);
+static int      log_trim(SCR *);
+
+/* Maximum text in a LOG_LINES record, a longer range is split. */
+#define LOG_LINESMAX    (1024 * 1024)
+
+/* Length of a LOG_LINES record header. */
+#define LOG_LINESHDR    (sizeof(unsigned char) + 2 * sizeof(recno_t))
+
+/* Length of a LOG_LINE_RESET record header. */
+#define LOG_RESETHDR                                                    \
+        (sizeof(unsigned char) + sizeof(recno_t) + 4 * sizeof(size_t))
 
 /* Try and restart the log on failure, i.e. if we run out of memory. */
 #define LOG_ERR {                                                       \
@@ -102,6 +125,7 @@ log_init(SCR *sp, EXF *ep)
         ep->l_cursor.lno = 1;           /* XXX Any valid recno. */
         ep->l_cursor.cno = 0;
         ep->l_high = ep->l_cur = 1;
+        ep->l_sets = 0;
 
         ep->log = dbopen(NULL, O_CREAT | O_NONBLOCK | O_RDWR,
             S_IRUSR | S_IWUSR, DB_RECNO, NULL);
@@ -139,6 +163,7 @@ log_end(SCR *sp, EXF *ep)
         ep->l_cursor.lno = 1;           /* XXX Any valid recno. */
         ep->l_cursor.cno = 0;
         ep->l_high = ep->l_cur = 1;
+        ep->l_sets = 0;
         return (0);
 }
 
@@ -185,6 +210,9 @@ log_cursor1(SCR *sp, int type)
         EXF *ep;
 
         ep = sp->ep;
+        if (type == LOG_CURSOR_INIT && log_trim(sp))
+                return (1);
+
         BINC_RET(sp, ep->l_lp, ep->l_len, sizeof(unsigned char) + sizeof(MARK));
         ep->l_lp[0] = type;
         memmove(ep->l_lp + sizeof(unsigned char), &ep->l_cursor, sizeof(MARK));
@@ -199,6 +227,49 @@ log_cursor1(SCR *sp, int type)
         /* Reset high water mark. */
         ep->l_high = ++ep->l_cur;
 
+        if (type == LOG_CURSOR_INIT)
+                ++ep->l_sets;
+        return (0);
+}
+
+/*
+ * log_trim --
+ *      Discard the oldest sets of changes from the log, so that a new
+ *      set doesn't take it over the undolimit option.
+ */
+
+static int
+log_trim(SCR *sp)
+{
+        DBT data, key;
+        EXF *ep;
+        recno_t lno;
+        unsigned long limit;
+
+        ep = sp->ep;
+        if ((limit = O_VAL(sp, O_UNDOLIMIT)) == 0)
+                return (0);
+
+        /*
+         * Deleting the first record renumbers the rest of them.  Delete
+         * records until the first one starts the next set of changes.
+         */
+        lno = 1;
+        key.data = &lno;
+        key.size = sizeof(recno_t);
+        while (ep->l_sets >= limit && ep->l_cur > 1) {
+                do {
+                        if (ep->log->del(ep->log, &key, 0) == -1)
+                                LOG_ERR;
+                        --ep->l_cur;
+                        --ep->l_high;
+                        if (ep->l_cur == 1)
+                                break;
+                        if (ep->log->get(ep->log, &key, &data, 0))
+                                LOG_ERR;
+                } while (*(unsigned char *)data.data != LOG_CURSOR_INIT);
+                --ep->l_sets;
+        }
         return (0);
 }
 
@@ -237,25 +308,9 @@ log_line(SCR *sp, recno_t lno, unsigned int action)
                 ep->l_cursor.lno = OOBLNO;
         }
 
-        /*
-         * Put out the changes.  If it's a LOG_LINE_RESET_B call, it's a
-         * special case, avoid the caches.  Also, if it fails and it's
-         * line 1, it just means that the user started with an empty file,
-         * so fake an empty length line.
-         */
-
-        if (action == LOG_LINE_RESET_B) {
-                if (db_get(sp, lno, DBG_NOCACHE, &lp, &len)) {
-                        if (lno != 1) {
-                                db_err(sp, lno);
-                                return (1);
-                        }
-                        len = 0;
-                        lp = "";
-                }
-        } else
-                if (db_get(sp, lno, DBG_FATAL, &lp, &len))
-                        return (1);
+        /* Put out the changes. */
+        if (db_get(sp, lno, DBG_FATAL, &lp, &len))
+                return (1);
         BINC_RET(sp,
             ep->l_lp, ep->l_len, len + sizeof(unsigned char) + sizeof(recno_t));
         ep->l_lp[0] = action;
@@ -275,6 +330,155 @@ log_line(SCR *sp, recno_t lno, unsigned int action)
         return (0);
 }
 
+/*
+ * log_reset --
+ *      Log a line that is about to be replaced.
+ *
+ * PUBLIC: int log_reset(SCR *, recno_t, char *, size_t);
+ */
+
+int
+log_reset(SCR *sp, recno_t lno, char *p, size_t len)
+{
+        DBT data, key;
+        EXF *ep;
+        size_t hdr[4], olen, pre, suf;
+        char *lp;
+
+        ep = sp->ep;
+        if (F_ISSET(ep, F_NOLOG))
+                return (0);
+
+        /* See the comment in log_line. */
+        F_CLR(ep, F_UNDO);
+
+        /* Put out one initial cursor record per set of changes. */
+        if (ep->l_cursor.lno != OOBLNO) {
+                if (log_cursor1(sp, LOG_CURSOR_INIT))
+                        return (1);
+                ep->l_cursor.lno = OOBLNO;
+        }
+
+        /*
+         * Get the old line, avoiding the caches.  If it fails and it's
+         * line 1, it just means that the user started with an empty file,
+         * so fake an empty length line.
+         */
+        if (db_get(sp, lno, DBG_NOCACHE, &lp, &olen)) {
+                if (lno != 1) {
+                        db_err(sp, lno);
+                        return (1);
+                }
+                olen = 0;
+                lp = "";
+        }
+
+        /* Only the text between the common prefix and suffix is logged. */
+        for (pre = 0; pre < olen && pre < len && lp[pre] == p[pre]; ++pre)
+                ;
+        for (suf = 0; suf < olen - pre && suf < len - pre &&
+            lp[olen - suf - 1] == p[len - suf - 1]; ++suf)
+                ;
+        hdr[0] = pre;
+        hdr[1] = suf;
+        hdr[2] = olen - pre - suf;
+        hdr[3] = len - pre - suf;
+
+        BINC_RET(sp, ep->l_lp, ep->l_len, LOG_RESETHDR + hdr[2] + hdr[3]);
+        ep->l_lp[0] = LOG_LINE_RESET;
+        memmove(ep->l_lp + sizeof(unsigned char), &lno, sizeof(recno_t));
+        memmove(ep->l_lp + sizeof(unsigned char) + sizeof(recno_t),
+            hdr, sizeof(hdr));
+        memmove(ep->l_lp + LOG_RESETHDR, lp + pre, hdr[2]);
+        memmove(ep->l_lp + LOG_RESETHDR + hdr[2], p + pre, hdr[3]);
+
+        key.data = &ep->l_cur;
+        key.size = sizeof(recno_t);
+        data.data = ep->l_lp;
+        data.size = LOG_RESETHDR + hdr[2] + hdr[3];
+        if (ep->log->put(ep->log, &key, &data, 0) == -1)
+                LOG_ERR;
+
+        /* Reset high water mark. */
+        ep->l_high = ++ep->l_cur;
+
+        return (0);
+}
+
+/*
+ * log_lines --
+ *      Log a range of lines that were appended, or are about to be deleted.
+ *      If lines is NULL, the lines are read from the file.
+ *
+ * PUBLIC: int log_lines(SCR *, recno_t, recno_t, DBT *, unsigned int);
+ */
+
+int
+log_lines(SCR *sp, recno_t lno, recno_t cnt, DBT *lines, unsigned int action)
+{
+        DBT data, key;
+        EXF *ep;
+        recno_t b, n, rlno;
+        size_t len, off;
+        char *lp;
+
+        ep = sp->ep;
+        if (F_ISSET(ep, F_NOLOG))
+                return (0);
+
+        /* See the comment in log_line. */
+        F_CLR(ep, F_UNDO);
+
+        /* Put out one initial cursor record per set of changes. */
+        if (ep->l_cursor.lno != OOBLNO) {
+                if (log_cursor1(sp, LOG_CURSOR_INIT))
+                        return (1);
+                ep->l_cursor.lno = OOBLNO;
+        }
+
+        /*
+         * Put out the lines, LOG_LINESMAX bytes or so to a record.  Appended
+         * lines are logged where they are in the file.  Deleted lines are
+         * logged as deleted one record after another at the same place, so
+         * every record's line number is lno.
+         */
+        for (rlno = lno, b = 0; b < cnt; b += n) {
+                for (off = LOG_LINESHDR, n = 0;
+                    b + n < cnt && off <= LOG_LINESMAX;
+                    ++n, off += sizeof(size_t) + len) {
+                        if (lines != NULL) {
+                                lp = lines[b + n].data;
+                                len = lines[b + n].size;
+                        } else if (db_get(sp, lno + b + n,
+                            DBG_FATAL | DBG_NOCACHE, &lp, &len))
+                                return (1);
+                        BINC_RET(sp, ep->l_lp, ep->l_len,
+                            off + sizeof(size_t) + len);
+                        memmove(ep->l_lp + off, &len, sizeof(size_t));
+                        memmove(ep->l_lp + off + sizeof(size_t), lp, len);
+                }
+                ep->l_lp[0] = action;
+                memmove(ep->l_lp + sizeof(unsigned char),
+                    &rlno, sizeof(recno_t));
+                memmove(ep->l_lp + sizeof(unsigned char) + sizeof(recno_t),
+                    &n, sizeof(recno_t));
+
+                key.data = &ep->l_cur;
+                key.size = sizeof(recno_t);
+                data.data = ep->l_lp;
+                data.size = off;
+                if (ep->log->put(ep->log, &key, &data, 0) == -1)
+                        LOG_ERR;
+
+                /* Reset high water mark. */
+                ep->l_high = ++ep->l_cur;
+
+                if (action == LOG_LINES_APPEND)
+                        rlno += n;
+        }
+        return (0);
+}
+
 /*
  * log_mark --
  *      Log a mark position.  For the log to work, we assume that there
@@ -359,6 +563,7 @@ log_backward(SCR *sp, MARK *rp)
                         LOG_ERR;
                 switch (*(p = (unsigned char *)data.data)) {
                 case LOG_CURSOR_INIT:
+                        --ep->l_sets;
                         if (didop) {
                                 memmove(rp, p + sizeof(unsigned char), sizeof(MARK));
                                 F_CLR(ep, F_NOLOG);
@@ -384,14 +589,20 @@ log_backward(SCR *sp, MARK *rp)
                                 goto err;
                         ++sp->rptlines[L_ADDED];
                         break;
-                case LOG_LINE_RESET_F:
+                case LOG_LINES_APPEND:
+                        didop = 1;
+                        if (log_lines1(sp, p, 0))
+                                goto err;
                         break;
-                case LOG_LINE_RESET_B:
+                case LOG_LINES_DELETE:
+                        didop = 1;
+                        if (log_lines1(sp, p, 1))
+                                goto err;
+                        break;
+                case LOG_LINE_RESET:
                         didop = 1;
                         memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (db_set(sp, lno, p + sizeof(unsigned char) +
-                            sizeof(recno_t), data.size - sizeof(unsigned char) -
-                            sizeof(recno_t)))
+                        if (log_reset1(sp, p, 0))
                                 goto err;
                         if (sp->rptlchange != lno) {
                                 sp->rptlchange = lno;
@@ -436,6 +647,7 @@ log_setline(SCR *sp)
         LMARK lm;
         MARK m;
         recno_t lno;
+        int moved;
         unsigned char *p;
 
         ep = sp->ep;
@@ -453,12 +665,13 @@ log_setline(SCR *sp)
         key.data = &ep->l_cur;          /* Initialize db request. */
         key.size = sizeof(recno_t);
 
-        for (;;) {
+        for (moved = 0;;) {
                 --ep->l_cur;
                 if (ep->log->get(ep->log, &key, &data, 0))
                         LOG_ERR;
                 switch (*(p = (unsigned char *)data.data)) {
                 case LOG_CURSOR_INIT:
+                        --ep->l_sets;
                         memmove(&m, p + sizeof(unsigned char), sizeof(MARK));
                         if (m.lno != sp->lno || ep->l_cur == 1) {
                                 F_CLR(ep, F_NOLOG);
@@ -476,14 +689,20 @@ log_setline(SCR *sp)
                 case LOG_LINE_APPEND:
                 case LOG_LINE_INSERT:
                 case LOG_LINE_DELETE:
-                case LOG_LINE_RESET_F:
+                case LOG_LINES_APPEND:
+                case LOG_LINES_DELETE:
+                        /*
+                         * The line changes are deltas, and can't be applied
+                         * once an earlier line was added or deleted, as the
+                         * line at this line number may not be the same one.
+                         */
+                        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
+                        if (lno <= sp->lno)
+                                moved = 1;
                         break;
-                case LOG_LINE_RESET_B:
+                case LOG_LINE_RESET:
                         memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (lno == sp->lno &&
-                            db_set(sp, lno, p + sizeof(unsigned char) +
-                            sizeof(recno_t), data.size - sizeof(unsigned char) -
-                            sizeof(recno_t)))
+                        if (!moved && lno == sp->lno && log_reset1(sp, p, 0))
                                 goto err;
                         if (sp->rptlchange != lno) {
                                 sp->rptlchange = lno;
@@ -554,6 +773,7 @@ log_forward(SCR *sp, MARK *rp)
                         }
                         break;
                 case LOG_CURSOR_INIT:
+                        ++ep->l_sets;
                         break;
                 case LOG_LINE_APPEND:
                 case LOG_LINE_INSERT:
@@ -572,14 +792,20 @@ log_forward(SCR *sp, MARK *rp)
                                 goto err;
                         ++sp->rptlines[L_DELETED];
                         break;
-                case LOG_LINE_RESET_B:
+                case LOG_LINES_APPEND:
+                        didop = 1;
+                        if (log_lines1(sp, p, 1))
+                                goto err;
+                        break;
+                case LOG_LINES_DELETE:
+                        didop = 1;
+                        if (log_lines1(sp, p, 0))
+                                goto err;
                         break;
-                case LOG_LINE_RESET_F:
+                case LOG_LINE_RESET:
                         didop = 1;
                         memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
-                        if (db_set(sp, lno, p + sizeof(unsigned char) +
-                            sizeof(recno_t), data.size - sizeof(unsigned char) -
-                            sizeof(recno_t)))
+                        if (log_reset1(sp, p, 1))
                                 goto err;
                         if (sp->rptlchange != lno) {
                                 sp->rptlchange = lno;
@@ -603,6 +829,102 @@ err:    F_CLR(ep, F_NOLOG);
         return (1);
 }
 
+/*
+ * log_lines1 --
+ *      Insert the lines in a LOG_LINES record back into the file, or
+ *      delete them from it.
+ */
+
+static int
+log_lines1(SCR *sp, unsigned char *p, int insert)
+{
+        DBT *lines;
+        recno_t cnt, lno, n;
+        size_t len;
+        unsigned char *lp;
+        int rval;
+
+        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
+        memmove(&cnt, p + sizeof(unsigned char) + sizeof(recno_t),
+            sizeof(recno_t));
+
+        if (!insert) {
+                if (db_delete_range(sp, lno, cnt))
+                        return (1);
+                sp->rptlines[L_DELETED] += cnt;
+                return (0);
+        }
+
+        lines = NULL;
+        REALLOCARRAY(sp, lines, cnt, sizeof(DBT));
+        if (lines == NULL)
+                return (1);
+        for (lp = p + LOG_LINESHDR, n = 0; n < cnt; ++n) {
+                memmove(&len, lp, sizeof(size_t));
+                lines[n].data = lp + sizeof(size_t);
+                lines[n].size = len;
+                lp += sizeof(size_t) + len;
+        }
+        rval = db_append_range(sp, 1, lno - 1, lines, cnt);
+        free(lines);
+        if (rval)
+                return (1);
+        sp->rptlines[L_ADDED] += cnt;
+        return (0);
+}
+
+/*
+ * log_reset1 --
+ *      Roll a LOG_LINE_RESET record back or forward.
+ */
+
+static int
+log_reset1(SCR *sp, unsigned char *p, int forward)
+{
+        recno_t lno;
+        size_t blen, hdr[4], len, nlen, olen, pre, suf;
+        char *bp, *lp;
+        unsigned char *np;
+        int rval;
+
+        memmove(&lno, p + sizeof(unsigned char), sizeof(recno_t));
+        memmove(hdr, p + sizeof(unsigned char) + sizeof(recno_t), sizeof(hdr));
+        pre = hdr[0];
+        suf = hdr[1];
+        if (forward) {
+                olen = hdr[2];
+                nlen = hdr[3];
+                np = p + LOG_RESETHDR + hdr[2];
+        } else {
+                olen = hdr[3];
+                nlen = hdr[2];
+                np = p + LOG_RESETHDR;
+        }
+
+        /* The line must be the one the change was logged against. */
+        if (db_get(sp, lno, 0, &lp, &len)) {
+                if (lno != 1 || pre + olen + suf != 0) {
+                        db_err(sp, lno);
+                        return (1);
+                }
+                len = 0;
+                lp = "";
+        }
+        if (len != pre + olen + suf) {
+                msgq(sp, M_ERR,
+                    "Log record doesn't match line %'lu", (unsigned long)lno);
+                return (1);
+        }
+
+        GET_SPACE_RET(sp, bp, blen, pre + nlen + suf);
+        memcpy(bp, lp, pre);
+        memcpy(bp + pre, np, nlen);
+        memcpy(bp + pre + nlen, lp + pre + olen, suf);
+        rval = db_set(sp, lno, bp, pre + nlen + suf);
+        FREE_SPACE(sp, bp, blen);
+        return (rval);
+}
+
 /*
  * log_err --
  *      Try and restart the log on failure, i.e. if we run out of memory.
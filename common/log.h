@@ -20,6 +20,7 @@
 #define LOG_LINE_APPEND         3
 #define LOG_LINE_DELETE         4
 #define LOG_LINE_INSERT         5
-#define LOG_LINE_RESET_F        6
-#define LOG_LINE_RESET_B        7
-#define LOG_MARK                8
+#define LOG_LINE_RESET          6
+#define LOG_MARK                7
+#define LOG_LINES_APPEND        8
+#define LOG_LINES_DELETE        9
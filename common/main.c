@@ -103,6 +103,7 @@ editor(GS *gp, int argc, char *argv[])
         TAILQ_INIT(&gp->dcb_store.textq);
         LIST_INIT(&gp->cutq);
         LIST_INIT(&gp->seqq);
+        TAILQ_INIT(&gp->recq);
 
         /* Set initial screen type and mode based on the program name. */
         readonly = 0;
@@ -525,6 +526,9 @@ v_end(GS *gp)
         /* Free map sequences. */
         seq_close(gp);
 
+        /* Free compiled RE's. */
+        re_close(gp);
+
         /* Free default buffer storage. */
         (void)text_lfree(&gp->dcb_store.textq);
 #endif /* if defined(DEBUG) || defined(PURIFY) */
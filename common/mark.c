@@ -25,6 +25,12 @@
 #include "common.h"
 
 static LMARK *mark_find(SCR *, CHAR_T);
+static int mark_index(SCR *);
+static int mark_cmp(const void *, const void *);
+static recno_t mark_lno(EXF *, size_t);
+static recno_t mark_curlno(EXF *, LMARK *);
+static size_t mark_lower(EXF *, recno_t);
+static void mark_shift(EXF *, size_t, recno_t);
 
 /*
  * Marks are maintained in a key sorted doubly linked list.  We can't
@@ -32,6 +38,17 @@ static LMARK *mark_find(SCR *, CHAR_T);
  * The underlying assumption is that users don't have more than, say,
  * 10 marks at any one time, so this will be is fast enough.
  *
+ * Inserting or deleting lines has to move every mark after the change,
+ * which is expensive when a large number of changes is made at once, e.g.
+ * by a global command.  So, the first insertion or deletion builds a second
+ * index of the marks, sorted by line, with a Fenwick (binary indexed) tree
+ * of pending line offsets.  The line number of the mark at index position
+ * i is its lno field plus the sum of the offsets of positions 0 through i,
+ * and moving all of the marks after a line is a single O(log n) update of
+ * the tree.  The index stays valid until someone needs to use or change the
+ * lno field directly, at which point mark_sync() applies the offsets to the
+ * marks and discards it.
+ *
  * Marks are fixed, and modifications to the line don't update the mark's
  * position in the line.  This can be hard.  If you add text to the line,
  * place a mark in that text, undo the addition and use ` to move to the
@@ -100,6 +117,12 @@ mark_end(SCR *sp, EXF *ep)
                 LIST_REMOVE(lmp, q);
                 free(lmp);
         }
+        free(ep->m_line);
+        free(ep->m_off);
+        ep->m_line = NULL;
+        ep->m_off = NULL;
+        ep->m_cnt = ep->m_len = 0;
+        F_CLR(ep, F_MARKLINE);
         return (0);
 }
 
@@ -114,6 +137,7 @@ int
 mark_get(SCR *sp, CHAR_T key, MARK *mp, mtype_t mtype)
 {
         LMARK *lmp;
+        recno_t lno;
 
         if (key == ABSMARK2)
                 key = ABSMARK1;
@@ -135,13 +159,14 @@ mark_get(SCR *sp, CHAR_T key, MARK *mp, mtype_t mtype)
          * you could use it in an empty file.  Make such a mark always work.
          */
 
-        if ((lmp->lno != 1 || lmp->cno != 0) && !db_exist(sp, lmp->lno)) {
+        lno = mark_curlno(sp->ep, lmp);
+        if ((lno != 1 || lmp->cno != 0) && !db_exist(sp, lno)) {
                 msgq(sp, mtype,
                     "Mark %s: cursor position no longer exists",
                     KEY_NAME(sp, key));
                 return (1);
         }
-        mp->lno = lmp->lno;
+        mp->lno = lno;
         mp->cno = lmp->cno;
         return (0);
 }
@@ -168,6 +193,7 @@ mark_set(SCR *sp, CHAR_T key, MARK *value, int userset)
          * by a previous undo.
          */
 
+        mark_sync(sp->ep);
         lmp = mark_find(sp, key);
         if (lmp == NULL || lmp->name != key) {
                 MALLOC_RET(sp, lmt, sizeof(LMARK));
@@ -212,30 +238,44 @@ mark_find(SCR *sp, CHAR_T key)
 
 /*
  * mark_insdel --
- *      Update the marks based on an insertion or deletion.
+ *      Update the marks based on an insertion or deletion of cnt lines.
  *
- * PUBLIC: int mark_insdel(SCR *, lnop_t, recno_t);
+ * PUBLIC: int mark_insdel(SCR *, lnop_t, recno_t, recno_t);
  */
 
 int
-mark_insdel(SCR *sp, lnop_t op, recno_t lno)
+mark_insdel(SCR *sp, lnop_t op, recno_t lno, recno_t cnt)
 {
-        LMARK *lmp;
-        recno_t lline;
+        EXF *ep;
+        LMARK *lmp, tmark;
+        recno_t lline, mlno;
+        size_t i;
 
+        ep = sp->ep;
         switch (op) {
         case LINE_APPEND:
                 /* All insert/append operations are done as inserts. */
                 abort();
         case LINE_DELETE:
-                LIST_FOREACH(lmp, &sp->ep->marks, q)
-                        if (lmp->lno >= lno) {
-                                if (lmp->lno == lno) {
-                                        F_SET(lmp, MARK_DELETED);
-                                        (void)log_mark(sp, lmp);
-                                } else
-                                        --lmp->lno;
-                        }
+                if (!F_ISSET(ep, F_MARKLINE) && mark_index(sp))
+                        return (1);
+
+                /*
+                 * Marks on the deleted lines are deleted (and logged), and
+                 * left on the first deleted line.  The index stays sorted.
+                 */
+
+                for (i = mark_lower(ep, lno);
+                    i < ep->m_cnt && (mlno = mark_lno(ep, i)) - lno < cnt;
+                    ++i) {
+                        lmp = ep->m_line[i];
+                        F_SET(lmp, MARK_DELETED);
+                        tmark = *lmp;
+                        tmark.lno = mlno;
+                        (void)log_mark(sp, &tmark);
+                        lmp->lno += lno - mlno;
+                }
+                mark_shift(ep, i, -cnt);
                 break;
         case LINE_INSERT:
 
@@ -249,24 +289,176 @@ mark_insdel(SCR *sp, lnop_t op, recno_t lno)
                  *
                  * work, i.e. historically you could mark the "line" in an empty
                  * file and replace it, and continue to use the mark.  Insane,
-                 * well, yes, I know, but someone complained.
+                 * well, yes, I know, but someone complained.  If more than
+                 * one line was added, the rest of them are inserts.
                  *
-                 * Check for line #2 before going to the end of the file.
+                 * Check for the line after the new ones before going to the
+                 * end of the file.
                  */
 
-                if (!db_exist(sp, 2)) {
+                if (!db_exist(sp, cnt + 1)) {
                         if (db_last(sp, &lline))
                                 return (1);
-                        if (lline == 1)
-                                return (0);
+                        if (lline == cnt) {
+                                if (--cnt == 0)
+                                        return (0);
+                                ++lno;
+                        }
                 }
 
-                LIST_FOREACH(lmp, &sp->ep->marks, q)
-                        if (lmp->lno >= lno)
-                                ++lmp->lno;
+                if (!F_ISSET(ep, F_MARKLINE) && mark_index(sp))
+                        return (1);
+                mark_shift(ep, mark_lower(ep, lno), cnt);
                 break;
         case LINE_RESET:
                 break;
         }
         return (0);
 }
+
+/*
+ * mark_sync --
+ *      Apply any pending line offsets to the marks, and discard the
+ *      line index, so the marks' line numbers can be used directly.
+ *
+ * PUBLIC: void mark_sync(EXF *);
+ */
+
+void
+mark_sync(EXF *ep)
+{
+        size_t i;
+
+        if (!F_ISSET(ep, F_MARKLINE))
+                return;
+        for (i = 0; i < ep->m_cnt; ++i)
+                ep->m_line[i]->lno = mark_lno(ep, i);
+        F_CLR(ep, F_MARKLINE);
+}
+
+/*
+ * mark_index --
+ *      Build the line index of the marks.
+ */
+
+static int
+mark_index(SCR *sp)
+{
+        EXF *ep;
+        LMARK *lmp;
+        size_t cnt;
+
+        ep = sp->ep;
+        cnt = 0;
+        LIST_FOREACH(lmp, &ep->marks, q)
+                ++cnt;
+        if (cnt > ep->m_len) {
+                REALLOCARRAY(sp, ep->m_line, cnt, sizeof(LMARK *));
+                REALLOCARRAY(sp, ep->m_off, cnt, sizeof(recno_t));
+                if (ep->m_line == NULL || ep->m_off == NULL) {
+                        free(ep->m_line);
+                        free(ep->m_off);
+                        ep->m_line = NULL;
+                        ep->m_off = NULL;
+                        ep->m_len = 0;
+                        return (1);
+                }
+                ep->m_len = cnt;
+        }
+
+        cnt = 0;
+        LIST_FOREACH(lmp, &ep->marks, q)
+                ep->m_line[cnt++] = lmp;
+        if (cnt != 0) {
+                qsort(ep->m_line, cnt, sizeof(LMARK *), mark_cmp);
+                memset(ep->m_off, 0, cnt * sizeof(recno_t));
+        }
+        ep->m_cnt = cnt;
+        F_SET(ep, F_MARKLINE);
+        return (0);
+}
+
+/*
+ * mark_cmp --
+ *      Compare the line numbers of two marks, for qsort.
+ */
+
+static int
+mark_cmp(const void *a, const void *b)
+{
+        recno_t alno, blno;
+
+        alno = (*(LMARK * const *)a)->lno;
+        blno = (*(LMARK * const *)b)->lno;
+        return (alno < blno ? -1 : alno > blno);
+}
+
+/*
+ * mark_lno --
+ *      Return the line number of the mark at an index position.
+ *
+ * The offsets are unsigned and may wrap, the sum doesn't.
+ */
+
+static recno_t
+mark_lno(EXF *ep, size_t i)
+{
+        recno_t lno;
+        size_t n;
+
+        lno = ep->m_line[i]->lno;
+        for (n = i + 1; n > 0; n -= n & -n)
+                lno += ep->m_off[n - 1];
+        return (lno);
+}
+
+/*
+ * mark_curlno --
+ *      Return the line number of a mark.
+ */
+
+static recno_t
+mark_curlno(EXF *ep, LMARK *lmp)
+{
+        size_t i;
+
+        if (F_ISSET(ep, F_MARKLINE))
+                for (i = 0; i < ep->m_cnt; ++i)
+                        if (ep->m_line[i] == lmp)
+                                return (mark_lno(ep, i));
+        return (lmp->lno);
+}
+
+/*
+ * mark_lower --
+ *      Return the index position of the first mark at or after a line.
+ */
+
+static size_t
+mark_lower(EXF *ep, recno_t lno)
+{
+        size_t lo, hi, mid;
+
+        for (lo = 0, hi = ep->m_cnt; lo < hi;) {
+                mid = lo + (hi - lo) / 2;
+                if (mark_lno(ep, mid) < lno)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        return (lo);
+}
+
+/*
+ * mark_shift --
+ *      Move the marks from an index position on by off lines.
+ */
+
+static void
+mark_shift(EXF *ep, size_t i, recno_t off)
+{
+        size_t n;
+
+        for (n = i + 1; n <= ep->m_cnt; n += n & -n)
+                ep->m_off[n - 1] += off;
+}
@@ -465,7 +465,7 @@ msgq_status(SCR *sp, recno_t lno, unsigned int flags)
                         p += strlen(p);
                 }
         } else {
-                if (db_last(sp, &last))
+                if (db_partial(sp) || db_last(sp, &last))
                         last = 0;
                 (void)snprintf(p, ep - p, "line %'lu", (unsigned long)lno);
                 p += strlen(p);
@@ -477,6 +477,12 @@ msgq_status(SCR *sp, recno_t lno, unsigned int flags)
 #ifdef DEBUG
         (void)snprintf(p, ep - p, " (pid %ld)", (long)getpid());
         p += strlen(p);
+        (void)snprintf(p, ep - p, " (line cache: %lu hits, %lu misses)",
+            sp->ep->c_hits, sp->ep->c_misses);
+        p += strlen(p);
+        (void)snprintf(p, ep - p, " (RE cache: %lu hits, %lu misses)",
+            sp->gp->re_hits, sp->gp->re_misses);
+        p += strlen(p);
 #endif /* ifdef DEBUG */
         *p++ = '\n';
         len = p - bp;
@@ -91,8 +91,12 @@ OPTLIST const optlist[] = {
         {"filec",       NULL,           OPT_STR,        0},
 /* O_FLASH          HPUX */
         {"flash",       NULL,           OPT_0BOOL,      0},
+/* O_FRAMETIME    OpenVi */
+        {"frametime",   NULL,           OPT_NUM,        0},
 /* O_HARDTABS       4BSD */
         {"hardtabs",    NULL,           OPT_NUM,        0},
+/* O_HLSEARCH     OpenVi */
+        {"hlsearch",    NULL,           OPT_0BOOL,      0},
 /* O_ICLOWER      4.4BSD */
         {"iclower",     f_recompile,    OPT_0BOOL,      0},
 /* O_IGNORECASE     4BSD */
@@ -143,6 +147,8 @@ OPTLIST const optlist[] = {
         {"report",      NULL,           OPT_NUM,        0},
 /* O_RULER        4.4BSD */
         {"ruler",       NULL,           OPT_0BOOL,      0},
+/* O_SAFEWRITE    OpenVi */
+        {"safewrite",   NULL,           OPT_0BOOL,      0},
 /* O_SCROLL         4BSD */
         {"scroll",      NULL,           OPT_NUM,        0},
 /* O_SEARCHINCR   4.4BSD */
@@ -183,6 +189,8 @@ OPTLIST const optlist[] = {
         {"timeout",     NULL,           OPT_1BOOL,      0},
 /* O_TTYWERASE    4.4BSD */
         {"ttywerase",   f_ttywerase,    OPT_0BOOL,      0},
+/* O_UNDOLIMIT    OpenVi */
+        {"undolimit",   NULL,           OPT_NUM,        0},
 /* O_VERBOSE      4.4BSD */
         {"verbose",     NULL,           OPT_0BOOL,      0},
 /* O_VISIBLETAB   OpenVi */
@@ -227,6 +235,7 @@ static OABBREV const abbrev[] = {
         {"et",          O_EXPANDTAB},           /* NetBSD 5.0 */
         {"ex",          O_EXRC},                /* System V (undocumented) */
         {"ht",          O_HARDTABS},            /*     4BSD */
+        {"hls",         O_HLSEARCH},            /*   OpenVi */
         {"ic",          O_IGNORECASE},          /*     4BSD */
         {"li",          O_LINES},               /*   4.4BSD */
         {"nu",          O_NUMBER},              /*     4BSD */
@@ -322,6 +331,7 @@ opts_init(SCR *sp, int *oargs)
         OI_b1(O_CDPATH);
         OI(O_ESCAPETIME, "escapetime=2");
         OI(O_FILEC, "filec=\t");
+        OI(O_FRAMETIME, "frametime=1");
         OI(O_KEYTIME, "keytime=6");
         OI(O_MATCHTIME, "matchtime=7");
         OI(O_REPORT, "report=5");
@@ -24,6 +24,11 @@
 
 #include "common.h"
 
+static int      put_lines(SCR *, recno_t *, TEXT *, TEXT *);
+
+/* Cut buffer lines are appended to the file in batches of this many. */
+#define PUT_NLINES      1024
+
 /*
  * put --
  *      Put text buffer contents into the file.
@@ -81,10 +86,8 @@ put(SCR *sp, CB *cbp, CHAR_T *namep, MARK *cp, MARK *rp, int append)
                 if (db_last(sp, &lno))
                         return (1);
                 if (lno == 0) {
-                        for (; tp; ++lno, ++sp->rptlines[L_ADDED],
-                            tp = TAILQ_NEXT(tp, q))
-                                if (db_append(sp, 1, lno, tp->lb, tp->len))
-                                        return (1);
+                        if (put_lines(sp, &lno, tp, NULL))
+                                return (1);
                         rp->lno = 1;
                         rp->cno = 0;
                         return (0);
@@ -95,10 +98,8 @@ put(SCR *sp, CB *cbp, CHAR_T *namep, MARK *cp, MARK *rp, int append)
         if (F_ISSET(cbp, CB_LMODE)) {
                 lno = append ? cp->lno : cp->lno - 1;
                 rp->lno = lno + 1;
-                for (; tp;
-                    ++lno, ++sp->rptlines[L_ADDED], tp = TAILQ_NEXT(tp, q))
-                        if (db_append(sp, 1, lno, tp->lb, tp->len))
-                                return (1);
+                if (put_lines(sp, &lno, tp, NULL))
+                        return (1);
                 rp->cno = 0;
                 (void)nonblank(sp, rp->lno, &rp->cno);
                 return (0);
@@ -220,10 +221,8 @@ put(SCR *sp, CB *cbp, CHAR_T *namep, MARK *cp, MARK *rp, int append)
                 }
 
                 /* Output any intermediate lines in the CB. */
-                for (tp = TAILQ_NEXT(tp, q); TAILQ_NEXT(tp, q);
-                    ++lno, ++sp->rptlines[L_ADDED], tp = TAILQ_NEXT(tp, q))
-                        if (db_append(sp, 1, lno, tp->lb, tp->len))
-                                goto err;
+                if (put_lines(sp, &lno, TAILQ_NEXT(tp, q), ltp))
+                        goto err;
 
                 if (db_append(sp, 1, lno, t, clen))
                         goto err;
@@ -237,3 +236,29 @@ err:            rval = 1;
         FREE_SPACE(sp, bp, blen);
         return (rval);
 }
+
+/*
+ * put_lines --
+ *      Append the cut buffer lines from tp up to, but not including, etp
+ *      after line *lnop, and leave *lnop at the last line appended.
+ */
+
+static int
+put_lines(SCR *sp, recno_t *lnop, TEXT *tp, TEXT *etp)
+{
+        DBT lines[PUT_NLINES];
+        recno_t n;
+
+        while (tp != etp) {
+                for (n = 0; tp != etp && n < PUT_NLINES;
+                    ++n, tp = TAILQ_NEXT(tp, q)) {
+                        lines[n].data = tp->lb;
+                        lines[n].size = tp->len;
+                }
+                if (db_append_range(sp, 1, *lnop, lines, n))
+                        return (1);
+                *lnop += n;
+                sp->rptlines[L_ADDED] += n;
+        }
+        return (0);
+}
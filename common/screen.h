@@ -111,6 +111,7 @@ struct _scr {
 #define SEARCH_EOL      0x0002          /* Offset past EOL is okay. */
 #define SEARCH_FILE     0x0004          /* Search the entire file. */
 #define SEARCH_INCR     0x0008          /* Search incrementally. */
+#define SEARCH_KEYS     0x0200          /* Stop if input is waiting. */
 #define SEARCH_MSG      0x0010          /* Display search messages. */
 #define SEARCH_PARSE    0x0020          /* Parse the search pattern. */
 #define SEARCH_SET      0x0040          /* Set search direction. */
@@ -122,6 +123,14 @@ struct _scr {
         regex_t  re_c;                  /* Search RE: compiled form. */
         char    *re;                    /* Search RE: uncompiled form. */
         size_t   re_len;                /* Search RE: uncompiled length. */
+        unsigned int re_gen;            /* Search RE: compile generation. */
+        MARK    *ml;                    /* Search RE: match list. */
+        size_t   ml_cnt;                /* Match list: entries. */
+        size_t   ml_cur;                /* Match list: entry at ml_pos. */
+        MARK     ml_pos;                /* Match list: last position found. */
+        unsigned int ml_gen;            /* Match list: RE generation. */
+        u_long   ml_chg;                /* Match list: file change count. */
+        int      ml_all;                /* Match list: covers the file. */
         regex_t  subre_c;               /* Substitute RE: compiled form. */
         char    *subre;                 /* Substitute RE: uncompiled form. */
         size_t   subre_len;             /* Substitute RE: uncompiled length). */
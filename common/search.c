@@ -28,8 +28,28 @@
 
 typedef enum { S_EMPTY, S_EOF, S_NOPREV, S_NOTFOUND, S_SOF, S_WRAP } smsg_t;
 
+/*
+ * Lines are read a database page at a time, and the RE's must string is
+ * looked for in all of them before any are handed to regexec(3).  Lines
+ * that are contiguous in memory, e.g., unmodified lines of a mapped file,
+ * are prescreened in a single pass.
+ */
+#define SEARCH_NLINES   256             /* Lines read at a time. */
+
+typedef struct {
+        DBT      lines[SEARCH_NLINES];  /* Lines first to first + cnt - 1. */
+        char     cand[SEARCH_NLINES];   /* Lines that may match. */
+        recno_t  first;
+        recno_t  cnt;
+} SLINES;
+
+static int      search_line(SCR *, SLINES *, dir_t, recno_t *, recno_t,
+                    char **, size_t *);
 static void     search_msg(SCR *, smsg_t);
 static int      search_init(SCR *, dir_t, char *, size_t, char **, unsigned int);
+static int      search_ml(SCR *, dir_t, MARK *, MARK *, unsigned int);
+static void     search_ml_set(SCR *, MARK *, size_t, int, unsigned int);
+static void     search_scan(SCR *, SLINES *);
 
 /*
  * search_init --
@@ -150,6 +170,7 @@ int
 f_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
     unsigned int flags)
 {
+        SLINES sl;
         busy_t btype;
         recno_t lno;
         regmatch_t match[1];
@@ -160,6 +181,11 @@ f_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
         if (search_init(sp, FORWARD, ptrn, plen, eptrn, flags))
                 return (1);
 
+        /* Step through the match list, if there's one for this search. */
+        if (!LF_ISSET(SEARCH_FILE | SEARCH_INCR) &&
+            (rval = search_ml(sp, FORWARD, fm, rm, flags)) != -1)
+                return (rval);
+
         if (LF_ISSET(SEARCH_FILE)) {
                 lno = 1;
                 coff = 0;
@@ -201,17 +227,21 @@ f_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
         }
 
         btype = BUSY_ON;
+        sl.first = sl.cnt = 0;
         for (cnt = INTERRUPT_CHECK, rval = 1;; ++lno, coff = 0) {
                 if (cnt-- == 0) {
-                        if (INTERRUPTED(sp))
+                        if (INTERRUPTED(sp) ||
+                            (LF_ISSET(SEARCH_KEYS) && INPUT_WAITING(sp)))
                                 break;
                         if (LF_ISSET(SEARCH_MSG)) {
                                 search_busy(sp, btype);
                                 btype = BUSY_UPDATE;
                         }
                         cnt = INTERRUPT_CHECK;
+                        sl.cnt = 0;
                 }
-                if ((wrapped && lno > fm->lno) || db_get(sp, lno, 0, &l, &len)) {
+                if ((wrapped && lno > fm->lno) || search_line(sp,
+                    &sl, FORWARD, &lno, wrapped ? fm->lno : 0, &l, &len)) {
                         if (wrapped) {
                                 if (LF_ISSET(SEARCH_MSG))
                                         search_msg(sp, S_NOTFOUND);
@@ -227,6 +257,10 @@ f_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
                         continue;
                 }
 
+                /* If no line can match, keep going. */
+                if (l == NULL)
+                        continue;
+
                 /* If already at EOL, just keep going. */
                 if (len != 0 && coff == len)
                         continue;
@@ -265,6 +299,9 @@ f_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
                 if (!LF_ISSET(SEARCH_EOL) && rm->cno >= len)
                         rm->cno = len != 0 ? len - 1 : 0;
 
+                if (!LF_ISSET(SEARCH_INCR))
+                        search_ml_set(sp,
+                            rm, match[0].rm_so, wrapped, flags);
                 rval = 0;
                 break;
         }
@@ -285,6 +322,7 @@ int
 b_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
     unsigned int flags)
 {
+        SLINES sl;
         busy_t btype;
         recno_t lno;
         regmatch_t match[1];
@@ -295,6 +333,11 @@ b_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
         if (search_init(sp, BACKWARD, ptrn, plen, eptrn, flags))
                 return (1);
 
+        /* Step through the match list, if there's one for this search. */
+        if (!LF_ISSET(SEARCH_INCR) &&
+            (rval = search_ml(sp, BACKWARD, fm, rm, flags)) != -1)
+                return (rval);
+
         /*
          * If doing incremental search, set the "starting" position past the
          * current column, so that we search a minimal distance and still
@@ -323,15 +366,18 @@ b_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
         }
 
         btype = BUSY_ON;
+        sl.first = sl.cnt = 0;
         for (cnt = INTERRUPT_CHECK, rval = 1, wrapped = 0;; --lno, coff = 0) {
                 if (cnt-- == 0) {
-                        if (INTERRUPTED(sp))
+                        if (INTERRUPTED(sp) ||
+                            (LF_ISSET(SEARCH_KEYS) && INPUT_WAITING(sp)))
                                 break;
                         if (LF_ISSET(SEARCH_MSG)) {
                                 search_busy(sp, btype);
                                 btype = BUSY_UPDATE;
                         }
                         cnt = INTERRUPT_CHECK;
+                        sl.cnt = 0;
                 }
                 if ((wrapped && lno < fm->lno) || lno == 0) {
                         if (wrapped) {
@@ -356,9 +402,14 @@ b_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
                         continue;
                 }
 
-                if (db_get(sp, lno, 0, &l, &len))
+                if (search_line(sp,
+                    &sl, BACKWARD, &lno, wrapped ? fm->lno : 0, &l, &len))
                         break;
 
+                /* If no line can match, keep going. */
+                if (l == NULL)
+                        continue;
+
                 /* Set the termination. */
                 match[0].rm_so = 0;
                 match[0].rm_eo = len;
@@ -418,6 +469,9 @@ b_search(SCR *sp, MARK *fm, MARK *rm, char *ptrn, size_t plen, char **eptrn,
                         rm->cno = len != 0 ? len - 1 : 0;
                 else
                         rm->cno = last;
+
+                if (!LF_ISSET(SEARCH_INCR))
+                        search_ml_set(sp, rm, last, wrapped, flags);
                 rval = 0;
                 break;
         }
@@ -427,6 +481,207 @@ err:    if (LF_ISSET(SEARCH_MSG))
         return (rval);
 }
 
+/*
+ * search_line --
+ *      Get a line that may match.  If line *lnop can't, set *lp to NULL
+ *      and move *lnop to the line before the next one in the search
+ *      direction that may, from the lines read with it, or as far as line
+ *      stop (0 if there's no limit).
+ */
+
+static int
+search_line(SCR *sp, SLINES *slp, dir_t dir, recno_t *lnop, recno_t stop,
+    char **lp, size_t *lenp)
+{
+        recno_t i, lno;
+
+        lno = *lnop;
+        if (lno < slp->first || lno - slp->first >= slp->cnt) {
+                slp->cnt = SEARCH_NLINES;
+                if (db_getv(sp,
+                    lno, dir, slp->lines, &slp->first, &slp->cnt)) {
+                        slp->cnt = 0;
+                        return (1);
+                }
+                search_scan(sp, slp);
+        }
+
+        i = lno - slp->first;
+        if (slp->cand[i]) {
+                *lp = slp->lines[i].data;
+                *lenp = slp->lines[i].size;
+                return (0);
+        }
+        *lp = NULL;
+        *lenp = 0;
+
+        /* Skip to the next line that may match. */
+        if (dir == FORWARD) {
+                while (i + 1 < slp->cnt && !slp->cand[i + 1])
+                        ++i;
+                lno = slp->first + i;
+                *lnop = stop != 0 && lno > stop ? stop : lno;
+        } else {
+                while (i > 0 && !slp->cand[i - 1])
+                        --i;
+                lno = slp->first + i;
+                *lnop = lno < stop ? stop : lno;
+        }
+        return (0);
+}
+
+/*
+ * search_scan --
+ *      Mark the lines that may match, i.e., the ones that contain the
+ *      RE's must string.
+ */
+
+static void
+search_scan(SCR *sp, SLINES *slp)
+{
+        DBT *lp;
+        recno_t i, j, k;
+        const char *end, *p, *q;
+
+        lp = slp->lines;
+        memset(slp->cand, 0, slp->cnt);
+        for (i = 0; i < slp->cnt; i = j) {
+                /* Find the run of lines that are contiguous in memory. */
+                for (j = i + 1; j < slp->cnt && (char *)lp[j - 1].data +
+                    lp[j - 1].size + 1 == (char *)lp[j].data; ++j)
+                        continue;
+                end = (char *)lp[j - 1].data + lp[j - 1].size;
+
+                /*
+                 * The string can span the separator between two lines, so
+                 * after a hit, restart at the beginning of the next line.
+                 */
+                for (k = i, p = lp[i].data; (q =
+                    regscan(&sp->re_c, p, end - p)) != NULL;) {
+                        while (q > (char *)lp[k].data + lp[k].size)
+                                ++k;
+                        slp->cand[k] = 1;
+                        if (++k == j)
+                                break;
+                        p = lp[k].data;
+                }
+        }
+}
+
+/*
+ * search_ml --
+ *      Move to the next or previous entry of the match list built by the
+ *      ex count command.  The entries are the places repeated searches
+ *      stop, so if the list is still current, i.e., neither the RE nor
+ *      the file changed, and the search starts where the last one found
+ *      an entry, the entry next to it is the match.  Return -1 if the
+ *      list can't be used and the lines have to be searched.
+ */
+
+static int
+search_ml(SCR *sp, dir_t dir, MARK *fm, MARK *rm, unsigned int flags)
+{
+        MARK *mp;
+        size_t cur, len;
+        int wrapped;
+
+        if (sp->ml == NULL || sp->ml_cur >= sp->ml_cnt ||
+            sp->ml_gen != sp->re_gen || sp->ml_chg != sp->ep->c_chg ||
+            fm->lno != sp->ml_pos.lno || fm->cno != sp->ml_pos.cno)
+                return (-1);
+
+        /*
+         * Past either end of the list, the search wraps, unless the list
+         * doesn't cover the whole file.
+         */
+        wrapped = 0;
+        if (dir == FORWARD) {
+                if ((cur = sp->ml_cur + 1) == sp->ml_cnt) {
+                        if (!sp->ml_all)
+                                return (-1);
+                        if (!O_ISSET(sp, O_WRAPSCAN)) {
+                                if (LF_ISSET(SEARCH_MSG))
+                                        search_msg(sp, S_EOF);
+                                return (1);
+                        }
+                        cur = 0;
+                        wrapped = 1;
+                }
+        } else {
+                if ((cur = sp->ml_cur) == 0) {
+                        if (!sp->ml_all)
+                                return (-1);
+                        if (!O_ISSET(sp, O_WRAPSCAN)) {
+                                if (LF_ISSET(SEARCH_MSG))
+                                        search_msg(sp, S_SOF);
+                                return (1);
+                        }
+                        cur = sp->ml_cnt;
+                        wrapped = 1;
+                }
+                --cur;
+        }
+
+        /* See comment in f_search(). */
+        mp = &sp->ml[cur];
+        if (db_get(sp, mp->lno, DBG_FATAL, NULL, &len))
+                return (1);
+        rm->lno = mp->lno;
+        if (!LF_ISSET(SEARCH_EOL) && mp->cno >= len)
+                rm->cno = len != 0 ? len - 1 : 0;
+        else
+                rm->cno = mp->cno;
+
+        if (wrapped && LF_ISSET(SEARCH_WMSG))
+                search_msg(sp, S_WRAP);
+        search_ml_set(sp, rm, mp->cno, wrapped, flags);
+        return (0);
+}
+
+/*
+ * search_ml_set --
+ *      Remember where a search stopped, if it's a match list entry, and
+ *      display the entry's place in the list.
+ */
+
+static void
+search_ml_set(SCR *sp, MARK *rm, size_t cno, int wrapped, unsigned int flags)
+{
+        MARK *mp;
+        size_t hi, lo, mid;
+
+        if (sp->ml == NULL ||
+            sp->ml_gen != sp->re_gen || sp->ml_chg != sp->ep->c_chg)
+                return;
+
+        /* The entry last moved to is the usual case. */
+        mp = sp->ml;
+        if (sp->ml_cur < sp->ml_cnt &&
+            mp[sp->ml_cur].lno == rm->lno && mp[sp->ml_cur].cno == cno)
+                lo = sp->ml_cur;
+        else
+                for (lo = 0, hi = sp->ml_cnt; lo < hi;) {
+                        mid = lo + (hi - lo) / 2;
+                        if (mp[mid].lno < rm->lno ||
+                            (mp[mid].lno == rm->lno && mp[mid].cno < cno))
+                                lo = mid + 1;
+                        else
+                                hi = mid;
+                }
+        if (lo == sp->ml_cnt ||
+            mp[lo].lno != rm->lno || mp[lo].cno != cno) {
+                sp->ml_cur = sp->ml_cnt;
+                return;
+        }
+        sp->ml_cur = lo;
+        sp->ml_pos = *rm;
+
+        /* A wrapped search has already said so. */
+        if (!wrapped && LF_ISSET(SEARCH_WMSG))
+                msgq(sp, M_INFO,
+                    "Match %lu of %lu", (u_long)lo + 1, (u_long)sp->ml_cnt);
+}
+
 /*
  * search_msg --
  *      Display one of the search messages.
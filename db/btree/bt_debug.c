@@ -232,6 +232,13 @@ __bt_dpage(PAGE *h)
                                     "big data page %u size %u",
                                     *(pgno_t *)rl->bytes,
                                     *(u_int32_t *)(rl->bytes + sizeof(pgno_t)));
+                        else if (rl->flags & P_MAPDATA)
+                                (void)fprintf(stderr,
+                                    "mapped data offset %llu size %u",
+                                    (unsigned long long)
+                                    *(u_int64_t *)rl->bytes,
+                                    *(u_int32_t *)(rl->bytes +
+                                    sizeof(u_int64_t)));
                         else if (rl->dsize)
                                 (void)fprintf(stderr,
                                     "%.*s", (int)rl->dsize, rl->bytes);
@@ -132,6 +132,7 @@ typedef struct _binternal {
         pgno_t  pgno;                   /* page number stored on */
 #define P_BIGDATA       0x01            /* overflow data */
 #define P_BIGKEY        0x02            /* overflow key */
+#define P_MAPDATA       0x04            /* mapped data reference */
         unsigned char  flags;
         char    bytes[1];               /* data */
 } BINTERNAL;
@@ -219,6 +220,13 @@ typedef struct _rleaf {
         char    bytes[1];
 } RLEAF;
 
+/*
+ * A recno leaf item with P_MAPDATA set doesn't hold the user's data, it
+ * holds the { offset, size } of the record in the input file.  The data
+ * is read from the mapped file (or the file itself) when it's returned.
+ */
+#define NMAPSIZE        (sizeof(u_int64_t) + sizeof(u_int32_t))
+
 /* Get the page's RLEAF structure at index indx. */
 #define GETRLEAF(pg, indx)                                              \
         ((RLEAF *)((char *)(pg) + (pg)->linp[indx]))
@@ -362,6 +370,7 @@ typedef struct _btree {
         caddr_t   bt_smap;              /* R: start of mapped space */
         caddr_t   bt_emap;              /* R: end of mapped space */
         size_t    bt_msize;             /* R: size of mapped region. */
+        struct timespec bt_mtim;        /* R: mapped file mod time. */
 
         recno_t   bt_nrecs;             /* R: number of records */
         size_t    bt_reclen;            /* R: fixed record length */
@@ -384,6 +393,7 @@ typedef struct _btree {
 #define R_CLOSEFP       0x00040         /* opened a file pointer */
 #define R_EOF           0x00100         /* end of input file reached. */
 #define R_FIXLEN        0x00200         /* fixed length records */
+#define R_MEMMAPPED     0x00400         /* memory mapped file. */
 #define R_INMEM         0x00800         /* in-memory file */
 #define R_MODIFIED      0x01000         /* modified file */
 #define R_RDONLY        0x02000         /* read-only file */
@@ -391,6 +401,8 @@ typedef struct _btree {
 #define B_DB_LOCK       0x04000         /* DB_LOCK specified. */
 #define B_DB_SHMEM      0x08000         /* DB_SHMEM specified. */
 #define B_DB_TXN        0x10000         /* DB_TXN specified. */
+
+#define R_MAPREF        0x20000         /* records reference the file */
         u_int32_t flags;
 } BTREE;
 
@@ -51,6 +51,9 @@ int      __rec_fout(BTREE *);
 int      __rec_fpipe(BTREE *, recno_t);
 int      __rec_get(const DB *, const DBT *, DBT *, unsigned int);
 int      __rec_iput(BTREE *, recno_t, const DBT *, unsigned int);
+int      __rec_iref(BTREE *, recno_t, u_int64_t, u_int32_t);
+int      __rec_mapget(BTREE *, const char *, DBT *);
+int      __rec_mvalid(BTREE *);
 int      __rec_put(const DB *dbp, DBT *, const DBT *, unsigned int);
 int      __rec_ret(BTREE *, EPG *, recno_t, DBT *, DBT *);
 EPG     *__rec_search(BTREE *, recno_t, enum SRCHOP);
@@ -46,12 +46,34 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <bsd_stdlib.h>
+#include <bsd_string.h>
 #include <bsd_unistd.h>
 
 #include <bsd_db.h>
 #include <compat_bsd_db.h>
 #include "recno.h"
 
+/* A list of page numbers. */
+typedef struct {
+        pgno_t  *pg;                    /* Page numbers. */
+        size_t   n;                     /* Number of entries. */
+        size_t   len;                   /* Allocated entries. */
+} PGLIST;
+
+static int rec_addlv(BTREE *, RINTERNAL **, size_t *, size_t *, PAGE *,
+    recno_t);
+static int rec_addpg(PGLIST *, pgno_t);
+static int rec_mklevels(BTREE *, RINTERNAL **, size_t *, size_t *,
+    PGLIST *);
+static PAGE *rec_npage(BTREE *, PAGE *, u_int32_t, PGLIST *);
+static int rec_pgfree(BTREE *, PGLIST *, int);
+static int rec_unref(BTREE *);
+static int rec_write(int, struct iovec *, int);
+
+/* Records are gathered into a buffer of this size when syncing. */
+#define REC_SYNCSIZE    (64 * 1024)
+
 /*
  * __REC_CLOSE -- Close a recno tree.
  *
@@ -82,6 +104,9 @@ __rec_close(DB *dbp)
         /* Committed to closing. */
         status = RET_SUCCESS;
 
+        if (t->bt_smap != NULL && munmap(t->bt_smap, t->bt_msize))
+                status = RET_ERROR;
+
         if (!F_ISSET(t, R_INMEM)) {
                 if (F_ISSET(t, R_CLOSEFP)) {
                         if (fclose(t->bt_rfp))
@@ -111,12 +136,17 @@ __rec_close(DB *dbp)
 int
 __rec_sync(const DB *dbp, unsigned int flags)
 {
-        struct iovec iov[2];
+        struct iovec iov[3];
         BTREE *t;
-        DBT data, key;
+        PAGE *h;
+        RLEAF *rl;
         off_t off;
-        recno_t scursor, trec;
+        pgno_t pg;
+        indx_t idx;
+        size_t dsize, len;
+        u_int32_t bval;
         int status;
+        char *bp, *p;
 
         t = dbp->internal;
 
@@ -126,12 +156,22 @@ __rec_sync(const DB *dbp, unsigned int flags)
                 t->bt_pinned = NULL;
         }
 
-        if (flags == R_RECNOSYNC)
+        /*
+         * The tree can't be written to backing store, and the file can't be
+         * overwritten, while records still reference the input file.
+         */
+        if (flags == R_RECNOSYNC) {
+                if (rec_unref(t) == RET_ERROR)
+                        return (RET_ERROR);
                 return (__bt_sync(dbp, 0));
+        }
 
         if (F_ISSET(t, R_RDONLY | R_INMEM) || !F_ISSET(t, R_MODIFIED))
                 return (RET_SUCCESS);
 
+        if (rec_unref(t) == RET_ERROR)
+                return (RET_ERROR);
+
         /* Read any remaining records into the tree. */
         if (!F_ISSET(t, R_EOF) && t->bt_irec(t, MAX_REC_NUMBER) == RET_ERROR)
                 return (RET_ERROR);
@@ -140,43 +180,81 @@ __rec_sync(const DB *dbp, unsigned int flags)
         if (lseek(t->bt_rfd, 0, SEEK_SET) != 0)
                 return (RET_ERROR);
 
-        /* Save the cursor. */
-        scursor = t->bt_cursor.rcursor;
-
-        key.size = sizeof(recno_t);
-        key.data = &trec;
-
-        if (F_ISSET(t, R_FIXLEN)) {
+        /*
+         * Walk the leaf pages, gathering records into a buffer.  A record
+         * that doesn't fit is written, along with the buffer, in a single
+         * writev(2) call.  Big records are copied out of their overflow
+         * pages first.
+         *
+         * We assume that fixed length records are all fixed length.  Any
+         * that aren't are either EINVAL'd or corrected by the record put
+         * code.
+         */
+        if ((bp = malloc(REC_SYNCSIZE)) == NULL)
+                return (RET_ERROR);
+        bval = F_ISSET(t, R_FIXLEN) ? 0 : 1;
+        iov[2].iov_base = &t->bt_bval;
+        iov[2].iov_len = bval;
+        len = 0;
+        status = RET_ERROR;
 
-                /*
-                 * We assume that fixed length records are all fixed length.
-                 * Any that aren't are either EINVAL'd or corrected by the
-                 * record put code.
-                 */
+        /* Find the first leaf page. */
+        for (pg = P_ROOT;;) {
+                if ((h = mpool_get(t->bt_mp, pg, 0)) == NULL)
+                        goto err;
+                if ((h->flags & P_TYPE) == P_RLEAF)
+                        break;
+                pg = NEXTINDEX(h) == 0 ? P_INVALID : GETRINTERNAL(h, 0)->pgno;
+                mpool_put(t->bt_mp, h, 0);
+                if (pg == P_INVALID)
+                        goto done;
+        }
 
-                status = (dbp->seq)(dbp, &key, &data, R_FIRST);
-                while (status == RET_SUCCESS) {
-                        if (write(t->bt_rfd, data.data, data.size) != data.size)
-                                return (RET_ERROR);
-                        status = (dbp->seq)(dbp, &key, &data, R_NEXT);
-                }
-        } else {
-                iov[1].iov_base = &t->bt_bval;
-                iov[1].iov_len = 1;
-
-                status = (dbp->seq)(dbp, &key, &data, R_FIRST);
-                while (status == RET_SUCCESS) {
-                        iov[0].iov_base = data.data;
-                        iov[0].iov_len = data.size;
-                        if (writev(t->bt_rfd, iov, 2) != data.size + 1)
-                                return (RET_ERROR);
-                        status = (dbp->seq)(dbp, &key, &data, R_NEXT);
+        for (;;) {
+                for (idx = 0; idx < NEXTINDEX(h); ++idx) {
+                        rl = GETRLEAF(h, idx);
+                        if (rl->flags & P_BIGDATA) {
+                                if (__ovfl_get(t, rl->bytes, &dsize,
+                                    &t->bt_rdata.data, &t->bt_rdata.size))
+                                        goto perr;
+                                p = t->bt_rdata.data;
+                        } else {
+                                dsize = rl->dsize;
+                                p = rl->bytes;
+                        }
+                        if (dsize + bval <= REC_SYNCSIZE - len) {
+                                memmove(bp + len, p, dsize);
+                                len += dsize;
+                                if (bval)
+                                        bp[len++] = t->bt_bval;
+                                continue;
+                        }
+                        iov[0].iov_base = bp;
+                        iov[0].iov_len = len;
+                        iov[1].iov_base = p;
+                        iov[1].iov_len = dsize;
+                        if (rec_write(t->bt_rfd, iov, 3))
+                                goto perr;
+                        len = 0;
                 }
+                pg = h->nextpg;
+                mpool_put(t->bt_mp, h, 0);
+                if (pg == P_INVALID)
+                        break;
+                if ((h = mpool_get(t->bt_mp, pg, 0)) == NULL)
+                        goto err;
         }
 
-        /* Restore the cursor. */
-        t->bt_cursor.rcursor = scursor;
+done:   iov[0].iov_base = bp;
+        iov[0].iov_len = len;
+        if (len != 0 && rec_write(t->bt_rfd, iov, 1))
+                goto err;
+        status = RET_SUCCESS;
 
+        if (0) {
+perr:           mpool_put(t->bt_mp, h, 0);
+        }
+err:    free(bp);
         if (status == RET_ERROR)
                 return (RET_ERROR);
         if ((off = lseek(t->bt_rfd, 0, SEEK_CUR)) == -1)
@@ -186,3 +264,483 @@ __rec_sync(const DB *dbp, unsigned int flags)
         F_CLR(t, R_MODIFIED);
         return (RET_SUCCESS);
 }
+
+/*
+ * REC_UNREF -- copy records that reference the input file into the tree.
+ *
+ * Replacing the records one at a time would search the tree and shuffle
+ * a leaf page for each of them.  Instead, walk the leaf pages in order and
+ * rebuild the tree from the bottom up: copy the records onto new, full leaf
+ * pages, then build the internal levels over the new leaves.  The new pages
+ * aren't reachable until the root page is rewritten, and the old pages are
+ * only freed after that, so a failure part way through frees the new pages
+ * and leaves the tree as it was.
+ *
+ * Parameters:
+ *      t:      tree
+ *
+ * Returns:
+ *      RET_SUCCESS, RET_ERROR.
+ */
+
+static int
+rec_unref(BTREE *t)
+{
+        DBT tdata, *data;
+        PAGE *h, *np, *tp;
+        PGLIST ipg, lpg, newpg, ovpg;
+        RINTERNAL *lv;
+        RLEAF *rl;
+        pgno_t fleaf, pg;
+        size_t i, lend, lstart, nlv, szlv;
+        recno_t nrecs;
+        indx_t idx, top;
+        u_int64_t off;
+        u_int32_t nbytes, size;
+        int dflags, isleaf, rval;
+        char *dest, db[NOVFLSIZE];
+
+        if (!F_ISSET(t, R_MAPREF))
+                return (RET_SUCCESS);
+
+        /*
+         * If the file changed underneath us, the records that reference it
+         * are gone.  Fail before anything in the tree is changed, leaving
+         * the references in place.
+         */
+        switch (__rec_mvalid(t)) {
+        case -1:
+                return (RET_ERROR);
+        case 0:
+                errno = ESTALE;
+                return (RET_ERROR);
+        }
+
+        data = &tdata;
+        memset(&ipg, 0, sizeof(PGLIST));
+        memset(&lpg, 0, sizeof(PGLIST));
+        memset(&newpg, 0, sizeof(PGLIST));
+        memset(&ovpg, 0, sizeof(PGLIST));
+        lv = NULL;
+        np = NULL;
+        nlv = szlv = 0;
+        if ((tp = malloc(t->bt_psize)) == NULL)
+                return (RET_ERROR);
+
+        /* Read the rest of the file, copying it this time. */
+        F_CLR(t, R_MAPREF);
+        if (!F_ISSET(t, R_EOF) && t->bt_irec(t, MAX_REC_NUMBER) == RET_ERROR)
+                goto err;
+        if (!F_ISSET(t, R_MEMMAPPED)) {
+                errno = ESTALE;
+                goto err;
+        }
+
+        /*
+         * Collect the internal pages, a level at a time.  All of the pages
+         * on a level have the same type, so check the first page of each
+         * new level to see if it's the leaf level.
+         */
+        if ((h = mpool_get(t->bt_mp, P_ROOT, 0)) == NULL)
+                goto err;
+        isleaf = h->flags & P_RLEAF;
+        mpool_put(t->bt_mp, h, 0);
+        fleaf = P_ROOT;
+        if (!isleaf) {
+                if (rec_addpg(&ipg, P_ROOT))
+                        goto err;
+                for (lstart = 0;; lstart = lend) {
+                        lend = ipg.n;
+                        if ((h =
+                            mpool_get(t->bt_mp, ipg.pg[lstart], 0)) == NULL)
+                                goto err;
+                        fleaf = GETRINTERNAL(h, 0)->pgno;
+                        mpool_put(t->bt_mp, h, 0);
+                        if ((h = mpool_get(t->bt_mp, fleaf, 0)) == NULL)
+                                goto err;
+                        isleaf = h->flags & P_RLEAF;
+                        mpool_put(t->bt_mp, h, 0);
+                        if (isleaf)
+                                break;
+                        for (i = lstart; i < lend; ++i) {
+                                if ((h =
+                                    mpool_get(t->bt_mp, ipg.pg[i], 0)) == NULL)
+                                        goto err;
+                                for (idx = 0, top = NEXTINDEX(h);
+                                    idx < top; ++idx)
+                                        if (rec_addpg(&ipg,
+                                            GETRINTERNAL(h, idx)->pgno)) {
+                                                mpool_put(t->bt_mp, h, 0);
+                                                goto err;
+                                        }
+                                mpool_put(t->bt_mp, h, 0);
+                        }
+                }
+        }
+
+        /*
+         * Copy the records onto new leaf pages.  The old leaf pages are
+         * left alone, and remembered so they can be freed once the new
+         * tree is in place.
+         */
+        for (pg = fleaf, nrecs = 0; pg != P_INVALID;) {
+                if (rec_addpg(&lpg, pg))
+                        goto err;
+                if ((h = mpool_get(t->bt_mp, pg, 0)) == NULL)
+                        goto err;
+                memmove(tp, h, t->bt_psize);
+                mpool_put(t->bt_mp, h, 0);
+                pg = tp->nextpg;
+
+                for (idx = 0, top = NEXTINDEX(tp); idx < top; ++idx) {
+                        rl = GETRLEAF(tp, idx);
+                        if (rl->flags & P_MAPDATA) {
+                                memmove(&off, rl->bytes, sizeof(u_int64_t));
+                                memmove(&size, rl->bytes + sizeof(u_int64_t),
+                                    sizeof(u_int32_t));
+                                data->data = t->bt_smap + off;
+                                data->size = size;
+                                dflags = 0;
+                                if (data->size > t->bt_ovflsize) {
+                                        /*
+                                         * Make room in the list first, so
+                                         * the chain can't be lost.
+                                         */
+                                        if (rec_addpg(&ovpg, P_INVALID) ||
+                                            __ovfl_put(t, data,
+                                            &ovpg.pg[ovpg.n - 1]) == RET_ERROR)
+                                                goto err;
+                                        *(pgno_t *)db = ovpg.pg[ovpg.n - 1];
+                                        *(u_int32_t *)(db + sizeof(pgno_t)) =
+                                            data->size;
+                                        data->data = db;
+                                        data->size = NOVFLSIZE;
+                                        dflags = P_BIGDATA;
+                                }
+                        } else {
+                                data->data = rl->bytes;
+                                data->size = rl->dsize;
+                                dflags = rl->flags;
+                        }
+
+                        nbytes = NRLEAFDBT(data->size);
+                        if (np == NULL ||
+                            np->upper - np->lower < nbytes + sizeof(indx_t)) {
+                                if (np != NULL &&
+                                    rec_addlv(t, &lv, &nlv, &szlv, np, nrecs))
+                                        goto err;
+                                if ((np = rec_npage(t,
+                                    np, P_RLEAF, &newpg)) == NULL)
+                                        goto err;
+                                nrecs = 0;
+                        }
+                        np->linp[NEXTINDEX(np)] = np->upper -= nbytes;
+                        np->lower += sizeof(indx_t);
+                        dest = (char *)np + np->upper;
+                        WR_RLEAF(dest, data, dflags);
+                        ++nrecs;
+                }
+        }
+        if (np != NULL && rec_addlv(t, &lv, &nlv, &szlv, np, nrecs))
+                goto err;
+        np = NULL;
+
+        /* Build internal levels until the top level fits on the root. */
+        if (rec_mklevels(t, &lv, &nlv, &szlv, &newpg))
+                goto err;
+
+        /*
+         * Switch the root page over to the new tree.  A single leaf page
+         * is copied onto the root page, otherwise the top level is.
+         * (Building a level never leaves a single page.)
+         */
+        if ((h = mpool_get(t->bt_mp, P_ROOT, 0)) == NULL)
+                goto err;
+        if (nlv == 1) {
+                if ((np = mpool_get(t->bt_mp, lv[0].pgno, 0)) == NULL) {
+                        mpool_put(t->bt_mp, h, 0);
+                        goto err;
+                }
+                memmove(h, np, t->bt_psize);
+                h->pgno = P_ROOT;
+                h->prevpg = h->nextpg = P_INVALID;
+        } else {
+                h->prevpg = h->nextpg = P_INVALID;
+                h->flags = nlv == 0 ? P_RLEAF : P_RINTERNAL;
+                h->lower = BTDATAOFF;
+                h->upper = t->bt_psize;
+                for (idx = 0; idx < nlv; ++idx) {
+                        h->linp[idx] = h->upper -= NRINTERNAL;
+                        h->lower += sizeof(indx_t);
+                        dest = (char *)h + h->upper;
+                        WR_RINTERNAL(dest, lv[idx].nrecs, lv[idx].pgno);
+                }
+        }
+        mpool_put(t->bt_mp, h, MPOOL_DIRTY);
+        t->bt_order = NOT;
+        F_SET(t, B_MODIFIED);
+
+        /*
+         * The tree is consistent from here on, a failure to free the old
+         * pages only loses them.
+         */
+        rval = RET_SUCCESS;
+        if (np != NULL && __bt_free(t, np))
+                rval = RET_ERROR;
+        if (rec_pgfree(t, &lpg, 0) || rec_pgfree(t, &ipg, 0))
+                rval = RET_ERROR;
+
+        free(lv);
+        free(ipg.pg);
+        free(lpg.pg);
+        free(newpg.pg);
+        free(ovpg.pg);
+        free(tp);
+
+        /*
+         * Nothing in the tree references the mapped file any longer, but
+         * the mapping stays until the tree is closed: the caller may still
+         * hold pointers to records returned before they were copied.
+         */
+        return (rval);
+
+err:    if (np != NULL)
+                mpool_put(t->bt_mp, np, MPOOL_DIRTY);
+        (void)rec_pgfree(t, &newpg, 0);
+        (void)rec_pgfree(t, &ovpg, 1);
+        free(lv);
+        free(ipg.pg);
+        free(lpg.pg);
+        free(newpg.pg);
+        free(ovpg.pg);
+        free(tp);
+        F_SET(t, R_MAPREF);
+        return (RET_ERROR);
+}
+
+/*
+ * REC_MKLEVELS -- build the internal levels of a rebuilt tree.
+ *
+ * Parameters:
+ *      t:      tree
+ *      lvp:    entries for the leaf pages, then for the top level
+ *      nlvp:   number of entries
+ *      szlvp:  allocated entries
+ *      newp:   list of new pages
+ *
+ * Returns:
+ *      RET_SUCCESS, RET_ERROR.
+ */
+
+static int
+rec_mklevels(BTREE *t, RINTERNAL **lvp, size_t *nlvp, size_t *szlvp,
+    PGLIST *newp)
+{
+        PAGE *np;
+        RINTERNAL *lv, *nl;
+        size_t cap, i, n, nn, szn;
+        recno_t nrecs;
+        char *dest;
+
+        cap = (t->bt_psize - BTDATAOFF) / (NRINTERNAL + sizeof(indx_t));
+        for (lv = *lvp, n = *nlvp; n > cap; lv = nl, n = nn) {
+                nl = NULL;
+                np = NULL;
+                nn = szn = 0;
+                for (i = 0, nrecs = 0; i < n; ++i) {
+                        if (np == NULL || np->upper - np->lower <
+                            NRINTERNAL + sizeof(indx_t)) {
+                                if (np != NULL &&
+                                    rec_addlv(t, &nl, &nn, &szn, np, nrecs))
+                                        goto err;
+                                if ((np = rec_npage(t,
+                                    np, P_RINTERNAL, newp)) == NULL)
+                                        goto err;
+                                nrecs = 0;
+                        }
+                        np->linp[NEXTINDEX(np)] = np->upper -= NRINTERNAL;
+                        np->lower += sizeof(indx_t);
+                        dest = (char *)np + np->upper;
+                        WR_RINTERNAL(dest, lv[i].nrecs, lv[i].pgno);
+                        nrecs += lv[i].nrecs;
+                }
+                if (rec_addlv(t, &nl, &nn, &szn, np, nrecs))
+                        goto err;
+                free(lv);
+                *lvp = nl;
+                *nlvp = nn;
+                *szlvp = szn;
+        }
+        return (RET_SUCCESS);
+
+err:    if (np != NULL)
+                mpool_put(t->bt_mp, np, MPOOL_DIRTY);
+        free(nl);
+        return (RET_ERROR);
+}
+
+/*
+ * REC_NPAGE -- get a new page, linked after the previous one.
+ *
+ * Parameters:
+ *      t:      tree
+ *      prev:   previous page on the level, or NULL
+ *      type:   P_RLEAF or P_RINTERNAL
+ *      newp:   list of new pages
+ *
+ * Returns:
+ *      The new, pinned, page; NULL on error.
+ */
+
+static PAGE *
+rec_npage(BTREE *t, PAGE *prev, u_int32_t type, PGLIST *newp)
+{
+        PAGE *h;
+        pgno_t npg;
+
+        if ((h = __bt_new(t, &npg)) == NULL)
+                return (NULL);
+        if (rec_addpg(newp, npg)) {
+                __bt_free(t, h);
+                return (NULL);
+        }
+        h->pgno = npg;
+        h->prevpg = prev == NULL ? P_INVALID : prev->pgno;
+        h->nextpg = P_INVALID;
+        h->flags = type;
+        h->lower = BTDATAOFF;
+        h->upper = t->bt_psize;
+        if (prev != NULL)
+                prev->nextpg = npg;
+        return (h);
+}
+
+/*
+ * REC_ADDLV -- add a finished page to the next level up, and release it.
+ *
+ * Parameters:
+ *      t:      tree
+ *      lvp:    level entries
+ *      nlvp:   number of entries
+ *      szlvp:  allocated entries
+ *      h:      page
+ *      nrecs:  records on, or below, the page
+ *
+ * Returns:
+ *      RET_SUCCESS, RET_ERROR.
+ */
+
+static int
+rec_addlv(BTREE *t, RINTERNAL **lvp, size_t *nlvp, size_t *szlvp, PAGE *h,
+    recno_t nrecs)
+{
+        void *p;
+
+        if (*nlvp == *szlvp) {
+                if ((p = realloc(*lvp, (*szlvp + 64) * 2 *
+                    sizeof(RINTERNAL))) == NULL)
+                        return (RET_ERROR);
+                *lvp = p;
+                *szlvp = (*szlvp + 64) * 2;
+        }
+        (*lvp)[*nlvp].nrecs = nrecs;
+        (*lvp)[*nlvp].pgno = h->pgno;
+        ++*nlvp;
+        return (mpool_put(t->bt_mp, h, MPOOL_DIRTY));
+}
+
+/*
+ * REC_ADDPG -- add a page number to a list.
+ *
+ * Parameters:
+ *      l:      list
+ *      pg:     page number
+ *
+ * Returns:
+ *      RET_SUCCESS, RET_ERROR.
+ */
+
+static int
+rec_addpg(PGLIST *l, pgno_t pg)
+{
+        void *p;
+
+        if (l->n == l->len) {
+                if ((p = realloc(l->pg, (l->len + 64) * 2 *
+                    sizeof(pgno_t))) == NULL)
+                        return (RET_ERROR);
+                l->pg = p;
+                l->len = (l->len + 64) * 2;
+        }
+        l->pg[l->n++] = pg;
+        return (RET_SUCCESS);
+}
+
+/*
+ * REC_PGFREE -- free the pages on a list.
+ *
+ * The root page and unused entries are skipped.
+ *
+ * Parameters:
+ *      t:      tree
+ *      l:      list
+ *      chains: if the pages start overflow chains
+ *
+ * Returns:
+ *      RET_SUCCESS, RET_ERROR.
+ */
+
+static int
+rec_pgfree(BTREE *t, PGLIST *l, int chains)
+{
+        PAGE *h;
+        pgno_t pg;
+        size_t i;
+        int rval;
+
+        rval = RET_SUCCESS;
+        for (i = 0; i < l->n; ++i)
+                for (pg = l->pg[i]; pg != P_INVALID && pg != P_ROOT;) {
+                        if ((h = mpool_get(t->bt_mp, pg, 0)) == NULL) {
+                                rval = RET_ERROR;
+                                break;
+                        }
+                        pg = chains ? h->nextpg : P_INVALID;
+                        if (__bt_free(t, h))
+                                rval = RET_ERROR;
+                }
+        return (rval);
+}
+
+/*
+ * REC_WRITE -- Write an iovec array, handling partial writes.
+ *
+ * Parameters:
+ *      fd:     file descriptor
+ *      iov:    iovec array
+ *      cnt:    number of iovecs
+ *
+ * Returns:
+ *      0 on success, -1 on error.
+ */
+
+static int
+rec_write(int fd, struct iovec *iov, int cnt)
+{
+        ssize_t nw;
+
+        while (cnt > 0) {
+                if ((nw = writev(fd, iov, cnt)) == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        return (-1);
+                }
+                for (; cnt > 0 && (size_t)nw >= iov->iov_len; ++iov, --cnt)
+                        nw -= iov->iov_len;
+                if (cnt > 0) {
+                        iov->iov_base = (char *)iov->iov_base + nw;
+                        iov->iov_len -= nw;
+                }
+        }
+        return (0);
+}
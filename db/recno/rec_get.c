@@ -40,6 +40,8 @@
 #include "../../include/compat.h"
 
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <errno.h>
 #include <stddef.h>
@@ -52,6 +54,9 @@
 #include <compat_bsd_db.h>
 #include "recno.h"
 
+/* Records read ahead of the caller from a mapped file. */
+#define REC_READAHEAD   1024
+
 /*
  * __REC_GET -- Get a record from the btree.
  *
@@ -99,6 +104,9 @@ __rec_get(const DB *dbp, const DBT *key, DBT *data, unsigned int flags)
                         return (status);
         }
 
+        if (__rec_mvalid(t) == -1)
+                return (RET_ERROR);
+
         --nrec;
         if ((e = __rec_search(t, nrec, SEARCH)) == NULL)
                 return (RET_ERROR);
@@ -252,6 +260,13 @@ __rec_fmap(BTREE *t, recno_t top)
         data.data = t->bt_rdata.data;
         data.size = t->bt_reclen;
 
+        switch (__rec_mvalid(t)) {
+        case -1:
+                return (RET_ERROR);
+        case 0:
+                return (t->bt_irec(t, top));
+        }
+
         sp = (unsigned char *)t->bt_cmap;
         ep = (unsigned char *)t->bt_emap;
         for (nrec = t->bt_nrecs; nrec < top; ++nrec) {
@@ -286,25 +301,113 @@ int
 __rec_vmap(BTREE *t, recno_t top)
 {
         DBT data;
-        unsigned char *sp, *ep;
-        recno_t nrec;
+        unsigned char *sp, *ep, *p;
+        recno_t nrec, want;
         int bval;
 
+        switch (__rec_mvalid(t)) {
+        case -1:
+                return (RET_ERROR);
+        case 0:
+                return (t->bt_irec(t, top));
+        }
+
         sp = (unsigned char *)t->bt_cmap;
         ep = (unsigned char *)t->bt_emap;
         bval = t->bt_bval;
 
+        /*
+         * Reading records out of the mapped file is cheap, read ahead of
+         * the caller so that walking the file a record at a time doesn't
+         * check the file once per record.
+         */
+        want = top;
+        if (top < MAX_REC_NUMBER - REC_READAHEAD)
+                top += REC_READAHEAD;
+
         for (nrec = t->bt_nrecs; nrec < top; ++nrec) {
-                if (sp >= ep) {
-                        F_SET(t, R_EOF);
-                        return (RET_SPECIAL);
+                if (sp >= ep)
+                        break;
+                if ((p = memchr(sp, bval, ep - sp)) == NULL)
+                        p = ep;
+                if (F_ISSET(t, R_MAPREF)) {
+                        if (__rec_iref(t, nrec,
+                            (u_int64_t)(sp - (unsigned char *)t->bt_smap),
+                            (u_int32_t)(p - sp)) != RET_SUCCESS)
+                                return (RET_ERROR);
+                } else {
+                        data.data = sp;
+                        data.size = p - sp;
+                        if (__rec_iput(t, nrec, &data, 0) != RET_SUCCESS)
+                                return (RET_ERROR);
                 }
-                for (data.data = sp; sp < ep && *sp != bval; ++sp);
-                data.size = sp - (unsigned char *)data.data;
-                if (__rec_iput(t, nrec, &data, 0) != RET_SUCCESS)
-                        return (RET_ERROR);
-                ++sp;
+                sp = p + 1;
         }
         t->bt_cmap = (caddr_t)sp;
+        if (sp >= ep) {
+                F_SET(t, R_EOF);
+                if (nrec < want)
+                        return (RET_SPECIAL);
+        }
         return (RET_SUCCESS);
 }
+
+/*
+ * __REC_MVALID -- Check that the mapped file hasn't changed.
+ *
+ * If the file was truncated or rewritten underneath us, the mapping can
+ * no longer be trusted (and touching it past the end of the file would
+ * fault).  Stop using it and read the rest of the file through stdio from
+ * where we left off.  Records that reference the file can't be returned
+ * any longer, see __rec_mapget.
+ *
+ * The file is checked once for each call into the tree that can return
+ * records that reference it, before the tree is searched.  That's once
+ * for each record for DB->get and DB->seq, and once for each page of
+ * records for R_NEXTV and R_PREVV, so callers reading many lines should
+ * read them a page at a time, see db_getv().
+ *
+ * XXX
+ * A file truncated between the check and the caller's use of the records
+ * can still fault.  Records only reference the file when the user asked
+ * for it not to be snapshotted (the -F option), see file_init().
+ *
+ * Parameters:
+ *      t:      tree
+ *
+ * Returns:
+ *      1 if the mapping is valid, 0 if the tree stopped using it, and -1
+ *      on error.
+ */
+
+int
+__rec_mvalid(BTREE *t)
+{
+        struct stat sb;
+        off_t off;
+
+        if (!F_ISSET(t, R_MEMMAPPED))
+                return (0);
+        if (fstat(t->bt_rfd, &sb) == 0 &&
+            sb.st_size == (off_t)t->bt_msize &&
+            sb.st_mtim.tv_sec == t->bt_mtim.tv_sec &&
+            sb.st_mtim.tv_nsec == t->bt_mtim.tv_nsec)
+                return (1);
+
+        /*
+         * The mapping itself is left alone until the tree is closed, the
+         * caller may still hold pointers to records returned from it.
+         */
+        F_CLR(t, R_MEMMAPPED);
+        if (F_ISSET(t, R_EOF))
+                return (0);
+
+        off = t->bt_cmap - t->bt_smap;
+        if ((t->bt_rfp = fdopen(t->bt_rfd, "r")) == NULL)
+                return (-1);
+        F_SET(t, R_CLOSEFP);
+        if (fseeko(t->bt_rfp, off, SEEK_SET))
+                return (-1);
+        t->bt_irec = F_ISSET(t, R_FIXLEN) ? __rec_fpipe : __rec_vpipe;
+        return (0);
+}
@@ -77,7 +77,8 @@ __rec_open(const char *fname, int flags, int mode, const RECNOINFO *openinfo,
         /* Create a btree in memory (backed by disk). */
         dbp = NULL;
         if (openinfo) {
-                if (openinfo->flags & ~(R_FIXEDLEN | R_NOKEY | R_SNAPSHOT))
+                if (openinfo->flags &
+                    ~(R_FIXEDLEN | R_NOKEY | R_SNAPSHOT | R_NOCOPY))
                         goto einval;
                 btopeninfo.flags      = 0;
                 btopeninfo.cachesize  = openinfo->cachesize;
@@ -154,10 +155,45 @@ slow:                   if ((t->bt_rfp = fdopen(rfd, "r")) == NULL)
 
                         if (fstat(rfd, &sb))
                                 goto err;
+
+                        /*
+                         * We'd like to test to see if the file is too big
+                         * to mmap.  There's no portable way to compare an
+                         * off_t and a size_t, so check that the size makes
+                         * it through the cast unchanged and hope that mmap
+                         * fails if the file is still too large.  Anything
+                         * that isn't a regular file, or that can't be mapped,
+                         * is read through stdio.
+                         */
                         if (sb.st_size == 0)
                                 F_SET(t, R_EOF);
-                        else {
+                        else if (!S_ISREG(sb.st_mode) ||
+                            (off_t)(size_t)sb.st_size != sb.st_size)
                                 goto slow;
+                        else {
+                                t->bt_msize = sb.st_size;
+                                if ((t->bt_smap = mmap(NULL, t->bt_msize,
+                                    PROT_READ, MAP_PRIVATE, rfd,
+                                    (off_t)0)) == MAP_FAILED) {
+                                        t->bt_smap = NULL;
+                                        goto slow;
+                                }
+                                t->bt_cmap = t->bt_smap;
+                                t->bt_emap = t->bt_smap + sb.st_size;
+                                t->bt_mtim = sb.st_mtim;
+                                t->bt_irec = F_ISSET(t, R_FIXLEN) ?
+                                    __rec_fmap : __rec_vmap;
+                                F_SET(t, R_MEMMAPPED);
+
+                                /*
+                                 * Variable length records that haven't been
+                                 * modified can stay in the mapped file, the
+                                 * tree holds a reference to them.
+                                 */
+                                if (openinfo &&
+                                    openinfo->flags & R_NOCOPY &&
+                                    !F_ISSET(t, R_FIXLEN))
+                                        F_SET(t, R_MAPREF);
                         }
                 }
         }
@@ -190,8 +226,12 @@ slow:                   if ((t->bt_rfp = fdopen(rfd, "r")) == NULL)
 
 einval: errno = EINVAL;
 err:    sverrno = errno;
-        if (dbp != NULL)
+        if (dbp != NULL) {
+                t = dbp->internal;
+                if (t->bt_smap != NULL)
+                        (void)munmap(t->bt_smap, t->bt_msize);
                 (void)__bt_close(dbp);
+        }
         if (fname != NULL)
                 (void)close(rfd);
         errno = sverrno;
@@ -50,6 +50,10 @@
 #include <compat_bsd_db.h>
 #include "recno.h"
 
+static EPG *rec_fast(BTREE *, u_int32_t);
+static int rec_ileaf(BTREE *, recno_t, const DBT *, unsigned int, int);
+static int rec_putv(BTREE *, DBT *, const DBT *);
+
 /*
  * __REC_PUT -- Add a recno item to the tree.
  *
@@ -57,7 +61,7 @@
  *      dbp:    pointer to access method
  *      key:    key
  *      data:   data
- *      flag:   R_CURSOR, R_IAFTER, R_IBEFORE, R_NOOVERWRITE
+ *      flag:   R_CURSOR, R_IAFTER, R_IAFTERV, R_IBEFORE, R_NOOVERWRITE
  *
  * Returns:
  *      RET_ERROR, RET_SUCCESS and RET_SPECIAL if the key is
@@ -81,6 +85,10 @@ __rec_put(const DB *dbp, DBT *key, const DBT *data, unsigned int flags)
                 t->bt_pinned = NULL;
         }
 
+        /* The data is a vector of records. */
+        if (flags == R_IAFTERV)
+                return (rec_putv(t, key, data));
+
         /*
          * If using fixed-length records, and the record is long, return
          * EINVAL.  If it's short, pad it out.  Use the record data return
@@ -179,6 +187,131 @@ einval:         errno = EINVAL;
         return (__rec_ret(t, NULL, nrec, key, NULL));
 }
 
+/*
+ * REC_PUTV -- Add a vector of records after a record.
+ *
+ * Parameters:
+ *      t:      tree
+ *      key:    key, the record to add the records after
+ *      vec:    data, an array of vec->size DBTs
+ *
+ * Each record is added as if by R_IAFTER, but the records that fit on the
+ * leaf page of the record before them are added without searching the tree
+ * again, and the counts in the parent pages are updated once for all of
+ * them.  On return, the key is the last record added, if any were.
+ *
+ * Returns:
+ *      RET_ERROR, RET_SUCCESS
+ */
+
+static int
+rec_putv(BTREE *t, DBT *key, const DBT *vec)
+{
+        EPG *e;
+        EPGNO *parent;
+        PAGE *h;
+        const DBT *data, *v;
+        indx_t idx, nxtindex;
+        recno_t nrec;
+        u_int32_t nbytes;
+        size_t cnt, n;
+        int status;
+        char *dest;
+
+        if (F_ISSET(t, R_FIXLEN))
+                goto einval;
+
+        /* Make sure that the record to add the records after exists. */
+        nrec = *(recno_t *)key->data;
+        if (nrec > t->bt_nrecs && !F_ISSET(t, R_EOF | R_INMEM) &&
+            t->bt_irec(t, nrec) == RET_ERROR)
+                return (RET_ERROR);
+        if (nrec > t->bt_nrecs)
+                goto einval;
+
+        status = RET_SUCCESS;
+        for (v = vec->data, cnt = vec->size; cnt > 0; v += n, cnt -= n) {
+                /* Records that won't fit on a page are added one at a time. */
+                n = 1;
+                if (v->size > t->bt_ovflsize) {
+                        if ((status = __rec_iput(t, nrec == 0 ? 0 : nrec - 1,
+                            v, nrec == 0 ? R_IBEFORE : R_IAFTER)) != RET_SUCCESS)
+                                break;
+                        ++nrec;
+                        continue;
+                }
+
+                /*
+                 * Find the leaf page, counting the first record in the
+                 * parent pages.  If the record doesn't fit, split the page,
+                 * the split code adds the record and unpins the page.
+                 */
+                if ((e = __rec_search(t,
+                    nrec == 0 ? 0 : nrec - 1, SINSERT)) == NULL) {
+                        status = RET_ERROR;
+                        break;
+                }
+                h = e->page;
+                idx = nrec == 0 ? e->index : e->index + 1;
+                nbytes = NRLEAFDBT(v->size);
+                if (h->upper - h->lower < nbytes + sizeof(indx_t)) {
+                        if ((status = __bt_split(t,
+                            h, NULL, v, 0, nbytes, idx)) != RET_SUCCESS)
+                                break;
+                        ++t->bt_nrecs;
+                        ++nrec;
+                        continue;
+                }
+
+                /* Add the records that fit on the page. */
+                for (n = 0; n < cnt && v[n].size <= t->bt_ovflsize &&
+                    h->upper - h->lower >=
+                    (nbytes = NRLEAFDBT(v[n].size)) + sizeof(indx_t);
+                    ++n, ++idx) {
+                        if (idx < (nxtindex = NEXTINDEX(h)))
+                                memmove(h->linp + idx + 1, h->linp + idx,
+                                    (nxtindex - idx) * sizeof(indx_t));
+                        h->lower += sizeof(indx_t);
+                        h->linp[idx] = h->upper -= nbytes;
+                        dest = (char *)h + h->upper;
+                        data = &v[n];
+                        WR_RLEAF(dest, data, 0);
+                }
+                if (h->nextpg == P_INVALID) {
+                        t->bt_order = FORWARD;
+                        t->bt_last.pgno = h->pgno;
+                }
+                mpool_put(t->bt_mp, h, MPOOL_DIRTY);
+
+                t->bt_nrecs += n;
+                nrec += n;
+                F_SET(t, B_MODIFIED);
+
+                /* Count the rest of the records in the parent pages. */
+                if (n > 1)
+                        for (parent = t->bt_stack;
+                            parent < t->bt_sp; ++parent) {
+                                if ((h = mpool_get(t->bt_mp,
+                                    parent->pgno, 0)) == NULL) {
+                                        status = RET_ERROR;
+                                        break;
+                                }
+                                GETRINTERNAL(h, parent->index)->nrecs += n - 1;
+                                mpool_put(t->bt_mp, h, MPOOL_DIRTY);
+                        }
+                if (status != RET_SUCCESS)
+                        break;
+        }
+
+        F_SET(t, R_MODIFIED);
+        if (__rec_ret(t, NULL, nrec, key, NULL) == RET_ERROR)
+                return (RET_ERROR);
+        return (status);
+
+einval: errno = EINVAL;
+        return (RET_ERROR);
+}
+
 /*
  * __REC_IPUT -- Add a recno item to the tree.
  *
@@ -195,13 +328,9 @@ int
 __rec_iput(BTREE *t, recno_t nrec, const DBT *data, unsigned int flags)
 {
         DBT tdata;
-        EPG *e;
-        PAGE *h;
-        indx_t idx, nxtindex;
         pgno_t pg;
-        u_int32_t nbytes;
-        int dflags, status;
-        char *dest, db[NOVFLSIZE];
+        int dflags;
+        char db[NOVFLSIZE];
 
         /*
          * If the data won't fit on a page, store it on indirect pages.
@@ -222,8 +351,70 @@ __rec_iput(BTREE *t, recno_t nrec, const DBT *data, unsigned int flags)
         } else
                 dflags = 0;
 
-        /* __rec_search pins the returned page. */
-        if ((e = __rec_search(t, nrec,
+        return (rec_ileaf(t, nrec, data, flags, dflags));
+}
+
+/*
+ * __REC_IREF -- Add a reference to a record in the input file to the tree.
+ *
+ * Parameters:
+ *      t:      tree
+ *      nrec:   record number
+ *      off:    offset of the record in the input file
+ *      size:   length of the record
+ *
+ * Returns:
+ *      RET_ERROR, RET_SUCCESS
+ */
+
+int
+__rec_iref(BTREE *t, recno_t nrec, u_int64_t off, u_int32_t size)
+{
+        DBT tdata;
+        char db[NMAPSIZE];
+
+        memmove(db, &off, sizeof(u_int64_t));
+        memmove(db + sizeof(u_int64_t), &size, sizeof(u_int32_t));
+        tdata.data = db;
+        tdata.size = NMAPSIZE;
+        return (rec_ileaf(t, nrec, &tdata, 0, P_MAPDATA));
+}
+
+/*
+ * REC_ILEAF -- Add an already built leaf item to the tree.
+ *
+ * Parameters:
+ *      t:      tree
+ *      nrec:   record number
+ *      data:   item
+ *      flags:  R_IAFTER, R_IBEFORE or 0
+ *      dflags: P_BIGDATA, P_MAPDATA or 0
+ *
+ * Returns:
+ *      RET_ERROR, RET_SUCCESS
+ */
+
+static int
+rec_ileaf(BTREE *t, recno_t nrec, const DBT *data, unsigned int flags,
+    int dflags)
+{
+        EPG *e;
+        PAGE *h;
+        indx_t idx, nxtindex;
+        u_int32_t nbytes;
+        int status;
+        char *dest;
+
+        /*
+         * Records are usually appended a record at a time as the file is
+         * read, try the last leaf page before searching the tree.  Either
+         * way, the returned page is pinned.
+         */
+        nbytes = NRLEAFDBT(data->size);
+        e = NULL;
+        if (flags == 0 && nrec == t->bt_nrecs && t->bt_order == FORWARD)
+                e = rec_fast(t, nbytes);
+        if (e == NULL && (e = __rec_search(t, nrec,
             nrec > t->bt_nrecs || flags == R_IAFTER || flags == R_IBEFORE ?
             SINSERT : SEARCH)) == NULL)
                 return (RET_ERROR);
@@ -259,7 +450,6 @@ __rec_iput(BTREE *t, recno_t nrec, const DBT *data, unsigned int flags)
          * the offset array, shift the pointers up.
          */
 
-        nbytes = NRLEAFDBT(data->size);
         if (h->upper - h->lower < nbytes + sizeof(indx_t)) {
                 status = __bt_split(t, h, NULL, data, dflags, nbytes, idx);
                 if (status == RET_SUCCESS)
@@ -278,9 +468,52 @@ __rec_iput(BTREE *t, recno_t nrec, const DBT *data, unsigned int flags)
                 return (RET_ERROR);
         WR_RLEAF(dest, data, dflags);
 
+        if (h->nextpg == P_INVALID) {
+                t->bt_order = FORWARD;
+                t->bt_last.pgno = h->pgno;
+        }
+
         ++t->bt_nrecs;
         F_SET(t, B_MODIFIED);
         mpool_put(t->bt_mp, h, MPOOL_DIRTY);
 
         return (RET_SUCCESS);
 }
+
+/*
+ * REC_FAST -- Do a quick check for an append to the last leaf page.
+ *
+ * Parameters:
+ *      t:      tree
+ *      nbytes: size of the leaf item
+ *
+ * Returns:
+ *      The EPG for the end of the last leaf page, or NULL if it's not
+ *      known or there's no room on it.
+ */
+
+static EPG *
+rec_fast(BTREE *t, u_int32_t nbytes)
+{
+        PAGE *h;
+
+        if ((h = mpool_get(t->bt_mp, t->bt_last.pgno, 0)) == NULL) {
+                t->bt_order = NOT;
+                return (NULL);
+        }
+
+        /*
+         * The page may have been split, or reused, since it was last the
+         * end of the tree.  If won't fit in this page, have to search to
+         * get split stack.
+         */
+        if (!(h->flags & P_RLEAF) || h->nextpg != P_INVALID ||
+            h->upper - h->lower < nbytes + sizeof(indx_t)) {
+                t->bt_order = NOT;
+                mpool_put(t->bt_mp, h, 0);
+                return (NULL);
+        }
+        t->bt_cur.page = h;
+        t->bt_cur.index = NEXTINDEX(h);
+        return (&t->bt_cur);
+}
@@ -50,6 +50,9 @@
 #include <compat_bsd_db.h>
 #include "recno.h"
 
+static int rec_direct(BTREE *, RLEAF *, DBT *);
+static int rec_seqv(BTREE *, DBT *, DBT *, unsigned int);
+
 /*
  * __REC_SEQ -- Recno sequential scan interface.
  *
@@ -57,7 +60,7 @@
  *      dbp:    pointer to access method
  *      key:    key for positioning and return value
  *      data:   data return value
- *      flags:  R_CURSOR, R_FIRST, R_LAST, R_NEXT, R_PREV.
+ *      flags:  R_CURSOR, R_FIRST, R_LAST, R_NEXT, R_NEXTV, R_PREV, R_PREVV.
  *
  * Returns:
  *      RET_ERROR, RET_SUCCESS or RET_SPECIAL if there's no next key.
@@ -80,6 +83,9 @@ __rec_seq(const DB *dbp, DBT *key, DBT *data, unsigned int flags)
         }
 
         switch(flags) {
+        case R_NEXTV:
+        case R_PREVV:
+                return (rec_seqv(t, key, data, flags));
         case R_CURSOR:
                 if ((nrec = *(recno_t *)key->data) == 0)
                         goto einval;
@@ -119,6 +125,9 @@ einval:         errno = EINVAL;
                         return (RET_SPECIAL);
         }
 
+        if (__rec_mvalid(t) == -1)
+                return (RET_ERROR);
+
         if ((e = __rec_search(t, nrec - 1, SEARCH)) == NULL)
                 return (RET_ERROR);
 
@@ -132,3 +141,133 @@ einval:         errno = EINVAL;
                 t->bt_pinned = e->page;
         return (status);
 }
+
+/*
+ * REC_SEQV -- Return a vector of records from a leaf page.
+ *
+ * Parameters:
+ *      t:      tree
+ *      key:    key, the record to start from
+ *      vec:    data, an array of vec->size DBTs
+ *      flags:  R_NEXTV, R_PREVV
+ *
+ * R_NEXTV returns the record and the records after it on its leaf page,
+ * R_PREVV the records before it on its leaf page and the record, in both
+ * cases in record order and at most vec->size of them.  The data is left
+ * in place, so only records that can be returned without being copied are
+ * included, unless the record itself has to be, in which case it's the
+ * only one returned.  On return, the key is the first record returned and
+ * vec->size the number of records.  The data is good until the next call
+ * into the tree.
+ *
+ * Returns:
+ *      RET_ERROR, RET_SUCCESS or RET_SPECIAL if the record doesn't exist.
+ */
+
+static int
+rec_seqv(BTREE *t, DBT *key, DBT *vec, unsigned int flags)
+{
+        DBT *v;
+        EPG *e;
+        PAGE *h;
+        recno_t nrec;
+        indx_t bot, idx, top;
+        int status;
+
+        v = vec->data;
+        if ((nrec = *(recno_t *)key->data) == 0 || vec->size == 0) {
+                errno = EINVAL;
+                return (RET_ERROR);
+        }
+
+        if (nrec > t->bt_nrecs) {
+                if (!F_ISSET(t, R_EOF | R_INMEM) &&
+                    (status = t->bt_irec(t, nrec)) != RET_SUCCESS)
+                        return (status);
+                if (nrec > t->bt_nrecs)
+                        return (RET_SPECIAL);
+        }
+
+        if (__rec_mvalid(t) == -1)
+                return (RET_ERROR);
+
+        if ((e = __rec_search(t, nrec - 1, SEARCH)) == NULL)
+                return (RET_ERROR);
+        h = e->page;
+
+        /* A record that has to be copied is returned by itself. */
+        if (!rec_direct(t, GETRLEAF(h, e->index), &v[0])) {
+                vec->size = 1;
+                status = __rec_ret(t, e, nrec, key, &v[0]);
+                if (F_ISSET(t, B_DB_LOCK))
+                        mpool_put(t->bt_mp, h, 0);
+                else
+                        t->bt_pinned = h;
+                return (status);
+        }
+
+        if (flags == R_NEXTV) {
+                bot = e->index;
+                for (top = bot + 1; top < NEXTINDEX(h) &&
+                    top - bot < vec->size &&
+                    rec_direct(t, GETRLEAF(h, top), &v[top - bot]); ++top)
+                        continue;
+        } else {
+                top = e->index + 1;
+                for (bot = e->index; bot > 0 && top - bot < vec->size &&
+                    rec_direct(t, GETRLEAF(h, bot - 1), NULL); --bot)
+                        continue;
+                for (idx = bot; idx < top; ++idx)
+                        (void)rec_direct(t, GETRLEAF(h, idx), &v[idx - bot]);
+                nrec -= e->index - bot;
+        }
+        vec->size = top - bot;
+
+        F_SET(&t->bt_cursor, CURS_INIT);
+        t->bt_cursor.rcursor = nrec;
+
+        status = __rec_ret(t, NULL, nrec, key, NULL);
+        t->bt_pinned = h;
+        return (status);
+}
+
+/*
+ * REC_DIRECT -- Return a record's data in place, if possible.
+ *
+ * Parameters:
+ *      t:      tree
+ *      rl:     leaf item
+ *      data:   data return value, may be NULL
+ *
+ * Returns:
+ *      1 if the data can be returned without copying it, 0 otherwise.
+ */
+
+static int
+rec_direct(BTREE *t, RLEAF *rl, DBT *data)
+{
+        u_int64_t off;
+        u_int32_t size;
+
+        if (F_ISSET(t, B_DB_LOCK) || rl->flags & P_BIGDATA)
+                return (0);
+        if (rl->flags & P_MAPDATA) {
+                if (!F_ISSET(t, R_MEMMAPPED))
+                        return (0);
+                memmove(&off, rl->bytes, sizeof(u_int64_t));
+                memmove(&size, rl->bytes + sizeof(u_int64_t),
+                    sizeof(u_int32_t));
+                if (off + size > t->bt_msize)
+                        return (0);
+                if (data != NULL) {
+                        data->data = t->bt_smap + off;
+                        data->size = size;
+                }
+                return (1);
+        }
+        if (data != NULL) {
+                data->data = rl->bytes;
+                data->size = rl->dsize;
+        }
+        return (1);
+}
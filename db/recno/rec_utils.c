@@ -39,6 +39,7 @@
 
 #include "../../include/compat.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <bsd_stdlib.h>
 #include <bsd_string.h>
@@ -99,6 +100,9 @@ dataonly:
                     &data->size, &t->bt_rdata.data, &t->bt_rdata.size))
                         return (RET_ERROR);
                 data->data = t->bt_rdata.data;
+        } else if (rl->flags & P_MAPDATA) {
+                if (__rec_mapget(t, rl->bytes, data))
+                        return (RET_ERROR);
         } else if (F_ISSET(t, B_DB_LOCK)) {
                 /* Use +1 in case the first record retrieved is 0 length. */
                 if (rl->dsize + 1 > t->bt_rdata.size) {
@@ -117,3 +121,58 @@ dataonly:
         }
         return (RET_SUCCESS);
 }
+
+/*
+ * __rec_mapget --
+ *      Return the data for a record that references the input file.
+ *
+ * Parameters:
+ *      t:      tree
+ *      p:      P_MAPDATA item
+ *   data:      user's data structure
+ *
+ * Returns:
+ *      RET_SUCCESS, RET_ERROR.
+ */
+
+int
+__rec_mapget(BTREE *t, const char *p, DBT *data)
+{
+        u_int64_t off;
+        u_int32_t size;
+        void *tp;
+
+        memmove(&off, p, sizeof(u_int64_t));
+        memmove(&size, p + sizeof(u_int64_t), sizeof(u_int32_t));
+
+        /*
+         * The caller checked the file before searching the tree.  If it
+         * changed underneath us, the record is gone: whatever is at its
+         * offset now isn't the user's data.  Fail, leaving the reference
+         * in the tree.
+         */
+        if (!F_ISSET(t, R_MEMMAPPED)) {
+                errno = ESTALE;
+                return (RET_ERROR);
+        }
+
+        /*
+         * Return a pointer into the mapped space, unless the user asked
+         * for their own copy.
+         */
+        if (!F_ISSET(t, B_DB_LOCK)) {
+                data->data = t->bt_smap + off;
+                data->size = size;
+                return (RET_SUCCESS);
+        }
+        if (size + 1 > t->bt_rdata.size) {
+                if ((tp = realloc(t->bt_rdata.data, size + 1)) == NULL)
+                        return (RET_ERROR);
+                t->bt_rdata.data = tp;
+                t->bt_rdata.size = size + 1;
+        }
+        memmove(t->bt_rdata.data, t->bt_smap + off, size);
+        data->data = t->bt_rdata.data;
+        data->size = size;
+        return (RET_SUCCESS);
+}
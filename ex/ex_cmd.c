@@ -133,6 +133,11 @@ EXCMDLIST const cmds[] = {
             "l1",
             "[line [,line]] co[py] line [flags]",
             "copy lines elsewhere in the file"},
+/* C_COUNT */
+        {"count",       ex_count,       E_ADDR2_ALL,
+            "!s",
+            "[line [,line]] cou[nt][!] [/RE/]",
+            "count the matches of an RE, and with ! list them for n and N"},
 /*
  * !!!
  * Adding new commands starting with 'd' may break the delete command code
@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Copyright (c) 2022-2023 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * See the LICENSE.md file for redistribution information.
+ */
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <bitstring.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <bsd_stdlib.h>
+#include <bsd_string.h>
+#include <bsd_unistd.h>
+
+#include "../common/common.h"
+#include "par.h"
+
+/*
+ * Count thread state; see ex_count().
+ */
+typedef struct _cntthr {
+        PARTHR   pt;                    /* Slice of the batch. */
+        regex_t *re;                    /* RE, read-only. */
+        u_long   matches;               /* Matches. */
+        u_long   lines;                 /* Lines that match. */
+        int      list;                  /* If listing the matches. */
+        MARK    *ml;                    /* Matches in the slice. */
+        size_t   ml_cnt;                /* Matches in ml. */
+        size_t   ml_len;                /* Length of ml. */
+} CNTTHR;
+
+static int c_line(CNTTHR *, recno_t, char *, size_t);
+static void *c_thread(void *);
+
+/*
+ * ex_count -- [line [,line]] cou[nt][!] [/pattern/]
+ *      Count the matches of a pattern, the places a repeated search
+ *      stops.  With !, keep them as a list that the next and previous
+ *      search commands step through until the RE or the file changes.
+ *
+ * PUBLIC: int ex_count(SCR *, EXCMD *);
+ */
+int
+ex_count(SCR *sp, EXCMD *cmdp)
+{
+        CNTTHR thr[PAR_MAXTHREADS], *tp;
+        MARK *ml;
+        PAR par;
+        busy_t btype;
+        recno_t elno, last, lno;
+        size_t ml_cnt, ml_len;
+        u_long matches, mlines;
+        int delim, list, nt, rval, t;
+        char *p, *ptrn, *q;
+
+        NEEDFILE(sp, cmdp);
+
+        /*
+         * Get the pattern string, toss escaped characters, as for the
+         * global command.  If there isn't one, use the last one.
+         */
+        ptrn = NULL;
+        if (cmdp->argc != 0) {
+                for (p = cmdp->argv[0]->bp; isblank(*p); ++p);
+                if (*p != '\0') {
+                        if (isalnum(*p) ||
+                            *p == '\\' || *p == '|' || *p == '\n') {
+usage:                          ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
+                                return (1);
+                        }
+                        delim = *p++;
+                        for (ptrn = q = p;;) {
+                                if (p[0] == '\0' || p[0] == delim) {
+                                        if (p[0] == delim)
+                                                ++p;
+                                        *q = '\0';
+                                        break;
+                                }
+                                if (p[0] == '\\') {
+                                        if (p[1] == delim)
+                                                ++p;
+                                        else if (p[1] == '\\')
+                                                *q++ = *p++;
+                                }
+                                *q++ = *p++;
+                        }
+                        for (; isblank(*p); ++p);
+                        if (*p != '\0')
+                                goto usage;
+                        if (*ptrn == '\0')
+                                ptrn = NULL;
+                }
+        }
+        if (ptrn == NULL) {
+                if (sp->re == NULL) {
+                        ex_emsg(sp, NULL, EXM_NOPREVRE);
+                        return (1);
+                }
+
+                /* Re-compile the RE if necessary. */
+                if (!F_ISSET(sp, SC_RE_SEARCH) && re_compile(sp,
+                    sp->re, sp->re_len, NULL, NULL, &sp->re_c, RE_C_SEARCH))
+                        return (1);
+        } else {
+                /* Compile the RE, and set the search direction. */
+                if (re_compile(sp, ptrn, q - ptrn,
+                    &sp->re, &sp->re_len, &sp->re_c, RE_C_SEARCH))
+                        return (1);
+                sp->searchdir = FORWARD;
+        }
+
+        /* Any old list is for some other RE, or for the old matches. */
+        list = FL_ISSET(cmdp->iflags, E_C_FORCE);
+        if (list) {
+                free(sp->ml);
+                sp->ml = NULL;
+                sp->ml_cnt = 0;
+        }
+
+        lno = cmdp->addr1.lno;
+        elno = cmdp->addr2.lno;
+        if (ex_par_init(sp, &par, ex_par_nthreads(elno - lno + 1))) {
+                ex_par_end(&par);
+                return (1);
+        }
+
+        memset(thr, 0, sizeof(thr));
+        ml = NULL;
+        ml_cnt = ml_len = 0;
+        matches = mlines = 0;
+        rval = 1;
+
+        /*
+         * Each thread counts the matches in a slice of the batch, and the
+         * lists of matches are joined in order.
+         */
+        btype = BUSY_ON;
+        for (; lno <= elno; lno += par.n) {
+                /* Someone's unhappy, time to stop. */
+                if (INTERRUPTED(sp))
+                        break;
+                search_busy(sp, btype);
+                btype = BUSY_UPDATE;
+
+                if (ex_par_read(sp, &par, lno, elno))
+                        goto err;
+                for (t = 0; t < PAR_MAXTHREADS; ++t) {
+                        thr[t].re = &sp->re_c;
+                        thr[t].list = list;
+                }
+                nt = ex_par_run(&par, thr, sizeof(CNTTHR), c_thread);
+
+                /* Add up the matches, in order. */
+                for (t = 0; t < nt; ++t) {
+                        tp = &thr[t];
+                        if (ex_par_err(sp, &tp->pt, &sp->re_c))
+                                goto err;
+                        matches += tp->matches;
+                        mlines += tp->lines;
+                        if (tp->ml_cnt == 0)
+                                continue;
+                        if (ml_cnt + tp->ml_cnt > ml_len) {
+                                ml_len = ml_len * 2 > ml_cnt + tp->ml_cnt ?
+                                    ml_len * 2 : ml_cnt + tp->ml_cnt;
+                                REALLOCARRAY(sp, ml, ml_len, sizeof(MARK));
+                                if (ml == NULL)
+                                        goto err;
+                        }
+                        memcpy(ml + ml_cnt, tp->ml, tp->ml_cnt * sizeof(MARK));
+                        ml_cnt += tp->ml_cnt;
+                }
+        }
+        search_busy(sp, BUSY_OFF);
+
+        if (lno <= elno)
+                msgq(sp, M_INFO, "Interrupted after %lu matches", matches);
+        else if (matches == 0)
+                msgq(sp, M_INFO, "No match found");
+        else
+                msgq(sp, M_INFO, "%lu match%s on %lu line%s", matches,
+                    matches == 1 ? "" : "es", mlines, mlines == 1 ? "" : "s");
+
+        /* Keep a complete list of matches. */
+        if (list && lno > elno && ml_cnt != 0) {
+                if (db_last(sp, &last))
+                        goto err;
+                sp->ml = ml;
+                sp->ml_cnt = ml_cnt;
+                sp->ml_cur = ml_cnt;
+                sp->ml_gen = sp->re_gen;
+                sp->ml_chg = sp->ep->c_chg;
+                sp->ml_all = cmdp->addr1.lno == 1 && cmdp->addr2.lno == last;
+                ml = NULL;
+        }
+        rval = 0;
+
+err:    if (rval)
+                search_busy(sp, BUSY_OFF);
+        for (t = 0; t < PAR_MAXTHREADS; ++t)
+                free(thr[t].ml);
+        free(ml);
+        ex_par_end(&par);
+        return (rval);
+}
+
+/*
+ * c_thread --
+ *      Count thread: count the matches in a slice of the batch.
+ */
+static void *
+c_thread(void *arg)
+{
+        CNTTHR *tp;
+        PAR *par;
+        size_t i;
+
+        tp = arg;
+        par = tp->pt.par;
+        tp->matches = tp->lines = 0;
+        tp->ml_cnt = 0;
+        for (i = tp->pt.first; i < tp->pt.first + tp->pt.cnt; ++i)
+                if (c_line(tp,
+                    par->lno + i, PAR_LP(par, i), PAR_LEN(par, i)))
+                        break;
+        tp->pt.done = i - tp->pt.first;
+        return (NULL);
+}
+
+/*
+ * c_line --
+ *      Count the matches in a line.  A match is a place a repeated
+ *      forward search stops, so the next match is looked for starting
+ *      a character past the last one; see f_search() and b_search().
+ *      Nothing here may touch the screen or the file, it's called by
+ *      the count threads.
+ */
+static int
+c_line(CNTTHR *tp, recno_t lno, char *l, size_t len)
+{
+        MARK *mp;
+        regmatch_t match[1];
+        size_t nlen;
+        u_long nmatch;
+        int eval;
+
+        nmatch = 0;
+        for (match[0].rm_so = 0;; ++match[0].rm_so) {
+                match[0].rm_eo = len;
+                eval = regexec(tp->re, l, 1, match,
+                    (match[0].rm_so == 0 ? 0 : REG_NOTBOL) | REG_STARTEND);
+                if (eval == REG_NOMATCH)
+                        break;
+                if (eval != 0) {
+                        tp->pt.eval = eval;
+                        return (1);
+                }
+                if (tp->list) {
+                        if (tp->ml_cnt == tp->ml_len) {
+                                nlen = tp->ml_len == 0 ? 256 : tp->ml_len * 2;
+                                if ((mp = openbsd_reallocarray(tp->ml,
+                                    nlen, sizeof(MARK))) == NULL) {
+                                        tp->pt.err = errno;
+                                        return (1);
+                                }
+                                tp->ml = mp;
+                                tp->ml_len = nlen;
+                        }
+                        mp = &tp->ml[tp->ml_cnt++];
+                        mp->lno = lno;
+                        mp->cno = match[0].rm_so;
+                }
+                if (nmatch++ == 0)
+                        ++tp->lines;
+                if (match[0].rm_so + 1 >= len)
+                        break;
+        }
+        tp->matches += nmatch;
+        return (0);
+}
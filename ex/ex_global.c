@@ -28,7 +28,19 @@
 
 enum which {GLOBAL, V};
 
+/* Commands the global command runs over all of the lines at once. */
+enum gfast {G_NONE, G_COPY, G_DELETE, G_MOVE, G_SUBST};
+
+/* Lines are copied and moved in batches of this many. */
+#define G_NLINES        1024
+
 static int ex_g_setup(SCR *, EXCMD *, enum which);
+static enum gfast ex_g_fast(SCR *, CHAR_T *, size_t);
+static int ex_g_copy(SCR *, bitstr_t *, recno_t, recno_t);
+static int ex_g_delete(SCR *, bitstr_t *, recno_t, recno_t);
+static int ex_g_move(SCR *, bitstr_t *, recno_t, recno_t);
+static int ex_g_subst(SCR *, bitstr_t *, recno_t, recno_t, CHAR_T *, size_t);
+static int ex_g_cursor(SCR *, recno_t);
 
 /*
  * ex_global -- [line [,line]] g[lobal][!] /pattern/ [commands]
@@ -66,12 +78,13 @@ ex_g_setup(SCR *sp, EXCMD *cmdp, enum which cmd)
         EXCMD *ecp;
         MARK abs_mark;
         RANGE *rp;
+        bitstr_t *bits;
         busy_t btype;
         recno_t start, end;
         regex_t *re;
         regmatch_t match[1];
-        size_t len;
-        int cnt, delim, eval;
+        size_t clen, len;
+        int cnt, delim, eval, rval;
         char *dbp;
 
         NEEDFILE(sp, cmdp);
@@ -156,59 +169,45 @@ usage:          ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
         if (mark_set(sp, ABSMARK1, &abs_mark, 1))
                 return (1);
 
-        /* Get an EXCMD structure. */
-        CALLOC_RET(sp, ecp, 1, sizeof(EXCMD));
-        TAILQ_INIT(&ecp->rq);
-
         /*
-         * Get a copy of the command string; the default command is print.
-         * Don't worry about a set of <blank>s with no command, that will
-         * default to print in the ex parser.  We need to have two copies
-         * because the ex parser may step on the command string when it's
-         * parsing it.
+         * Get the command; the default command is print.  Don't worry about
+         * a set of <blank>s with no command, that will default to print in
+         * the ex parser.
          */
-        if ((len = cmdp->argv[0]->len - (p - cmdp->argv[0]->bp)) == 0) {
+        if ((clen = cmdp->argv[0]->len - (p - cmdp->argv[0]->bp)) == 0) {
                 p = "pp";
-                len = 1;
+                clen = 1;
         }
 
-        MALLOC_RET(sp, ecp->cp, len * 2);
-        ecp->o_cp = ecp->cp;
-        ecp->o_clen = len;
-        memcpy(ecp->cp + len, p, len);
-        ecp->range_lno = OOBLNO;
-        FL_SET(ecp->agv_flags, cmd == GLOBAL ? AGV_GLOBAL : AGV_V);
-        LIST_INSERT_HEAD(&sp->gp->ecq, ecp, q);
-
         /*
          * For each line...  The semantics of global matching are that we first
          * have to decide which lines are going to get passed to the command,
-         * and then pass them to the command, ignoring other changes.  There's
-         * really no way to do this in a single pass, since arbitrary line
-         * creation, deletion and movement can be done in the ex command.  For
-         * example, a good vi clone test is ":g/X/mo.-3", or "g/X/.,.+1d".
-         * What we do is create linked list of lines that are tracked through
-         * each ex command.  There's a callback routine which the DB interface
-         * routines call when a line is created or deleted.  This doesn't help
-         * the layering much.
+         * and then pass them to the command, ignoring other changes.  First,
+         * mark the lines in a bitmap, in a single pass over the range.
          */
+        if ((bits = bit_alloc(cmdp->addr2.lno - cmdp->addr1.lno + 1)) == NULL) {
+                msgq(sp, M_SYSERR, NULL);
+                return (1);
+        }
         btype = BUSY_ON;
         cnt = INTERRUPT_CHECK;
         for (start = cmdp->addr1.lno,
             end = cmdp->addr2.lno; start <= end; ++start) {
                 if (cnt-- == 0) {
                         if (INTERRUPTED(sp)) {
-                                LIST_REMOVE(ecp, q);
-                                free(ecp->cp);
-                                free(ecp);
-                                break;
+                                search_busy(sp, BUSY_OFF);
+                                free(bits);
+                                return (0);
                         }
                         search_busy(sp, btype);
                         btype = BUSY_UPDATE;
                         cnt = INTERRUPT_CHECK;
                 }
-                if (db_get(sp, start, DBG_FATAL, &dbp, &len))
+                if (db_get(sp, start, DBG_FATAL, &dbp, &len)) {
+                        search_busy(sp, BUSY_OFF);
+                        free(bits);
                         return (1);
+                }
                 match[0].rm_so = 0;
                 match[0].rm_eo = len;
                 switch (eval =
@@ -225,6 +224,72 @@ usage:          ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
                         re_error(sp, eval, &sp->re_c);
                         break;
                 }
+                bit_set(bits, start - cmdp->addr1.lno);
+        }
+        search_busy(sp, BUSY_OFF);
+        start = cmdp->addr1.lno;
+        end = cmdp->addr2.lno;
+
+        /*
+         * The common commands that only change the lines they're run on,
+         * or move them to the start or the end of the file, are run over
+         * all of the lines at once.
+         */
+        rval = 0;
+        switch (ex_g_fast(sp, p, clen)) {
+        case G_NONE:
+                break;
+        case G_COPY:
+                rval = ex_g_copy(sp, bits, start, end);
+                goto done;
+        case G_DELETE:
+                rval = ex_g_delete(sp, bits, start, end);
+                goto done;
+        case G_MOVE:
+                rval = ex_g_move(sp, bits, start, end);
+                goto done;
+        case G_SUBST:
+                rval = ex_g_subst(sp, bits, start, end, p, clen);
+                goto done;
+        }
+
+        /* Get an EXCMD structure. */
+        CALLOC(sp, ecp, 1, sizeof(EXCMD));
+        if (ecp == NULL) {
+                rval = 1;
+                goto done;
+        }
+        TAILQ_INIT(&ecp->rq);
+
+        /*
+         * Get a copy of the command string.  We need to have two copies
+         * because the ex parser may step on the command string when it's
+         * parsing it.
+         */
+        MALLOC(sp, ecp->cp, clen * 2);
+        if (ecp->cp == NULL) {
+                free(ecp);
+                rval = 1;
+                goto done;
+        }
+        ecp->o_cp = ecp->cp;
+        ecp->o_clen = clen;
+        memcpy(ecp->cp + clen, p, clen);
+        ecp->range_lno = OOBLNO;
+        FL_SET(ecp->agv_flags, cmd == GLOBAL ? AGV_GLOBAL : AGV_V);
+        LIST_INSERT_HEAD(&sp->gp->ecq, ecp, q);
+
+        /*
+         * Arbitrary line creation, deletion and movement can be done in the
+         * ex command.  For example, a good vi clone test is ":g/X/mo.-3", or
+         * "g/X/.,.+1d".  What we do is create linked list of lines that are
+         * tracked through each ex command.  There's a callback routine which
+         * the DB interface routines call when a line is created or deleted.
+         * This doesn't help the layering much.
+         */
+        for (; start <= end; ++start) {
+                if (!bit_test(bits, start - cmdp->addr1.lno))
+                        continue;
 
                 /* If follows the last entry, extend the last entry's range. */
                 if ((rp = TAILQ_LAST(&ecp->rq, _rh)) && rp->stop == start - 1) {
@@ -234,26 +299,344 @@ usage:          ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
 
                 /* Allocate a new range, and append it to the list. */
                 CALLOC(sp, rp, 1, sizeof(RANGE));
-                if (rp == NULL)
-                        return (1);
+                if (rp == NULL) {
+                        rval = 1;
+                        goto done;
+                }
                 rp->start = rp->stop = start;
                 TAILQ_INSERT_TAIL(&ecp->rq, rp, q);
         }
-        search_busy(sp, BUSY_OFF);
-        return (0);
+
+done:   free(bits);
+        return (rval);
 }
 
+/*
+ * ex_g_fast --
+ *      Return if the command is one that can be run over all of the lines
+ *      at once: "d", "t$", "m0", or a substitution that doesn't add lines
+ *      and doesn't depend on having been run before, i.e. "s/RE/repl/g".
+ */
+static enum gfast
+ex_g_fast(SCR *sp, CHAR_T *p, size_t len)
+{
+        CHAR_T *ep, *name;
+        size_t nlen;
+        int delim;
+
+        /* Multiple commands and escaped characters take the long way. */
+        for (ep = p + len, name = p; name < ep; ++name)
+                if (*name == '|' ||
+                    *name == '\n' || KEY_VAL(sp, *name) == K_VLNEXT)
+                        return (G_NONE);
+
+        for (; p < ep && isblank(*p); ++p);
+        for (name = p; p < ep && isalpha(*p); ++p);
+        if ((nlen = p - name) == 0)
+                return (G_NONE);
+
+        if (nlen == 1 && name[0] == 's') {
+                /*
+                 * The replacement can't use the previous replacement, which
+                 * changes every time it's run, or split the line.  With the
+                 * edcompatible option set, the 'g' flag toggles every time
+                 * it's run.  Other flags change what's displayed.
+                 */
+                if (O_ISSET(sp, O_EDCOMPATIBLE) || p == ep)
+                        return (G_NONE);
+                delim = *p++;
+                if (isalnum(delim) || isblank(delim) ||
+                    delim == '\\' || delim == '"')
+                        return (G_NONE);
+                for (; p < ep && *p != delim; ++p)
+                        if (*p == '\\' && p + 1 < ep)
+                                ++p;
+                if (p < ep)
+                        ++p;
+                for (; p < ep && *p != delim; ++p) {
+                        if (*p == '\\' && p + 1 < ep)
+                                ++p;
+                        if (*p == '~' || *p == '\r' || *p == '\n')
+                                return (G_NONE);
+                }
+                if (p < ep)
+                        ++p;
+                for (; p < ep; ++p)
+                        if (*p != 'g' && !isblank(*p))
+                                return (G_NONE);
+                return (G_SUBST);
+        }
+        if (nlen <= 6 && !memcmp(name, "delete", nlen))
+                delim = '\0';
+        else if ((nlen == 1 && name[0] == 't') ||
+            (nlen >= 2 && nlen <= 4 && !memcmp(name, "copy", nlen)))
+                delim = '$';
+        else if (nlen <= 4 && !memcmp(name, "move", nlen))
+                delim = '0';
+        else
+                return (G_NONE);
+
+        /* Followed by the destination line, if any. */
+        for (; p < ep && isblank(*p); ++p);
+        if (delim != '\0' && (p == ep || *p++ != delim))
+                return (G_NONE);
+        for (; p < ep && isblank(*p); ++p);
+        if (p != ep)
+                return (G_NONE);
+        return (delim == '\0' ? G_DELETE : delim == '$' ? G_COPY : G_MOVE);
+}
+
+/*
+ * ex_g_copy --
+ *      Copy the marked lines to the end of the file, ":g/RE/t$".
+ */
+static int
+ex_g_copy(SCR *sp, bitstr_t *bits, recno_t start, recno_t end)
+{
+        CB cb;
+        MARK m, tm;
+        recno_t i, n;
+        int rval;
+
+        rval = 0;
+        memset(&cb, 0, sizeof(cb));
+        TAILQ_INIT(&cb.textq);
+        for (i = start; i <= end;) {
+                for (n = 0; i <= end && n < G_NLINES; ++i) {
+                        if (!bit_test(bits, i - start))
+                                continue;
+                        if (cut_line(sp, i, 0, CUT_LINE_TO_EOL, &cb)) {
+                                rval = 1;
+                                goto err;
+                        }
+                        ++n;
+                }
+                if (n == 0)
+                        break;
+                cb.flags |= CB_LMODE;
+
+                tm.cno = 0;
+                if (db_last(sp, &tm.lno) || put(sp, &cb, NULL, &tm, &m, 1)) {
+                        rval = 1;
+                        goto err;
+                }
+                text_lfree(&cb.textq);
+                cb.len = 0;
+
+                /* Copy puts the cursor on the last line copied. */
+                sp->lno = m.lno + (n - 1);
+                sp->cno = 0;
+
+                if (INTERRUPTED(sp))
+                        break;
+        }
+err:    text_lfree(&cb.textq);
+        return (rval);
+}
+
+/*
+ * ex_g_delete --
+ *      Delete the marked lines, ":g/RE/d".
+ */
+static int
+ex_g_delete(SCR *sp, bitstr_t *bits, recno_t start, recno_t end)
+{
+        MARK fm, tm;
+        recno_t cnt, i, last;
+
+        for (cnt = 0, last = OOBLNO, i = start; i <= end; ++i)
+                if (bit_test(bits, i - start)) {
+                        ++cnt;
+                        last = i;
+                }
+        if (cnt == 0)
+                return (0);
+
+        /*
+         * Each line was cut into the default buffer before it was deleted,
+         * leaving the last line in the buffer.
+         */
+        fm.lno = tm.lno = last;
+        fm.cno = tm.cno = 0;
+        if (cut(sp, NULL, &fm, &tm, CUT_LINEMODE))
+                return (1);
+
+        /* Delete the runs of lines, last first, so the others don't move. */
+        for (i = end + 1; i > start;) {
+                if (!bit_test(bits, i - 1 - start)) {
+                        --i;
+                        continue;
+                }
+                for (tm.lno = i - 1;
+                    i > start && bit_test(bits, i - 1 - start); --i);
+                fm.lno = i;
+                if (del(sp, &fm, &tm, 1))
+                        return (1);
+                if (INTERRUPTED(sp))
+                        break;
+        }
+
+        /* The cursor is on the line after the last line deleted. */
+        return (ex_g_cursor(sp, last - (cnt - 1)));
+}
+
+/*
+ * ex_g_move --
+ *      Move the marked lines to the start of the file, ":g/RE/m0", which
+ *      reverses their order.
+ */
+static int
+ex_g_move(SCR *sp, bitstr_t *bits, recno_t start, recno_t end)
+{
+        DBT lines[G_NLINES], tl;
+        recno_t i, last, lno[G_NLINES], n, lo, hi;
+        size_t blen, len, off;
+        char *bp, *p;
+
+        GET_SPACE_RET(sp, bp, blen, 256);
+
+        /*
+         * Move the lines, a batch at a time.  Each batch is added to the
+         * start of the file, the last line first, and then the originals
+         * are deleted.  The lines after the batch don't change position.
+         */
+        for (i = start, last = OOBLNO; i <= end;) {
+                for (off = 0, n = 0; i <= end && n < G_NLINES; ++i) {
+                        if (!bit_test(bits, i - start))
+                                continue;
+                        if (db_get(sp, i, DBG_FATAL, &p, &len))
+                                goto err;
+                        BINC_GOTO(sp, bp, blen, off + len);
+                        memcpy(bp + off, p, len);
+                        lines[n].size = len;
+                        lno[n++] = i;
+                        off += len;
+                }
+                if (n == 0)
+                        break;
+                for (p = bp, hi = 0; hi < n; p += lines[hi].size, ++hi)
+                        lines[hi].data = p;
+                for (lo = 0, hi = n - 1; lo < hi; ++lo, --hi) {
+                        tl = lines[lo];
+                        lines[lo] = lines[hi];
+                        lines[hi] = tl;
+                }
+                if (db_append_range(sp, 1, 0, lines, n))
+                        goto err;
+
+                for (hi = n; hi > 0;) {
+                        for (lo = --hi; lo > 0 && lno[lo - 1] == lno[lo] - 1;)
+                                --lo;
+                        if (db_delete_range(sp,
+                            lno[lo] + n, lno[hi] - lno[lo] + 1))
+                                goto err;
+                        hi = lo;
+                }
+                sp->rptlines[L_MOVED] += n;
+                last = lno[n - 1];
+
+                if (INTERRUPTED(sp))
+                        break;
+        }
+        FREE_SPACE(sp, bp, blen);
+
+        /* Each move left the cursor on the line after the moved line. */
+        return (last == OOBLNO ? 0 : ex_g_cursor(sp, last + 1));
+
+alloc_err:
+err:    FREE_SPACE(sp, bp, blen);
+        return (1);
+}
+
+/*
+ * ex_g_subst --
+ *      Substitute on the marked lines, a run of lines at a time.
+ */
+static int
+ex_g_subst(SCR *sp, bitstr_t *bits,
+    recno_t start, recno_t end, CHAR_T *p, size_t len)
+{
+        ARGS a, *argv[2];
+        EXCMD cmd;
+        recno_t i, last;
+        size_t blen;
+        int rval;
+        char *bp;
+
+        /* The substitute command's argument follows the 's'. */
+        for (; isblank(*p); ++p, --len);
+        ++p;
+        --len;
+
+        GET_SPACE_RET(sp, bp, blen, len + 1);
+        memset(&cmd, 0, sizeof(EXCMD));
+        cmd.cmd = &cmds[C_SUBSTITUTE];
+        cmd.addrcnt = 2;
+        cmd.argc = 1;
+        cmd.argv = argv;
+        argv[0] = &a;
+        argv[1] = NULL;
+
+        F_SET(sp, SC_EX_GLOBAL);
+        for (rval = 0, last = OOBLNO, i = start; i <= end;) {
+                if (!bit_test(bits, i - start)) {
+                        ++i;
+                        continue;
+                }
+                for (cmd.addr1.lno = i;
+                    i <= end && bit_test(bits, i - start); ++i);
+                cmd.addr2.lno = last = i - 1;
+
+                /* The parser steps on the argument, use a new copy. */
+                memcpy(bp, p, len);
+                bp[len] = '\0';
+                a.bp = bp;
+                a.len = len;
+                sp->lno = cmd.addr1.lno;
+                if (ex_s(sp, &cmd)) {
+                        rval = 1;
+                        break;
+                }
+                if (INTERRUPTED(sp))
+                        break;
+        }
+        F_CLR(sp, SC_EX_GLOBAL);
+        FREE_SPACE(sp, bp, blen);
+
+        /* The cursor is on the line the last command was run on. */
+        return (rval || last == OOBLNO ? rval : ex_g_cursor(sp, last));
+}
+
+/*
+ * ex_g_cursor --
+ *      Set the cursor after a global command, as if it had been run a
+ *      line at a time.
+ */
+static int
+ex_g_cursor(SCR *sp, recno_t lno)
+{
+        if (db_exist(sp, lno))
+                sp->lno = lno;
+        else {
+                if (db_last(sp, &sp->lno))
+                        return (1);
+                if (sp->lno == 0)
+                        sp->lno = 1;
+        }
+        return (0);
+}
 /*
  * ex_g_insdel --
- *      Update the ranges based on an insertion or deletion.
+ *      Update the ranges based on an insertion or deletion of cnt lines.
  *
- * PUBLIC: int ex_g_insdel(SCR *, lnop_t, recno_t);
+ * PUBLIC: int ex_g_insdel(SCR *, lnop_t, recno_t, recno_t);
  */
 int
-ex_g_insdel(SCR *sp, lnop_t op, recno_t lno)
+ex_g_insdel(SCR *sp, lnop_t op, recno_t lno, recno_t cnt)
 {
         EXCMD *ecp;
         RANGE *nrp, *rp;
+        recno_t last;
 
         /* All insert/append operations are done as inserts. */
         if (op == LINE_APPEND)
@@ -262,6 +645,9 @@ ex_g_insdel(SCR *sp, lnop_t op, recno_t lno)
         if (op == LINE_RESET)
                 return (0);
 
+        /* The last deleted line. */
+        last = lno + cnt - 1;
+
         LIST_FOREACH(ecp, &sp->gp->ecq, q) {
                 if (!FL_ISSET(ecp->agv_flags, AGV_AT | AGV_GLOBAL | AGV_V))
                         continue;
@@ -273,35 +659,41 @@ ex_g_insdel(SCR *sp, lnop_t op, recno_t lno)
                                 continue;
 
                         /*
-                         * If range greater than the line, decrement or
+                         * If range greater than the lines, decrement or
                          * increment the range.
                          */
-                        if (rp->start > lno) {
+                        if (op == LINE_DELETE ? rp->start > last :
+                            rp->start > lno) {
                                 if (op == LINE_DELETE) {
-                                        --rp->start;
-                                        --rp->stop;
+                                        rp->start -= cnt;
+                                        rp->stop -= cnt;
                                 } else {
-                                        ++rp->start;
-                                        ++rp->stop;
+                                        rp->start += cnt;
+                                        rp->stop += cnt;
                                 }
                                 continue;
                         }
 
                         /*
-                         * Lno is inside the range, decrement the end point
-                         * for deletion, and split the range for insertion.
-                         * In the latter case, since we're inserting a new
-                         * element, neither range can be exhausted.
+                         * The lines overlap the range.  For deletion, drop
+                         * the deleted lines from the range, for insertion,
+                         * split the range.  In the latter case, since we're
+                         * inserting new elements, neither range can be
+                         * exhausted.
                          */
                         if (op == LINE_DELETE) {
-                                if (rp->start > --rp->stop) {
+                                if (rp->start > lno)
+                                        rp->start = lno;
+                                rp->stop -= (rp->stop < last ?
+                                    rp->stop : last) - lno + 1;
+                                if (rp->start > rp->stop) {
                                         TAILQ_REMOVE(&ecp->rq, rp, q);
                                         free(rp);
                                 }
                         } else {
                                 CALLOC_RET(sp, nrp, 1, sizeof(RANGE));
-                                nrp->start = lno + 1;
-                                nrp->stop = rp->stop + 1;
+                                nrp->start = lno + cnt;
+                                nrp->stop = rp->stop + cnt;
                                 rp->stop = lno - 1;
                                 TAILQ_INSERT_AFTER(&ecp->rq, rp, nrp, q);
                                 rp = nrp;
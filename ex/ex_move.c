@@ -23,6 +23,9 @@
 
 #include "../common/common.h"
 
+/* Lines are moved in batches of this many. */
+#define MOVE_NLINES     1024
+
 /*
  * ex_copy -- :[line [,line]] co[py] line [flags]
  *      Copy selected lines.
@@ -85,10 +88,11 @@ err:    text_lfree(&cb.textq);
 int
 ex_move(SCR *sp, EXCMD *cmdp)
 {
+        DBT lines[MOVE_NLINES];
         LMARK *lmp;
         MARK fm1, fm2;
-        recno_t cnt, diff, fl, tl, mfl, mtl;
-        size_t blen, len;
+        recno_t cnt, diff, fl, i, n, sfl, tl, mfl, mtl;
+        size_t blen, len, off;
         int mark_reset;
         char *bp, *p;
 
@@ -121,6 +125,7 @@ ex_move(SCR *sp, EXCMD *cmdp)
 
         /* Log the old positions of the marks. */
         mark_reset = 0;
+        mark_sync(sp->ep);
         LIST_FOREACH(lmp, &sp->ep->marks, q)
                 if (lmp->name != ABSMARK1 &&
                     lmp->lno >= fl && lmp->lno <= tl) {
@@ -132,44 +137,50 @@ ex_move(SCR *sp, EXCMD *cmdp)
         /* Get memory for the copy. */
         GET_SPACE_RET(sp, bp, blen, 256);
 
-        /* Move the lines. */
+        /*
+         * Move the lines, a batch at a time.  Each batch is appended after
+         * the destination, the marks in the source lines are moved to the
+         * copies, and then the source lines are deleted.
+         */
         diff = (fm2.lno - fm1.lno) + 1;
         if (tl > fl) {                          /* Destination > source. */
                 mfl = tl - diff;
                 mtl = tl;
-                for (cnt = diff; cnt--;) {
-                        if (db_get(sp, fl, DBG_FATAL, &p, &len))
-                                return (1);
-                        BINC_RET(sp, bp, blen, len);
-                        memcpy(bp, p, len);
-                        if (db_append(sp, 1, tl, bp, len))
-                                return (1);
-                        if (mark_reset)
-                                LIST_FOREACH(lmp, &sp->ep->marks, q)
-                                        if (lmp->name != ABSMARK1 &&
-                                            lmp->lno == fl)
-                                                lmp->lno = tl + 1;
-                        if (db_delete(sp, fl))
-                                return (1);
-                }
         } else {                                /* Destination < source. */
                 mfl = tl;
                 mtl = tl + diff;
-                for (cnt = diff; cnt--;) {
-                        if (db_get(sp, fl, DBG_FATAL, &p, &len))
-                                return (1);
-                        BINC_RET(sp, bp, blen, len);
-                        memcpy(bp, p, len);
-                        if (db_append(sp, 1, tl++, bp, len))
-                                return (1);
-                        if (mark_reset)
-                                LIST_FOREACH(lmp, &sp->ep->marks, q)
-                                        if (lmp->name != ABSMARK1 &&
-                                            lmp->lno == fl)
-                                                lmp->lno = tl;
-                        ++fl;
-                        if (db_delete(sp, fl))
+        }
+        for (cnt = diff; cnt > 0; cnt -= n) {
+                n = cnt > MOVE_NLINES ? MOVE_NLINES : cnt;
+
+                /* Copy the lines, they're lost when the file changes. */
+                for (off = 0, i = 0; i < n; ++i) {
+                        if (db_get(sp, fl + i, DBG_FATAL, &p, &len))
                                 return (1);
+                        BINC_RET(sp, bp, blen, off + len);
+                        memcpy(bp + off, p, len);
+                        lines[i].size = len;
+                        off += len;
+                }
+                for (p = bp, i = 0; i < n; p += lines[i].size, ++i)
+                        lines[i].data = p;
+                if (db_append_range(sp, 1, tl, lines, n))
+                        return (1);
+
+                /* The source lines follow the copies if they were before. */
+                sfl = tl > fl ? fl : fl + n;
+                if (mark_reset) {
+                        mark_sync(sp->ep);
+                        LIST_FOREACH(lmp, &sp->ep->marks, q)
+                                if (lmp->name != ABSMARK1 &&
+                                    lmp->lno >= sfl && lmp->lno - sfl < n)
+                                        lmp->lno = lmp->lno - sfl + tl + 1;
+                }
+                if (db_delete_range(sp, sfl, n))
+                        return (1);
+                if (tl < fl) {
+                        tl += n;
+                        fl += n;
                 }
         }
         FREE_SPACE(sp, bp, blen);
@@ -178,11 +189,13 @@ ex_move(SCR *sp, EXCMD *cmdp)
         sp->cno = 0;
 
         /* Log the new positions of the marks. */
-        if (mark_reset)
+        if (mark_reset) {
+                mark_sync(sp->ep);
                 LIST_FOREACH(lmp, &sp->ep->marks, q)
                         if (lmp->name != ABSMARK1 &&
                             lmp->lno >= mfl && lmp->lno <= mtl)
                                 (void)log_mark(sp, lmp);
+        }
 
         sp->rptlines[L_MOVED] += diff;
         return (0);
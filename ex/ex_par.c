@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Copyright (c) 2022-2023 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * See the LICENSE.md file for redistribution information.
+ */
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <bitstring.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <bsd_stdlib.h>
+#include <bsd_string.h>
+#include <bsd_unistd.h>
+
+#include "../common/common.h"
+#include "par.h"
+
+/*
+ * Commands that work on a large range of lines can spread the work over
+ * threads.  The lines are read into a private buffer a batch at a time,
+ * and each thread works on a slice of the batch.  The threads can't touch
+ * the screen or the file, so the command does anything that does, for
+ * the whole batch, once the threads are done.
+ */
+
+/*
+ * ex_par_nthreads --
+ *      Return the number of threads to use for a range of lines.
+ *
+ * PUBLIC: int ex_par_nthreads(recno_t);
+ */
+int
+ex_par_nthreads(recno_t nlines)
+{
+        long ncpu;
+
+        if (nlines < PAR_LINES ||
+            (ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+                return (1);
+        return (ncpu > PAR_MAXTHREADS ? PAR_MAXTHREADS : (int)ncpu);
+}
+
+/*
+ * ex_par_init --
+ *      Set up for batches worked on by a number of threads.
+ *
+ * PUBLIC: int ex_par_init(SCR *, PAR *, int);
+ */
+int
+ex_par_init(SCR *sp, PAR *par, int nthreads)
+{
+        memset(par, 0, sizeof(PAR));
+        par->nthreads = nthreads;
+        CALLOC_RET(sp, par->ioff, nthreads * PAR_SLICE + 1, sizeof(size_t));
+        return (0);
+}
+
+/*
+ * ex_par_read --
+ *      Read the next batch, starting at line lno and ending at or before
+ *      line elno.
+ *
+ * PUBLIC: int ex_par_read(SCR *, PAR *, recno_t, recno_t);
+ */
+int
+ex_par_read(SCR *sp, PAR *par, recno_t lno, recno_t elno)
+{
+        DBT lines[PAR_NLINES];
+        recno_t first, vcnt;
+        size_t blen, i, j, n;
+        void *p;
+
+        n = elno - lno + 1;
+        if (n > (size_t)par->nthreads * PAR_SLICE)
+                n = par->nthreads * PAR_SLICE;
+        par->lno = lno;
+        par->n = 0;
+        for (blen = i = 0; i < n; i += vcnt) {
+                vcnt = n - i < PAR_NLINES ? n - i : PAR_NLINES;
+                if (db_getv(sp, lno + i, FORWARD, lines, &first, &vcnt))
+                        return (1);
+                for (j = 0; j < vcnt; ++j) {
+                        if (blen + lines[j].size > par->ilen) {
+                                if ((p = binc(sp, par->ib,
+                                    &par->ilen, blen + lines[j].size)) == NULL) {
+                                        par->ib = NULL;
+                                        return (1);
+                                }
+                                par->ib = p;
+                        }
+                        memcpy(par->ib + blen, lines[j].data, lines[j].size);
+                        par->ioff[i + j] = blen;
+                        blen += lines[j].size;
+                }
+        }
+        par->ioff[n] = blen;
+        par->n = n;
+        return (0);
+}
+
+/*
+ * ex_par_run --
+ *      Work on the batch: split it into a slice for each thread, and call
+ *      func for each slice.  The thread structures are in an array of
+ *      PAR_MAXTHREADS elements of size bytes, each starting with a PARTHR.
+ *      Return the number of slices.
+ *
+ * PUBLIC: int ex_par_run(PAR *, void *, size_t, void *(*)(void *));
+ */
+int
+ex_par_run(PAR *par, void *thr, size_t size, void *(*func)(void *))
+{
+        PARTHR *tp;
+        size_t i, slice;
+        int nt, t;
+
+        /*
+         * Start a thread for each slice but the first, which we do
+         * ourselves.  If a thread can't be started, do its slice
+         * ourselves, too.
+         */
+        slice = (par->n + par->nthreads - 1) / par->nthreads;
+        for (nt = 0, i = 0; i < par->n; ++nt, i += slice) {
+                tp = (PARTHR *)((char *)thr + nt * size);
+                tp->par = par;
+                tp->first = i;
+                tp->cnt = slice < par->n - i ? slice : par->n - i;
+                tp->done = 0;
+                tp->eval = tp->err = 0;
+                tp->started = nt != 0 &&
+                    pthread_create(&tp->tid, NULL, func, tp) == 0;
+        }
+        for (t = 0; t < nt; ++t) {
+                tp = (PARTHR *)((char *)thr + t * size);
+                if (!tp->started)
+                        (void)func(tp);
+        }
+        for (t = 0; t < nt; ++t) {
+                tp = (PARTHR *)((char *)thr + t * size);
+                if (tp->started)
+                        (void)pthread_join(tp->tid, NULL);
+        }
+        return (nt);
+}
+
+/*
+ * ex_par_err --
+ *      Report why a thread stopped before the end of its slice, if it did.
+ *
+ * PUBLIC: int ex_par_err(SCR *, PARTHR *, regex_t *);
+ */
+int
+ex_par_err(SCR *sp, PARTHR *tp, regex_t *re)
+{
+        if (tp->done == tp->cnt)
+                return (0);
+        if (tp->eval == 0) {
+                errno = tp->err;
+                msgq(sp, M_SYSERR, NULL);
+        } else
+                re_error(sp, tp->eval, re);
+        return (1);
+}
+
+/*
+ * ex_par_end --
+ *      Discard the batch.
+ *
+ * PUBLIC: void ex_par_end(PAR *);
+ */
+void
+ex_par_end(PAR *par)
+{
+        free(par->ib);
+        free(par->ioff);
+}
@@ -32,6 +32,12 @@
 
 #undef open
 
+static int      ex_readlines(SCR *, recno_t, char *, DBT *, recno_t);
+
+/* Lines read are appended to the file in batches of this many or size. */
+#define READ_NLINES     1024
+#define READ_BSIZE      (64 * 1024)
+
 /*
  * ex_read --   :read [file]
  *              :read [!cmd]
@@ -299,25 +305,31 @@ int
 ex_readfp(SCR *sp, char *name, FILE *fp, MARK *fm, recno_t *nlinesp,
     int silent)
 {
+        DBT lines[READ_NLINES];
         EX_PRIVATE *exp;
         GS *gp;
-        recno_t lcnt, lno;
-        size_t len;
+        recno_t lcnt, lno, n;
+        size_t blen, boff, len;
         unsigned long ccnt;                    /* XXX: can't print off_t portably. */
         int nf, rval;
-        char *p;
+        char *bp, *p;
 
         gp = sp->gp;
         exp = EXP(sp);
+        bp = NULL;
+        blen = 0;
 
         /*
          * Add in the lines from the output.  Insertion starts at the line
-         * following the address.
+         * following the address.  The lines are collected in a buffer and
+         * appended to the file a batch at a time.
          */
         ccnt = 0;
         lcnt = 0;
         p = "Reading...";
-        for (lno = fm->lno; !ex_getline(sp, fp, &len); ++lno, ++lcnt) {
+        for (lno = fm->lno, boff = 0, n = 0;; ++lcnt) {
+                if (ex_getline(sp, fp, &len))
+                        break;
                 if ((lcnt + 1) % INTERRUPT_CHECK == 0) {
                         if (INTERRUPTED(sp))
                                 break;
@@ -327,10 +339,20 @@ ex_readfp(SCR *sp, char *name, FILE *fp, MARK *fm, recno_t *nlinesp,
                                 p = NULL;
                         }
                 }
-                if (db_append(sp, 1, lno, exp->ibp, len))
-                        goto err;
+                if (n == READ_NLINES || (n != 0 && boff + len > READ_BSIZE)) {
+                        if (ex_readlines(sp, lno, bp, lines, n))
+                                goto err;
+                        lno += n;
+                        boff = n = 0;
+                }
+                BINC_GOTO(sp, bp, blen, boff + len);
+                memcpy(bp + boff, exp->ibp, len);
+                lines[n++].size = len;
+                boff += len;
                 ccnt += len;
         }
+        if (n != 0 && ex_readlines(sp, lno, bp, lines, n))
+                goto err;
 
         if (ferror(fp) || fclose(fp))
                 goto err;
@@ -349,12 +371,28 @@ ex_readfp(SCR *sp, char *name, FILE *fp, MARK *fm, recno_t *nlinesp,
 
         rval = 0;
         if (0) {
+alloc_err:
 err:            msgq_str(sp, M_SYSERR, name, "%s");
                 (void)fclose(fp);
                 rval = 1;
         }
 
+        free(bp);
         if (!silent)
                 gp->scr_busy(sp, NULL, BUSY_OFF);
         return (rval);
 }
+
+/*
+ * ex_readlines --
+ *      Append a batch of lines that were read into a buffer.
+ */
+static int
+ex_readlines(SCR *sp, recno_t lno, char *bp, DBT *lines, recno_t cnt)
+{
+        recno_t n;
+
+        for (n = 0; n < cnt; bp += lines[n].size, ++n)
+                lines[n].data = bp;
+        return (db_append_range(sp, 1, lno, lines, cnt));
+}
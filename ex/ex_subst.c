@@ -19,6 +19,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <bsd_stdlib.h>
 #include <bsd_string.h>
@@ -26,16 +27,66 @@
 
 #include "../common/common.h"
 #include "../vi/vi.h"
+#include "par.h"
 
 #define MAXIMUM(a, b)   (((a) > (b)) ? (a) : (b))
 
 #define SUB_FIRST       0x01            /* The 'r' flag isn't reasonable. */
 #define SUB_MUSTSETR    0x02            /* The 'r' flag is required.      */
 
+/*
+ * Substitute thread state and per-line results; see s_par().
+ */
+typedef struct _subline {
+        size_t   off;                   /* Replacement offset in lb. */
+        size_t   len;                   /* Replacement length. */
+        size_t   nl;                    /* First newline offset in newl. */
+        size_t   nlcnt;                 /* Newlines in the replacement. */
+        size_t   cno;                   /* Last change cursor. */
+        int      changed;               /* If the line changed. */
+} SUBLINE;
+
+typedef struct _subthr {
+        PARTHR   pt;                    /* Slice of the batch. */
+        SCR     *sp;                    /* Screen, read-only. */
+        regex_t *re;                    /* RE, read-only. */
+        SUBLINE *ln;                    /* Batch line results. */
+        char    *lb;                    /* Build buffer. */
+        size_t   lbclen;                /* Build buffer length used. */
+        size_t   lblen;                 /* Build buffer length. */
+        size_t  *newl;                  /* Newline offsets. */
+        size_t   newl_cnt;              /* Newline offsets used. */
+        size_t   newl_len;              /* Newline offsets length. */
+} SUBTHR;
+
+/*
+ * Compiled RE's are kept in a cache shared by the screens, keyed by the
+ * converted pattern and the regcomp(3) flags, which between them cover the
+ * magic, extended, ignorecase and iclower options and tag patterns.  The
+ * screens' search and substitute RE's are copies of cache entries.  Up to
+ * RE_CACHE_MAX entries not used by any screen are kept.
+ */
+#define RE_CACHE_MAX    16              /* Unused RE's kept. */
+
+struct _recache {
+        TAILQ_ENTRY(_recache) q;        /* Most recently used first. */
+        char    *ptrn;                  /* Converted pattern. */
+        size_t   plen;                  /* Converted pattern length. */
+        int      reflags;               /* Regcomp flags. */
+        int      refcnt;                /* Screen RE's using it. */
+        regex_t  re;                    /* Compiled RE. */
+};
+
+static int re_cache(SCR *, char *, size_t, int, regex_t *);
 static int re_conv(SCR *, char **, size_t *, int *);
-static int re_sub(SCR *, char *, char **, size_t *, size_t *, regmatch_t [10]);
+static int re_sub(SCR *, char *,
+    char **, size_t *, size_t *, size_t **, size_t *, size_t *, regmatch_t [10]);
 static int re_tag_conv(SCR *, char **, size_t *, int *);
 static int s(SCR *, EXCMD *, char *, regex_t *, unsigned int);
+static int s_build(SUBTHR *, char *, size_t);
+static int s_line(SUBTHR *, SUBLINE *, char *, size_t);
+static int s_par(SCR *, EXCMD *, regex_t *, int, int, int, int, int *);
+static void *s_thread(void *);
 
 /*
  * ex_s --
@@ -147,7 +198,8 @@ subagain:       return (ex_subagain(sp, cmdp));
                  * Compile the RE.  Historic practice is that substitutes set
                  * the search direction as well as both substitute and search
                  * RE's.  We compile the RE twice, as we don't want to bother
-                 * ref counting the pattern string and (opaque) structure.
+                 * ref counting the pattern string; the second compile finds
+                 * the RE in the cache.
                  */
                 if (re_compile(sp, ptrn, t - ptrn,
                     &sp->re, &sp->re_len, &sp->re_c, RE_C_SEARCH))
@@ -297,17 +349,6 @@ ex_subtilde(SCR *sp, EXCMD *cmdp)
  * when the replacement is done.  Don't change it unless you're *damned*
  * confident.
  */
-#define NEEDNEWLINE(sp) {                                               \
-        if ((sp)->newl_len == (sp)->newl_cnt) {                         \
-                (sp)->newl_len += 25;                                   \
-                REALLOCARRAY((sp), (sp)->newl,                          \
-                    (sp)->newl_len, sizeof(size_t));                    \
-                if ((sp)->newl == NULL) {                               \
-                        (sp)->newl_len = 0;                             \
-                        return (1);                                     \
-                }                                                       \
-        }                                                               \
-}
 
 #define BUILD(sp, l, len) {                                             \
         if (lbclen + (len) > lblen) {                                   \
@@ -322,17 +363,6 @@ ex_subtilde(SCR *sp, EXCMD *cmdp)
         lbclen += (len);                                                \
 }
 
-#define NEEDSP(sp, len, pnt) {                                          \
-        if (lbclen + (len) > lblen) {                                   \
-                lblen += MAXIMUM(lbclen + (len), 256);                  \
-                REALLOC((sp), lb, lblen);                               \
-                if (lb == NULL) {                                       \
-                        lbclen = 0;                                     \
-                        return (1);                                     \
-                }                                                       \
-                (pnt) = lb + lbclen;                                    \
-        }                                                               \
-}
 
 static int
 s(SCR *sp, EXCMD *cmdp, char *s, regex_t *re, unsigned int flags)
@@ -346,7 +376,7 @@ s(SCR *sp, EXCMD *cmdp, char *s, regex_t *re, unsigned int flags)
         size_t offset, saved_offset, scno;
         int lflag, nflag, pflag, rflag;
         int didsub, do_eol_match, eflags, nempty, eval;
-        int linechanged, matched, quit, rval;
+        int linechanged, matched, nthreads, quit, rval;
         unsigned long ul;
         char *bp, *lb;
 
@@ -482,6 +512,17 @@ noargs: if (F_ISSET(sp, SC_VI) && sp->c_suffix && (lflag || nflag || pflag)) {
         bp = lb = NULL;
         blen = lbclen = lblen = 0;
 
+        /* Without confirmation, substitute over large ranges in parallel. */
+        matched = 0;
+        if (!sp->c_suffix &&
+            (nthreads = ex_par_nthreads(
+            cmdp->addr2.lno - cmdp->addr1.lno + 1)) > 1) {
+                if (s_par(sp, cmdp, re,
+                    nthreads, lflag, nflag, pflag, &matched))
+                        goto err;
+                goto done;
+        }
+
         /* For each line... */
         for (matched = quit = 0, lno = cmdp->addr1.lno,
             elno = cmdp->addr2.lno; !quit && lno <= elno; ++lno) {
@@ -678,8 +719,11 @@ lquit:                          quit = 1;
 
                 /* Substitute the matching bytes. */
                 didsub = 1;
-                if (re_sub(sp, s, &lb, &lbclen, &lblen, match))
+                if (re_sub(sp, s, &lb, &lbclen, &lblen,
+                    &sp->newl, &sp->newl_cnt, &sp->newl_len, match)) {
+                        msgq(sp, M_SYSERR, NULL);
                         goto err;
+                }
 
                 /* Set the change flag so we know this line was modified. */
                 linechanged = 1;
@@ -819,7 +863,7 @@ endmatch:       if (!linechanged)
                 }
         }
 
-        /*
+done:   /*
          * !!!
          * Historically, vi attempted to leave the cursor at the same place if
          * the substitution was done at the current cursor position.  Otherwise
@@ -863,6 +907,250 @@ err:            rval = 1;
         return (rval);
 }
 
+/*
+ * s_par --
+ *      Substitute without confirmation over a large range, in parallel.
+ *
+ *      Each thread matches and builds the replacements for a slice of the
+ *      batch, and the changed lines are then stored in order, by this
+ *      thread, so the log, marks, report counts and cursor are as if done
+ *      serially.
+ */
+static int
+s_par(SCR *sp, EXCMD *cmdp, regex_t *re,
+    int nthreads, int lflag, int nflag, int pflag, int *matchedp)
+{
+        MARK from, to;
+        PAR par;
+        SUBLINE *lp, *ln;
+        SUBTHR thr[PAR_MAXTHREADS], *tp;
+        recno_t elno, lno;
+        size_t cnt, i, last, len;
+        int nt, rval, t;
+        char *p;
+
+        memset(thr, 0, sizeof(thr));
+        rval = 1;
+        ln = NULL;
+        if (ex_par_init(sp, &par, nthreads))
+                goto err;
+        CALLOC(sp, ln, nthreads * PAR_SLICE, sizeof(SUBLINE));
+        if (ln == NULL)
+                goto err;
+
+        for (lno = cmdp->addr1.lno, elno = cmdp->addr2.lno; lno <= elno;) {
+                /* Someone's unhappy, time to stop. */
+                if (INTERRUPTED(sp))
+                        break;
+
+                if (ex_par_read(sp, &par, lno, elno))
+                        goto err;
+                for (t = 0; t < PAR_MAXTHREADS; ++t) {
+                        thr[t].sp = sp;
+                        thr[t].re = re;
+                        thr[t].ln = ln;
+                }
+                nt = ex_par_run(&par, thr, sizeof(SUBTHR), s_thread);
+
+                /* Store the changed lines, in order. */
+                for (t = 0; t < nt; ++t) {
+                        tp = &thr[t];
+                        for (i = tp->pt.first;
+                            i < tp->pt.first + tp->pt.done; ++i, ++lno) {
+                                lp = &ln[i];
+                                if (!lp->changed)
+                                        continue;
+                                *matchedp = 1;
+
+                                /*
+                                 * Set the cursor to the last position
+                                 * changed.
+                                 */
+                                sp->lno = lno;
+                                sp->cno = lp->cno;
+
+                                /* Store inserted lines. */
+                                p = tp->lb + lp->off;
+                                last = 0;
+                                for (cnt = 0;
+                                    cnt < lp->nlcnt; ++cnt, ++lno, ++elno) {
+                                        len = tp->newl[lp->nl + cnt] - lp->off;
+                                        if (db_insert(sp,
+                                            lno, p + last, len - last))
+                                                goto err;
+                                        last = len + 1;
+                                        ++sp->rptlines[L_ADDED];
+                                }
+
+                                /* Store the changed line. */
+                                if (db_set(sp, lno, p + last, lp->len - last))
+                                        goto err;
+
+                                /* Update changed line counter. */
+                                if (sp->rptlchange != lno) {
+                                        sp->rptlchange = lno;
+                                        ++sp->rptlines[L_CHANGED];
+                                }
+
+                                /* Display as necessary. */
+                                if (lflag || nflag || pflag) {
+                                        from.lno = to.lno = lno;
+                                        from.cno = to.cno = 0;
+                                        if (lflag)
+                                                (void)ex_print(sp,
+                                                    cmdp, &from, &to, E_C_LIST);
+                                        if (nflag)
+                                                (void)ex_print(sp,
+                                                    cmdp, &from, &to, E_C_HASH);
+                                        if (pflag)
+                                                (void)ex_print(sp,
+                                                    cmdp, &from, &to, E_C_PRINT);
+                                }
+                        }
+
+                        /* The thread stopped early on an error. */
+                        if (ex_par_err(sp, &tp->pt, re))
+                                goto err;
+                }
+        }
+        rval = 0;
+
+err:    for (t = 0; t < PAR_MAXTHREADS; ++t) {
+                free(thr[t].lb);
+                free(thr[t].newl);
+        }
+        ex_par_end(&par);
+        free(ln);
+        return (rval);
+}
+
+/*
+ * s_thread --
+ *      Substitute thread: match and build the replacements for a slice
+ *      of the batch.
+ */
+static void *
+s_thread(void *arg)
+{
+        SUBTHR *tp;
+        PAR *par;
+        size_t i;
+
+        tp = arg;
+        par = tp->pt.par;
+        tp->lbclen = tp->newl_cnt = 0;
+        for (i = tp->pt.first; i < tp->pt.first + tp->pt.cnt; ++i)
+                if (s_line(tp,
+                    &tp->ln[i], PAR_LP(par, i), PAR_LEN(par, i)))
+                        break;
+        tp->pt.done = i - tp->pt.first;
+        return (NULL);
+}
+
+/*
+ * s_line --
+ *      Match and build the replacement for a line; the same as the loop
+ *      in s(), without confirmation.  Nothing here may touch the screen
+ *      or the file, it's called by the substitute threads.
+ */
+static int
+s_line(SUBTHR *tp, SUBLINE *lp, char *s, size_t llen)
+{
+        regmatch_t match[10];
+        size_t len, offset;
+        int do_eol_match, eflags, eval, nempty;
+
+        lp->off = tp->lbclen;
+        lp->nl = tp->newl_cnt;
+        lp->changed = 0;
+
+        offset = 0;
+        len = llen;
+        nempty = -1;
+        do_eol_match = 1;
+        eflags = REG_STARTEND;
+        for (;;) {
+                match[0].rm_so = offset;
+                match[0].rm_eo = llen;
+                eval = regexec(tp->re, s, 10, match, eflags);
+                if (eval == REG_NOMATCH)
+                        break;
+                if (eval != 0) {
+                        tp->pt.eval = eval;
+                        return (1);
+                }
+
+                /* Only the first search can match an anchored expression. */
+                eflags |= REG_NOTBOL;
+
+                /* Skip an empty match following the previous match. */
+                if (match[0].rm_so == nempty && match[0].rm_eo == nempty) {
+                        nempty = -1;
+                        if (len == 0)
+                                break;
+                        if (s_build(tp, s + offset, 1))
+                                goto nomem;
+                        ++offset;
+                        --len;
+                        continue;
+                }
+
+                /* Copy the bytes before the match, and substitute. */
+                lp->cno = match[0].rm_so;
+                if (s_build(tp, s + offset, match[0].rm_so - offset) ||
+                    re_sub(tp->sp, s, &tp->lb, &tp->lbclen, &tp->lblen,
+                    &tp->newl, &tp->newl_cnt, &tp->newl_len, match))
+                        goto nomem;
+                lp->changed = 1;
+
+                /* Move past the matched bytes. */
+                offset = match[0].rm_eo;
+                len = llen - match[0].rm_eo;
+                nempty = match[0].rm_eo;
+
+                if (!tp->sp->g_suffix || !do_eol_match)
+                        break;
+                if (len == 0) {
+                        do_eol_match = 0;
+                        eflags |= REG_NOTEOL;
+                }
+        }
+
+        if (!lp->changed)
+                return (0);
+
+        /* Copy any remaining bytes into the build buffer. */
+        if (len && s_build(tp, s + offset, len))
+                goto nomem;
+        lp->len = tp->lbclen - lp->off;
+        lp->nlcnt = tp->newl_cnt - lp->nl;
+        return (0);
+
+nomem:  tp->pt.err = errno;
+        return (1);
+}
+
+/*
+ * s_build --
+ *      Append bytes to a substitute thread's build buffer.
+ */
+static int
+s_build(SUBTHR *tp, char *p, size_t len)
+{
+        void *tmpp;
+
+        if (tp->lbclen + len > tp->lblen) {
+                if ((tmpp = realloc(tp->lb,
+                    tp->lblen + MAXIMUM(tp->lbclen + len, 256))) == NULL)
+                        return (1);
+                tp->lb = tmpp;
+                tp->lblen += MAXIMUM(tp->lbclen + len, 256);
+        }
+        memcpy(tp->lb + tp->lbclen, p, len);
+        tp->lbclen += len;
+        return (0);
+}
+
 /*
  * re_compile --
  *      Compile the RE.
@@ -896,11 +1184,11 @@ re_compile(SCR *sp, char *ptrn, size_t plen, char **ptrnp, size_t *lenp,
 
         /* If we're replacing a saved value, clear the old one. */
         if (LF_ISSET(RE_C_SEARCH) && F_ISSET(sp, SC_RE_SEARCH)) {
-                regfree(&sp->re_c);
+                re_free(sp, &sp->re_c);
                 F_CLR(sp, SC_RE_SEARCH);
         }
         if (LF_ISSET(RE_C_SUBST) && F_ISSET(sp, SC_RE_SUBST)) {
-                regfree(&sp->subre_c);
+                re_free(sp, &sp->subre_c);
                 F_CLR(sp, SC_RE_SUBST);
         }
 
@@ -951,20 +1239,121 @@ re_compile(SCR *sp, char *ptrn, size_t plen, char **ptrnp, size_t *lenp,
          * Regcomp isn't 8-bit clean, so we just lost if the pattern
          * contained a NULL.  Bummer!
          */
-        if ((rval = regcomp(rep, ptrn, /* plen, */ reflags)) != 0) {
+        if ((rval = re_cache(sp, ptrn, plen, reflags, rep)) != 0) {
                 if (!LF_ISSET(RE_C_SILENT))
                         re_error(sp, rval, rep);
                 return (1);
         }
 
-        if (LF_ISSET(RE_C_SEARCH))
+        if (LF_ISSET(RE_C_SEARCH)) {
                 F_SET(sp, SC_RE_SEARCH);
+                ++sp->re_gen;
+        }
         if (LF_ISSET(RE_C_SUBST))
                 F_SET(sp, SC_RE_SUBST);
 
         return (0);
 }
 
+/*
+ * re_cache --
+ *      Get a compiled RE from the cache, compiling it if it's not there.
+ */
+static int
+re_cache(SCR *sp, char *ptrn, size_t plen, int reflags, regex_t *rep)
+{
+        GS *gp;
+        RECACHE *rp;
+        int rval;
+
+        gp = sp->gp;
+        TAILQ_FOREACH(rp, &gp->recq, q)
+                if (rp->reflags == reflags &&
+                    rp->plen == plen && !memcmp(rp->ptrn, ptrn, plen))
+                        break;
+        if (rp != NULL) {
+                ++gp->re_hits;
+                TAILQ_REMOVE(&gp->recq, rp, q);
+        } else {
+                ++gp->re_misses;
+                if ((rp = calloc(1, sizeof(RECACHE))) == NULL)
+                        return (REG_ESPACE);
+                if ((rp->ptrn = malloc(plen + 1)) == NULL) {
+                        free(rp);
+                        return (REG_ESPACE);
+                }
+                memcpy(rp->ptrn, ptrn, plen);
+                rp->ptrn[plen] = '\0';
+                rp->plen = plen;
+                rp->reflags = reflags;
+                if ((rval = regcomp(&rp->re, ptrn, reflags)) != 0) {
+                        free(rp->ptrn);
+                        free(rp);
+                        return (rval);
+                }
+        }
+        TAILQ_INSERT_HEAD(&gp->recq, rp, q);
+        ++rp->refcnt;
+        *rep = rp->re;
+        return (0);
+}
+
+/*
+ * re_free --
+ *      Release a compiled RE.
+ *
+ * PUBLIC: void re_free(SCR *, regex_t *);
+ */
+void
+re_free(SCR *sp, regex_t *rep)
+{
+        GS *gp;
+        RECACHE *rp, *next;
+        int cnt;
+
+        gp = sp->gp;
+        TAILQ_FOREACH(rp, &gp->recq, q)
+                if (rp->re.re_g == rep->re_g)
+                        break;
+        if (rp == NULL) {
+                regfree(rep);
+                return;
+        }
+        if (--rp->refcnt != 0)
+                return;
+
+        /* Discard the least recently used RE's nothing is using. */
+        cnt = 0;
+        for (rp = TAILQ_FIRST(&gp->recq); rp != NULL; rp = next) {
+                next = TAILQ_NEXT(rp, q);
+                if (rp->refcnt != 0 || ++cnt <= RE_CACHE_MAX)
+                        continue;
+                TAILQ_REMOVE(&gp->recq, rp, q);
+                regfree(&rp->re);
+                free(rp->ptrn);
+                free(rp);
+        }
+}
+
+/*
+ * re_close --
+ *      Discard the compiled RE cache.
+ *
+ * PUBLIC: void re_close(GS *);
+ */
+void
+re_close(GS *gp)
+{
+        RECACHE *rp;
+
+        while ((rp = TAILQ_FIRST(&gp->recq)) != NULL) {
+                TAILQ_REMOVE(&gp->recq, rp, q);
+                regfree(&rp->re);
+                free(rp->ptrn);
+                free(rp);
+        }
+}
+
 /*
  * re_conv --
  *      Convert vi's regular expressions into something that the
@@ -1202,24 +1591,35 @@ re_error(SCR *sp, int errcode, regex_t *preg)
 /*
  * re_sub --
  *      Do the substitution for a regular expression.
+ *
+ *      The newline offsets are returned in the caller's array rather than
+ *      the screen's, so that substitute worker threads can call us, and we
+ *      don't report allocation failures, for the same reason.  Return 1 on
+ *      allocation failure, with errno set.
  */
 static int
 re_sub(SCR *sp, char *ip, char **lbp, size_t *lbclenp, size_t *lblenp,
-    regmatch_t match[10])
+    size_t **newlp, size_t *newl_cntp, size_t *newl_lenp, regmatch_t match[10])
 {
         enum { C_NOTSET, C_LOWER, C_ONELOWER, C_ONEUPPER, C_UPPER } conv;
         size_t lbclen, lblen;           /* Local copies. */
+        size_t newl_cnt, newl_len;      /* Local copies. */
         size_t mlen;                    /* Match length. */
         size_t rpl;                     /* Remaining replacement length. */
+        size_t *newl;                   /* Local copies. */
         char *rp;                       /* Replacement pointer. */
-        int ch;
+        int ch, rval;
         int no;                         /* Match replacement offset. */
         char *p, *t;                    /* Buffer pointers. */
         char *lb;                       /* Local copies. */
+        void *tmpp;
 
         lb = *lbp;                      /* Get local copies. */
         lbclen = *lbclenp;
         lblen = *lblenp;
+        newl = *newlp;
+        newl_cnt = *newl_cntp;
+        newl_len = *newl_lenp;
 
         /*
          * QUOTING NOTE:
@@ -1238,12 +1638,31 @@ re_sub(SCR *sp, char *ip, char **lbp, size_t *lbclenp, size_t *lblenp,
          * Otherwise, since this is the lowest level of replacement, discard
          * all escaping characters.  This (hopefully) matches historic practice.
          */
+#define NEEDNEWLINE {                                                   \
+        if (newl_len == newl_cnt) {                                     \
+                if ((tmpp = openbsd_reallocarray(newl,                  \
+                    newl_len + 25, sizeof(size_t))) == NULL)            \
+                        goto nomem;                                     \
+                newl = tmpp;                                            \
+                newl_len += 25;                                         \
+        }                                                               \
+}
+#define NEEDSP(len, pnt) {                                              \
+        if (lbclen + (len) > lblen) {                                   \
+                if ((tmpp = realloc(lb,                                 \
+                    lblen + MAXIMUM(lbclen + (len), 256))) == NULL)     \
+                        goto nomem;                                     \
+                lb = tmpp;                                              \
+                lblen += MAXIMUM(lbclen + (len), 256);                  \
+                (pnt) = lb + lbclen;                                    \
+        }                                                               \
+}
 #define OUTCH(ch, nltrans) {                                            \
         CHAR_T __ch = (ch);                                             \
         unsigned int __value = KEY_VAL(sp, __ch);                       \
         if ((nltrans) && (__value == K_CR || __value == K_NL)) {        \
-                NEEDNEWLINE(sp);                                        \
-                sp->newl[sp->newl_cnt++] = lbclen;                      \
+                NEEDNEWLINE;                                            \
+                newl[newl_cnt++] = lbclen;                              \
         } else if (conv != C_NOTSET) {                                  \
                 switch (conv) {                                         \
                 case C_ONELOWER:                                        \
@@ -1264,7 +1683,7 @@ re_sub(SCR *sp, char *ip, char **lbp, size_t *lbclenp, size_t *lblenp,
                         abort();                                        \
                 }                                                       \
         }                                                               \
-        NEEDSP(sp, 1, p);                                               \
+        NEEDSP(1, p);                                                   \
         *p++ = __ch;                                                    \
         ++lbclen;                                                       \
 }
@@ -1328,8 +1747,15 @@ subzero:                        if (match[no].rm_so == -1 ||
                 OUTCH(ch, 1);
         }
 
+        rval = 0;
+        if (0) {
+nomem:          rval = 1;
+        }
         *lbp = lb;                      /* Update caller's information. */
         *lbclenp = lbclen;
         *lblenp = lblen;
-        return (0);
+        *newlp = newl;
+        *newl_cntp = newl_cnt;
+        *newl_lenp = newl_len;
+        return (rval);
 }
@@ -15,6 +15,7 @@
 #include <sys/types.h>
 #include <sys/queue.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <bitstring.h>
 #include <ctype.h>
@@ -30,6 +31,10 @@
 
 enum which {WN, WQ, WRITE, XIT};
 static int exwr(SCR *, EXCMD *, enum which);
+static int ex_writev(int, struct iovec *, int);
+
+#define WBUFSIZE        (64 * 1024)     /* ex_writefd() buffer size. */
+#define WNLINES         256             /* ex_writefd() lines read at a time. */
 
 /*
  * ex_wn --     :wn[!] [>>] [file]
@@ -359,3 +364,148 @@ err:            if (!F_ISSET(sp->ep, F_MULTILOCK))
         }
         return (rval);
 }
+
+/*
+ * ex_writefd --
+ *      Write a range of lines to a file descriptor.
+ *
+ * Lines are gathered into a single buffer which is written when the next
+ * line doesn't fit, together with that line, in one writev(2) call.  The
+ * file descriptor is synced but not closed.
+ *
+ * PUBLIC: int ex_writefd(SCR *,
+ * PUBLIC:    char *, int, MARK *, MARK *, unsigned long *, unsigned long *, int);
+ */
+int
+ex_writefd(SCR *sp, char *name, int fd, MARK *fm, MARK *tm, unsigned long *nlno,
+    unsigned long *nch, int silent)
+{
+        static char nl = '\n';
+        struct iovec iov[3];
+        struct stat sb;
+        DBT lines[WNLINES];
+        GS *gp;
+        unsigned long ccnt;
+        recno_t cnt, first, fline, tline, lcnt;
+        size_t len, off;
+        int rval;
+        char *bp, *msg, *p;
+
+        gp = sp->gp;
+        fline = fm->lno;
+        tline = tm->lno;
+
+        if (nlno != NULL) {
+                *nch = 0;
+                *nlno = 0;
+        }
+
+        if ((bp = malloc(WBUFSIZE)) == NULL) {
+                msgq(sp, M_SYSERR, NULL);
+                return (1);
+        }
+
+        /* See ex_writefp() for the rules. */
+        ccnt = 0;
+        lcnt = 0;
+        off = 0;
+        msg = "Writing...";
+        if (tline != 0)
+                for (cnt = first = 0; fline <= tline; ++fline, ++lcnt) {
+                        /*
+                         * Caller has to provide any interrupt message.  The
+                         * lines read are only good until the next database
+                         * call, and checking for an interrupt may make one.
+                         */
+                        if ((lcnt + 1) % INTERRUPT_CHECK == 0) {
+                                cnt = 0;
+                                if (INTERRUPTED(sp))
+                                        break;
+                                if (!silent) {
+                                        gp->scr_busy(sp, msg, msg == NULL ?
+                                            BUSY_UPDATE : BUSY_ON);
+                                        msg = NULL;
+                                }
+                        }
+
+                        /* Read the lines a database page at a time. */
+                        if (fline < first || fline - first >= cnt) {
+                                cnt = WNLINES;
+                                if (db_getv(sp,
+                                    fline, FORWARD, lines, &first, &cnt))
+                                        goto err;
+                        }
+                        p = lines[fline - first].data;
+                        len = lines[fline - first].size;
+                        if (len < WBUFSIZE - off) {
+                                memcpy(bp + off, p, len);
+                                off += len;
+                                bp[off++] = '\n';
+                        } else {
+                                iov[0].iov_base = bp;
+                                iov[0].iov_len = off;
+                                iov[1].iov_base = p;
+                                iov[1].iov_len = len;
+                                iov[2].iov_base = &nl;
+                                iov[2].iov_len = 1;
+                                if (ex_writev(fd, iov, 3))
+                                        goto err;
+                                off = 0;
+                        }
+                        ccnt += len + 1;
+                }
+
+        if (off != 0) {
+                iov[0].iov_base = bp;
+                iov[0].iov_len = off;
+                if (ex_writev(fd, iov, 1))
+                        goto err;
+        }
+
+        /* See ex_writefp() for why we sync. */
+        if (!fstat(fd, &sb) && S_ISREG(sb.st_mode) && fsync(fd))
+                goto err;
+
+        rval = 0;
+        if (0) {
+err:            if (!F_ISSET(sp->ep, F_MULTILOCK))
+                        msgq_str(sp, M_SYSERR, name, "%s");
+                rval = 1;
+        }
+        free(bp);
+
+        if (!silent)
+                gp->scr_busy(sp, NULL, BUSY_OFF);
+
+        /* Report the possibly partial transfer. */
+        if (nlno != NULL) {
+                *nch = ccnt;
+                *nlno = lcnt;
+        }
+        return (rval);
+}
+
+/*
+ * ex_writev --
+ *      Write an iovec array, handling partial writes.
+ */
+static int
+ex_writev(int fd, struct iovec *iov, int cnt)
+{
+        ssize_t nw;
+
+        while (cnt > 0) {
+                if ((nw = writev(fd, iov, cnt)) == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        return (1);
+                }
+                for (; cnt > 0 && (size_t)nw >= iov->iov_len; ++iov, --cnt)
+                        nw -= iov->iov_len;
+                if (cnt > 0) {
+                        iov->iov_base = (char *)iov->iov_base + nw;
+                        iov->iov_len -= nw;
+                }
+        }
+        return (0);
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Copyright (c) 2022-2023 Jeffrey H. Johnson <trnsz@pobox.com>
+ *
+ * See the LICENSE.md file for redistribution information.
+ */
+
+#define PAR_LINES       4096            /* Lines before going parallel. */
+#define PAR_NLINES      256             /* Lines read at a time.        */
+#define PAR_SLICE       1024            /* Lines per thread per batch.  */
+#define PAR_MAXTHREADS  16              /* Maximum threads.             */
+
+/*
+ * A batch of lines, read into a private buffer so threads can work on
+ * them without touching the file; see ex_par.c.
+ */
+struct _par {
+        char    *ib;                    /* Batch text. */
+        size_t   ilen;                  /* Batch text buffer length. */
+        size_t  *ioff;                  /* Batch line offsets. */
+        recno_t  lno;                   /* Line number of the batch. */
+        size_t   n;                     /* Lines in the batch. */
+        int      nthreads;              /* Threads. */
+};
+
+/* Line i of the batch, and its length. */
+#define PAR_LP(par, i)  ((par)->ib + (par)->ioff[i])
+#define PAR_LEN(par, i) ((par)->ioff[(i) + 1] - (par)->ioff[i])
+
+/*
+ * Thread state, the first member of each command's thread structure.
+ * The thread works on lines first to first + cnt - 1 of the batch, and
+ * sets done to the number of lines it finished.
+ */
+struct _parthr {
+        PAR     *par;                   /* Batch, read-only. */
+        size_t   first;                 /* First line of the slice. */
+        size_t   cnt;                   /* Lines in the slice. */
+        size_t   done;                  /* Lines done. */
+        int      eval;                  /* RE error, else 0. */
+        int      err;                   /* Allocation errno. */
+        pthread_t tid;                  /* Thread. */
+        int      started;               /* If the thread was started. */
+};
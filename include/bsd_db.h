@@ -80,6 +80,9 @@ typedef struct {
 # define R_PREV         9               /* seq (BTREE, RECNO) */
 # define R_SETCURSOR    10              /* put (RECNO)        */
 # define R_RECNOSYNC    11              /* sync (RECNO)       */
+# define R_IAFTERV      12              /* put (RECNO)        */
+# define R_NEXTV        13              /* seq (RECNO)        */
+# define R_PREVV        14              /* seq (RECNO)        */
 
 typedef enum { DB_BTREE, DB_HASH, DB_RECNO } DBTYPE;
 
@@ -156,6 +159,7 @@ typedef struct {
 # define R_FIXEDLEN             0x01    /* fixed-length records      */
 # define R_NOKEY                0x02    /* key not required          */
 # define R_SNAPSHOT             0x04    /* snapshot the input        */
+# define R_NOCOPY               0x08    /* reference, don't copy, input */
         unsigned long   flags;          /* ...                       */
         unsigned int    cachesize;      /* bytes to cache            */
         unsigned int    psize;          /* page size                 */
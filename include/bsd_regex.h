@@ -110,10 +110,12 @@ typedef struct {
 # define regerror       openbsd_regerror
 # define regexec        openbsd_regexec
 # define regfree        openbsd_regfree
+# define regscan        openbsd_regscan
 
 int     regcomp(regex_t *, const char *, int);
 size_t  regerror(int, const regex_t *, char *, size_t);
 int     regexec(const regex_t *, const char *, size_t, regmatch_t [], int);
 void    regfree(regex_t *);
+const char *regscan(const regex_t *, const char *, size_t);
 
 #endif /* !_REGEX_H_ */
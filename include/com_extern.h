@@ -59,19 +59,28 @@ int v_event_push(SCR *, EVENT *, CHAR_T *, size_t, unsigned int);
 int v_event_get(SCR *, EVENT *, int, u_int32_t);
 void v_event_err(SCR *, EVENT *);
 int v_event_flush(SCR *, unsigned int);
+EVENT *v_event_run(SCR *, size_t *, u_int32_t);
 int db_eget(SCR *, recno_t, char **, size_t *, int *);
 int db_get(SCR *, recno_t, u_int32_t, char **, size_t *);
+int db_getv(SCR *, recno_t, dir_t, DBT *, recno_t *, recno_t *);
 int db_delete(SCR *, recno_t);
+int db_delete_range(SCR *, recno_t, recno_t);
 int db_append(SCR *, int, recno_t, char *, size_t);
+int db_append_range(SCR *, int, recno_t, DBT *, recno_t);
 int db_insert(SCR *, recno_t, char *, size_t);
 int db_set(SCR *, recno_t, char *, size_t);
 int db_exist(SCR *, recno_t);
 int db_last(SCR *, recno_t *);
+int db_partial(SCR *);
+int db_idle(SCR *);
+void db_cache_end(EXF *);
 void db_err(SCR *, recno_t);
 int log_init(SCR *, EXF *);
 int log_end(SCR *, EXF *);
 int log_cursor(SCR *);
 int log_line(SCR *, recno_t, unsigned int);
+int log_reset(SCR *, recno_t, char *, size_t);
+int log_lines(SCR *, recno_t, recno_t, DBT *, unsigned int);
 int log_mark(SCR *, LMARK *);
 int log_backward(SCR *, MARK *);
 int log_setline(SCR *);
@@ -82,7 +91,8 @@ int mark_init(SCR *, EXF *);
 int mark_end(SCR *, EXF *);
 int mark_get(SCR *, CHAR_T, MARK *, mtype_t);
 int mark_set(SCR *, CHAR_T, MARK *, int);
-int mark_insdel(SCR *, lnop_t, recno_t);
+int mark_insdel(SCR *, lnop_t, recno_t, recno_t);
+void mark_sync(EXF *);
 void msgq(SCR *, mtype_t, const char *, ...);
 void msgq_str(SCR *, mtype_t, char *, char *);
 void mod_rpt(SCR *);
@@ -59,6 +59,7 @@ int argv_free(SCR *);
 int ex_at(SCR *, EXCMD *);
 int ex_bang(SCR *, EXCMD *);
 int ex_cd(SCR *, EXCMD *);
+int ex_count(SCR *, EXCMD *);
 int ex_delete(SCR *, EXCMD *);
 int ex_display(SCR *, EXCMD *);
 int ex_edit(SCR *, EXCMD *);
@@ -67,7 +68,7 @@ int ex_file(SCR *, EXCMD *);
 int ex_filter(SCR *, EXCMD *, MARK *, MARK *, MARK *, char *, enum filtertype);
 int ex_global(SCR *, EXCMD *);
 int ex_v(SCR *, EXCMD *);
-int ex_g_insdel(SCR *, lnop_t, recno_t);
+int ex_g_insdel(SCR *, lnop_t, recno_t, recno_t);
 int ex_screen_copy(SCR *, SCR *);
 int ex_screen_end(SCR *);
 int ex_optchange(SCR *, int, char *, unsigned long *);
@@ -81,6 +82,12 @@ int ex_mkexrc(SCR *, EXCMD *);
 int ex_copy(SCR *, EXCMD *);
 int ex_move(SCR *, EXCMD *);
 int ex_open(SCR *, EXCMD *);
+int ex_par_nthreads(recno_t);
+int ex_par_init(SCR *, PAR *, int);
+int ex_par_read(SCR *, PAR *, recno_t, recno_t);
+int ex_par_run(PAR *, void *, size_t, void *(*)(void *));
+int ex_par_err(SCR *, PARTHR *, regex_t *);
+void ex_par_end(PAR *);
 int ex_preserve(SCR *, EXCMD *);
 int ex_recover(SCR *, EXCMD *);
 int ex_list(SCR *, EXCMD *);
@@ -118,6 +125,8 @@ int ex_s(SCR *, EXCMD *);
 int ex_subagain(SCR *, EXCMD *);
 int ex_subtilde(SCR *, EXCMD *);
 int re_compile(SCR *, char *, size_t, char **, size_t *, regex_t *, unsigned int);
+void re_free(SCR *, regex_t *);
+void re_close(GS *);
 void re_error(SCR *, int, regex_t *);
 int ex_tag_first(SCR *, char *);
 int ex_tag_push(SCR *, EXCMD *);
@@ -151,5 +160,6 @@ int ex_wq(SCR *, EXCMD *);
 int ex_write(SCR *, EXCMD *);
 int ex_xit(SCR *, EXCMD *);
 int ex_writefp(SCR *, char *, FILE *, MARK *, MARK *, unsigned long *, unsigned long *, int);
+int ex_writefd(SCR *, char *, int, MARK *, MARK *, unsigned long *, unsigned long *, int);
 int ex_yank(SCR *, EXCMD *);
 int ex_z(SCR *, EXCMD *);
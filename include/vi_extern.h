@@ -145,6 +145,7 @@ int vs_crel(SCR *, long);
 int v_zexit(SCR *, VICMD *);
 int vi(SCR **);
 int vs_line(SCR *, SMAP *, size_t *, size_t *);
+int vs_hl_refresh(SCR *);
 int vs_number(SCR *);
 void vs_busy(SCR *, const char *, busy_t);
 void vs_home(SCR *);
@@ -160,6 +161,7 @@ size_t vs_columns(SCR *, char *, recno_t, size_t *, size_t *);
 size_t vs_rcm(SCR *, recno_t, int);
 size_t vs_colpos(SCR *, recno_t, size_t);
 int vs_change(SCR *, recno_t, lnop_t);
+int vs_change_range(SCR *, recno_t, recno_t, lnop_t);
 int vs_sm_fill(SCR *, recno_t, pos_t);
 int vs_sm_scroll(SCR *, MARK *, recno_t, scroll_t);
 int vs_sm_1up(SCR *);
@@ -139,6 +139,46 @@ CHIN(const cset *cs, char c)
   return ( cs->ptr[(uch)c] & cs->mask ) != 0;
 }
 
+/*
+ * Multi-word state sets, used by regexec() for expressions with more states
+ * than fit in a long, up to MSTATES; see regexec.c.
+ */
+#define MSTATES   4096 /* most states kept in multi-word sets */
+#define MWORDS(g) ((size_t)(( g )->nstates + 63 ) / 64 )
+
+/*
+ * Lazily built DFA state cache, used by regexec() in place of the fast()
+ * NFA search for expressions without back references; see regexec.c.
+ */
+struct re_dfa
+{
+  struct re_dfa *next; /* next idle cache */
+  int nds;             /* number of DFA states in use */
+  int maxds;           /* maximum number of DFA states */
+  int hmask;           /* hash table size - 1 */
+  int *hash;           /* -> int [hmask+1], state number + 1 */
+  int *trans;          /* -> int [maxds][NC], transitions */
+  char *sets;          /* -> char [maxds][nstates], NFA states */
+  uch *kind;           /* -> uch [maxds], previous character class */
+  uch *fresh;          /* -> uch [maxds], is the fresh start set */
+  signed char *acc;    /* -> signed char [maxds][2], match at end */
+  char *start;         /* -> char [nstates], fresh start set */
+  char *tmp;           /* -> char [nstates], scratch */
+  char *aft;           /* -> char [nstates], scratch */
+};
+
+/*
+ * Match workspace, kept by regexec() across calls so that matching
+ * doesn't allocate; see regexec.c.
+ */
+struct re_work
+{
+  struct re_work *next;  /* next idle workspace */
+  char *space;           /* -> char [4][nstates], large or multi-word sets */
+  regmatch_t *pmatch;    /* -> regmatch_t [nsub+1] */
+  const char **lastpos;  /* -> const char * [nplus+1] */
+};
+
 /*
  * main compiled-expression structure
  */
@@ -159,13 +199,21 @@ struct re_guts
 #define USEBOL 01   /* used ^ */
 #define USEEOL 02   /* used $ */
 #define BAD    04   /* something wrong */
+#define LITERAL 010 /* nothing but the must string */
   int nbol;         /* number of ^ used */
   int neol;         /* number of $ used */
-  char *must;       /* match must contain this string */
+  char *must;       /* match must contain this string, folded */
   int mlen;         /* length of must */
+  uch fold[NC];     /* char to its OCHAR operand: lower case if REG_ICASE */
   size_t nsub;      /* copy of re_nsub */
   int backrefs;     /* does it use back references? */
   sopno nplus;      /* how deep does it nest +s? */
+  uint64_t *cmask;  /* -> uint64_t[NC][MWORDS], states taking each char */
+  sopno *cskip;     /* -> sopno[nstates], next state not taking a char */
+  struct re_dfa *dfa;        /* idle DFA caches */
+  int ndfa;                  /* number of DFA caches */
+  struct re_work *work;      /* idle match workspaces */
+  pthread_mutex_t lock;      /* protects dfa, ndfa and work */
 };
 
 /* misc utilities */
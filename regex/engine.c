@@ -74,6 +74,18 @@
 # define match lmat
 # define nope lnope
 #endif /* ifdef LNAMES */
+#ifdef MNAMES
+# define matcher mmatcher
+# define fast mfast
+# define slow mslow
+# define dissect mdissect
+# define backref mbackref
+# define step mstep
+# define print mprint
+# define at mat
+# define match mmat
+# define nope mnope
+#endif /* ifdef MNAMES */
 
 /* another structure passed up and down to avoid zillions of parameters */
 struct match
@@ -86,6 +98,7 @@ struct match
   const char *endp;     /* end of string -- virtual NUL here */
   const char *coldp;    /* can be no match starting before here */
   const char **lastpos; /* [nplus+1] */
+  struct re_work *work; /* workspace, if one has been taken */
   STATEVARS;
   states st;    /* current states */
   states fresh; /* states for a fresh start */
@@ -185,21 +198,9 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
     }
 
   /* prescreening; this does wonders for this rather slow code */
-  if (g->must != NULL)
+  if (g->must != NULL && mustfind(g, start, stop - start) == NULL)
     {
-      for (dp = start; dp < stop; dp++)
-        {
-          if (*dp == g->must[0] && stop - dp >= g->mlen
-              && memcmp(dp, g->must, g->mlen) == 0)
-            {
-              break;
-            }
-        }
-
-      if (dp == stop) /* we didn't find g->must */
-        {
-          return REG_NOMATCH;
-        }
+      return REG_NOMATCH; /* we didn't find g->must */
     }
 
   /* match struct setup */
@@ -207,6 +208,7 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
   m->eflags = eflags;
   m->pmatch = NULL;
   m->lastpos = NULL;
+  m->work = NULL;
   m->offp = string;
   m->beginp = start;
   m->endp = stop;
@@ -220,12 +222,16 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
   /* this loop does only one repetition except for backrefs */
   for (;;)
     {
-      endp = fast(m, start, stop, gf, gl);
+      if (g->backrefs
+          || !dfast(g, eflags, m->offp, m->beginp, start, stop,
+                    &m->coldp, &endp))
+        {
+          endp = fast(m, start, stop, gf, gl);
+        }
+
       if (endp == NULL)
         { /* a miss */
-          free(m->pmatch);
-          free(m->lastpos);
-          STATETEARDOWN(m);
+          work_put(g, m->work);
           return REG_NOMATCH;
         }
 
@@ -255,18 +261,13 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
         }
 
       /* oh my, he wants the subexpressions... */
-      if (m->pmatch == NULL)
+      if (m->work == NULL && ( m->work = work_get(g)) == NULL)
         {
-          m->pmatch = openbsd_reallocarray(
-            NULL, m->g->nsub + 1, sizeof ( regmatch_t ) );
-        }
-
-      if (m->pmatch == NULL)
-        {
-          STATETEARDOWN(m);
           return REG_ESPACE;
         }
 
+      m->pmatch = m->work->pmatch;
+
       for (i = 1; i <= m->g->nsub; i++)
         {
           m->pmatch[i].rm_so = m->pmatch[i].rm_eo = -1;
@@ -279,17 +280,9 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
         }
       else
         {
-          if (g->nplus > 0 && m->lastpos == NULL)
+          if (g->nplus > 0)
             {
-              m->lastpos = openbsd_reallocarray(
-                NULL, g->nplus + 1, sizeof ( char * ) );
-            }
-
-          if (g->nplus > 0 && m->lastpos == NULL)
-            {
-              free(m->pmatch);
-              STATETEARDOWN(m);
-              return REG_ESPACE;
+              m->lastpos = m->work->lastpos;
             }
 
           NOTE("backref dissect");
@@ -371,9 +364,7 @@ matcher(struct re_guts *g, const char *string, size_t nmatch,
         }
     }
 
-  free(m->pmatch);
-  free(m->lastpos);
-  STATETEARDOWN(m);
+  work_put(g, m->work);
   return 0;
 }
 
@@ -644,7 +635,7 @@ backref(struct match *m, const char *start, const char *stop, sopno startst,
       switch (OP(s = m->g->strip[ss]))
         {
         case OCHAR:
-          if (sp == stop || *sp++ != (char)OPND(s))
+          if (sp == stop || m->g->fold[(uch)*sp++] != (uch)OPND(s))
             {
               return NULL;
             }
@@ -1150,9 +1141,40 @@ step(struct re_guts *g, sopno start,  /* start state within strip */
   onestate here; /* note, macros know this name */
   sopno look;
   int i;
+  int fc = NONCHAR(ch) ? ch : (char)g->fold[(uch)ch]; /* ch as an OCHAR */
+#ifdef MNAMES
+  const sopno *skip = NULL;
+
+  /*
+   * The character transitions read only bef, so unless it's also aft
+   * they can all be made at once, and the loop need only visit the
+   * other states.
+   */
+  if (bef != aft || NONCHAR(ch))
+    {
+      if (!NONCHAR(ch))
+        {
+          mfwd(g, start, stop, bef, ch, aft);
+        }
+
+      skip = g->cskip;
+    }
+#endif /* ifdef MNAMES */
 
   for (pc = start, INIT(here, pc); pc != stop; pc++, INC(here))
     {
+#ifdef MNAMES
+      if (skip != NULL)
+        {
+          if (( pc = skip[pc] ) >= stop)
+            {
+              break;
+            }
+
+          INIT(here, pc);
+        }
+
+#endif /* ifdef MNAMES */
       s = g->strip[pc];
       switch (OP(s))
         {
@@ -1162,8 +1184,8 @@ step(struct re_guts *g, sopno start,  /* start state within strip */
 
         case OCHAR:
           /* only characters can match */
-          assert(!NONCHAR(ch) || ch != (char)OPND(s));
-          if (ch == (char)OPND(s))
+          assert(!NONCHAR(ch) || fc != (char)OPND(s));
+          if (fc == (char)OPND(s))
             {
               FWD(aft, bef, 1);
             }
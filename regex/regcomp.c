@@ -50,6 +50,7 @@
 #include <bsd_string.h>
 #include <ctype.h>
 #include <limits.h>
+#include <pthread.h>
 #include <bsd_stdlib.h>
 #include <bsd_regex.h>
 #include <bsd_unistd.h>
@@ -103,6 +104,7 @@ static void freeset(struct parse *, cset *);
 static int freezeset(struct parse *, cset *);
 static int firstch(struct parse *, cset *);
 static int nch(struct parse *, cset *);
+static int icpair(struct parse *, cset *);
 static sopno dupl(struct parse *, sopno, sopno);
 static void doemit(struct parse *, sop, size_t);
 static void doinsert(struct parse *, sop, size_t, sopno);
@@ -111,6 +113,7 @@ static int enlarge(struct parse *, sopno);
 static void stripsnug(struct parse *, struct re_guts *);
 static void findmust(struct parse *, struct re_guts *);
 static sopno pluscount(struct parse *, struct re_guts *);
+static void mstates(struct parse *, struct re_guts *);
 
 static char nuls[10]; /* place to point scanner in event of error */
 
@@ -232,6 +235,22 @@ regcomp(regex_t *preg, const char *pattern, int cflags)
   g->mlen = 0;
   g->nsub = 0;
   g->backrefs = 0;
+  g->cmask = NULL;
+  g->cskip = NULL;
+  for (i = 0; i < NC; i++)
+    {
+      g->fold[i] = (uch)i;
+      if (cflags & REG_ICASE && isupper(i) && (uch)othercase(i) != i
+          && (uch)othercase(othercase(i)) == i)
+        {
+          g->fold[i] = (uch)othercase(i);
+        }
+    }
+
+  g->dfa = NULL;
+  g->ndfa = 0;
+  g->work = NULL;
+  (void)pthread_mutex_init(&g->lock, NULL);
 
   /* do it */
   EMIT(OEND, 0);
@@ -255,7 +274,13 @@ regcomp(regex_t *preg, const char *pattern, int cflags)
   /* tidy up loose ends and fill things in */
   stripsnug(p, g);
   findmust(p, g);
+  if (g->mlen > 0 && g->mlen == g->laststate - g->firststate - 1)
+    {
+      g->iflags |= LITERAL; /* the must string is all of it */
+    }
+
   g->nplus = pluscount(p, g);
+  mstates(p, g);
   g->magic = MAGIC2;
   preg->re_nsub = g->nsub;
   preg->re_g = g;
@@ -877,8 +902,8 @@ p_bracket(struct parse *p)
         }
     }
 
-  if (nch(p, cs) == 1)
-    { /* optimize singleton sets */
+  if (nch(p, cs) == 1 || ( p->g->cflags & REG_ICASE && icpair(p, cs)))
+    { /* optimize singleton sets, and letters in both cases */
       ordinary(p, firstch(p, cs));
       freeset(p, cs);
     }
@@ -1130,17 +1155,22 @@ bothcases(struct parse *p, int ch)
 
 /*
  * - ordinary - emit an ordinary character
+ *
+ * Under REG_ICASE, a letter is emitted folded and the matchers fold the
+ * text to compare with it; bothcases() is left for letters whose cases
+ * don't fold together.
  */
 static void
 ordinary(struct parse *p, int ch)
 {
-  if (( p->g->cflags & REG_ICASE ) && isalpha((uch)ch) && othercase(ch) != ch)
+  if (( p->g->cflags & REG_ICASE ) && isalpha((uch)ch) && othercase(ch) != ch
+      && p->g->fold[(uch)ch] != p->g->fold[(uch)othercase(ch)])
     {
       bothcases(p, ch);
     }
   else
     {
-      EMIT(OCHAR, (uch)ch);
+      EMIT(OCHAR, p->g->fold[(uch)ch]);
     }
 }
 
@@ -1464,6 +1494,25 @@ nch(struct parse *p, cset *cs)
   return n;
 }
 
+/*
+ * - icpair - is a set just the two cases of one folded letter?
+ */
+static int
+icpair(struct parse *p, cset *cs)
+{
+  int c;
+
+  if (nch(p, cs) != 2)
+    {
+      return 0;
+    }
+
+  c = (uch)firstch(p, cs);
+  return isalpha(c) && (uch)othercase(c) != c
+         && p->g->fold[c] == p->g->fold[(uch)othercase(c)]
+         && CHIN(cs, othercase(c));
+}
+
 /*
  * - dupl - emit a duplicate of a bunch of sops
  */
@@ -1772,3 +1821,84 @@ pluscount(struct parse *p, struct re_guts *g)
 
   return maxnest;
 }
+
+/*
+ * - mstates - build the tables for the multi-word state sets
+ *
+ * For each character, cmask holds the set of states that take it, so
+ * the character transitions of step() can be made a word at a time, and
+ * cskip lets step() walk past those states to the next one it must look
+ * at.  Without them, regexec() uses the byte-per-state sets.
+ */
+static void
+mstates(struct parse *p, struct re_guts *g)
+{
+  const size_t nw = MWORDS(g);
+  uint64_t bit;
+  cset *cs;
+  sopno i;
+  sop s;
+  int c;
+
+  if (p->error != 0 || g->nstates <= CHAR_BIT * sizeof ( long )
+      || g->nstates > MSTATES)
+    {
+      return;
+    }
+
+  g->cmask = calloc((size_t)NC * nw, sizeof ( uint64_t ));
+  g->cskip = openbsd_reallocarray(NULL, g->nstates, sizeof ( sopno ));
+  if (g->cmask == NULL || g->cskip == NULL)
+    {
+      free(g->cmask);
+      free(g->cskip);
+      g->cmask = NULL;
+      g->cskip = NULL;
+      return;
+    }
+
+  for (i = g->nstates - 1; i >= 0; i--)
+    {
+      s = g->strip[i];
+      bit = (uint64_t)1 << ( i & 63 );
+      switch (OP(s))
+        {
+        case OCHAR:
+          for (c = 0; c < NC; c++)
+            {
+              if (g->fold[c] == (uch)OPND(s))
+                {
+                  g->cmask[(size_t)c * nw + ( i >> 6 )] |= bit;
+                }
+            }
+
+          break;
+
+        case OANY:
+          for (c = 0; c < NC; c++)
+            {
+              g->cmask[(size_t)c * nw + ( i >> 6 )] |= bit;
+            }
+
+          break;
+
+        case OANYOF:
+          cs = &g->sets[OPND(s)];
+          for (c = 0; c < NC; c++)
+            {
+              if (CHIN(cs, (char)c))
+                {
+                  g->cmask[(size_t)c * nw + ( i >> 6 )] |= bit;
+                }
+            }
+
+          break;
+
+        default:
+          g->cskip[i] = i;
+          continue;
+        }
+
+      g->cskip[i] = ( i + 1 < g->nstates ) ? g->cskip[i + 1] : g->nstates;
+    }
+}
@@ -57,11 +57,346 @@
 #include <bsd_string.h>
 #include <limits.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <bsd_regex.h>
 
 #include "utils.h"
 #include "bsd_regex2.h"
 
+/*
+ * - memfind - find a string in a buffer
+ *
+ * Used for the must prescreen and for literal expressions.  Candidates
+ * are found by comparing the first and last bytes of the string at each
+ * position, 16 or 32 positions at a time where SSE2 or AVX2 is available
+ * (AVX2 chosen at run time), and only candidates are compared in full.
+ * With a fold table, the string is folded and each byte of the buffer is
+ * folded before it's compared; the first and last bytes are then looked
+ * for in both cases.
+ */
+#if defined(__GNUC__) && defined(__SSE2__) \
+    && ( defined(__x86_64__) || defined(__i386__))
+# include <immintrin.h>
+# define MEMFIND_SSE2
+# if defined(__clang__) || __GNUC__ >= 5
+#  define MEMFIND_AVX2
+# endif /* if defined(__clang__) || __GNUC__ >= 5 */
+#endif /* if defined(__GNUC__) && defined(__SSE2__) ... */
+
+static int /* do the middles of two strings match? */
+memfind_eq(const uch *fold, const char *h, const char *n, size_t nlen)
+{
+  size_t i;
+
+  if (nlen <= 2)
+    {
+      return 1;
+    }
+
+  if (fold == NULL)
+    {
+      return memcmp(h + 1, n + 1, nlen - 2) == 0;
+    }
+
+  for (i = 1; i < nlen - 1; i++)
+    {
+      if (fold[(uch)h[i]] != (uch)n[i])
+        {
+          return 0;
+        }
+    }
+
+  return 1;
+}
+
+static const char *
+memfind_tail(const char *h, size_t i, size_t end, const char *n, size_t nlen,
+             const uch *fold)
+{
+  const char *p;
+
+  if (fold != NULL)
+    {
+      for (; i < end; i++)
+        {
+          if (fold[(uch)h[i]] == (uch)n[0]
+              && fold[(uch)h[i + nlen - 1]] == (uch)n[nlen - 1]
+              && memfind_eq(fold, h + i, n, nlen))
+            {
+              return h + i;
+            }
+        }
+
+      return NULL;
+    }
+
+  for (; i < end; i = p - h + 1)
+    {
+      if (( p = memchr(h + i, n[0], end - i)) == NULL)
+        {
+          return NULL;
+        }
+
+      if (p[nlen - 1] == n[nlen - 1] && memfind_eq(NULL, p, n, nlen))
+        {
+          return p;
+        }
+    }
+
+  return NULL;
+}
+
+#ifdef MEMFIND_AVX2
+__attribute__(( target("avx2")))
+static const char *
+memfind_avx2(const char *h, size_t hlen, const char *n, size_t nlen,
+             const uch *fold, int fu, int lu)
+{
+  const __m256i first = _mm256_set1_epi8(n[0]);
+  const __m256i last = _mm256_set1_epi8(n[nlen - 1]);
+  const __m256i firstu = _mm256_set1_epi8((char)fu);
+  const __m256i lastu = _mm256_set1_epi8((char)lu);
+  const size_t end = hlen - nlen + 1;
+  unsigned int mask;
+  __m256i a;
+  __m256i b;
+  size_t i;
+
+  for (i = 0; i + 32 <= end; i += 32)
+    {
+      a = _mm256_loadu_si256((const __m256i *)( h + i ));
+      b = _mm256_loadu_si256((const __m256i *)( h + i + nlen - 1 ));
+      mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(a, first),
+                        _mm256_cmpeq_epi8(a, firstu)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(b, last),
+                        _mm256_cmpeq_epi8(b, lastu))));
+      for (; mask != 0; mask &= mask - 1)
+        {
+          if (memfind_eq(fold, h + i + __builtin_ctz(mask), n, nlen))
+            {
+              return h + i + __builtin_ctz(mask);
+            }
+        }
+    }
+
+  return memfind_tail(h, i, end, n, nlen, fold);
+}
+#endif /* ifdef MEMFIND_AVX2 */
+
+#ifdef MEMFIND_SSE2
+static const char *
+memfind_sse2(const char *h, size_t hlen, const char *n, size_t nlen,
+             const uch *fold, int fu, int lu)
+{
+  const __m128i first = _mm_set1_epi8(n[0]);
+  const __m128i last = _mm_set1_epi8(n[nlen - 1]);
+  const __m128i firstu = _mm_set1_epi8((char)fu);
+  const __m128i lastu = _mm_set1_epi8((char)lu);
+  const size_t end = hlen - nlen + 1;
+  unsigned int mask;
+  __m128i a;
+  __m128i b;
+  size_t i;
+
+  for (i = 0; i + 16 <= end; i += 16)
+    {
+      a = _mm_loadu_si128((const __m128i *)( h + i ));
+      b = _mm_loadu_si128((const __m128i *)( h + i + nlen - 1 ));
+      mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(a, firstu)),
+        _mm_or_si128(_mm_cmpeq_epi8(b, last), _mm_cmpeq_epi8(b, lastu))));
+      for (; mask != 0; mask &= mask - 1)
+        {
+          if (memfind_eq(fold, h + i + __builtin_ctz(mask), n, nlen))
+            {
+              return h + i + __builtin_ctz(mask);
+            }
+        }
+    }
+
+  return memfind_tail(h, i, end, n, nlen, fold);
+}
+#endif /* ifdef MEMFIND_SSE2 */
+
+/*
+ * - memfind_other - the other case of a folded byte, or the byte itself
+ */
+static int
+memfind_other(const uch *fold, int c)
+{
+  int u;
+
+  c = (uch)c;
+  if (fold == NULL || !islower(c))
+    {
+      return c;
+    }
+
+  u = (uch)toupper(c);
+  return fold[u] == c ? u : c;
+}
+
+static const char * /* start of the string, or NULL */
+memfind(const char *h, size_t hlen, const char *n, size_t nlen,
+        const uch *fold)
+{
+  int fu;
+  int lu;
+
+  if (nlen > hlen)
+    {
+      return NULL;
+    }
+
+  fu = memfind_other(fold, n[0]);
+  lu = nlen == 0 ? 0 : memfind_other(fold, n[nlen - 1]);
+  if (nlen == 0 || ( nlen == 1 && fu == (uch)n[0] ))
+    {
+      return nlen == 0 ? h : memchr(h, n[0], hlen);
+    }
+
+#ifdef MEMFIND_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    {
+      return memfind_avx2(h, hlen, n, nlen, fold, fu, lu);
+    }
+
+#endif /* ifdef MEMFIND_AVX2 */
+#ifdef MEMFIND_SSE2
+  return memfind_sse2(h, hlen, n, nlen, fold, fu, lu);
+#else  /* ifdef MEMFIND_SSE2 */
+  return memfind_tail(h, 0, hlen - nlen + 1, n, nlen, fold);
+#endif /* ifdef MEMFIND_SSE2 */
+}
+
+/*
+ * - mustfind - find the must string in a buffer
+ */
+static const char * /* start of the string, or NULL */
+mustfind(const struct re_guts *g, const char *h, size_t hlen)
+{
+  return memfind(h, hlen, g->must, g->mlen,
+                 ( g->cflags & REG_ICASE ) ? g->fold : NULL);
+}
+
+/*
+ * - litmatcher - the matcher for expressions that are just a string
+ */
+static int /* 0 success, REG_NOMATCH failure */
+litmatcher(struct re_guts *g, const char *string, size_t nmatch,
+           regmatch_t pmatch[], int eflags)
+{
+  const char *start;
+  const char *stop;
+  const char *dp;
+  size_t i;
+
+  if (g->cflags & REG_NOSUB)
+    {
+      nmatch = 0;
+    }
+
+  if (eflags & REG_STARTEND)
+    {
+      start = string + pmatch[0].rm_so;
+      stop = string + pmatch[0].rm_eo;
+    }
+  else
+    {
+      start = string;
+      stop = start + strlen(start);
+    }
+
+  if (stop < start)
+    {
+      return REG_INVARG;
+    }
+
+  if (( dp = mustfind(g, start, stop - start)) == NULL)
+    {
+      return REG_NOMATCH;
+    }
+
+  if (nmatch > 0)
+    {
+      pmatch[0].rm_so = dp - string;
+      pmatch[0].rm_eo = dp - string + g->mlen;
+    }
+
+  for (i = 1; i < nmatch; i++)
+    {
+      pmatch[i].rm_so = -1;
+      pmatch[i].rm_eo = -1;
+    }
+
+  return 0;
+}
+
+static int dfast(struct re_guts *, int, const char *, const char *,
+                 const char *, const char *, const char **, const char **);
+
+/*
+ * - work_get - take a match workspace from the pool, allocating one if need be
+ */
+static struct re_work *
+work_get(struct re_guts *g)
+{
+  struct re_work *w;
+
+  if (pthread_mutex_lock(&g->lock) != 0)
+    {
+      return NULL;
+    }
+
+  if (( w = g->work ) != NULL)
+    {
+      g->work = w->next;
+    }
+
+  (void)pthread_mutex_unlock(&g->lock);
+  if (w != NULL)
+    {
+      return w;
+    }
+
+  if (( w = calloc(1, sizeof ( struct re_work ))) == NULL)
+    {
+      return NULL;
+    }
+
+  w->space = openbsd_reallocarray(NULL, g->nstates, 4);
+  w->pmatch = openbsd_reallocarray(NULL, g->nsub + 1, sizeof ( regmatch_t ));
+  w->lastpos = openbsd_reallocarray(NULL, g->nplus + 1, sizeof ( char * ));
+  if (w->space == NULL || w->pmatch == NULL || w->lastpos == NULL)
+    {
+      free(w->space);
+      free(w->pmatch);
+      free(w->lastpos);
+      free(w);
+      return NULL;
+    }
+
+  return w;
+}
+
+/*
+ * - work_put - return a match workspace to the pool
+ */
+static void
+work_put(struct re_guts *g, struct re_work *w)
+{
+  if (w == NULL)
+    {
+      return;
+    }
+
+  (void)pthread_mutex_lock(&g->lock);
+  w->next = g->work;
+  g->work = w;
+  (void)pthread_mutex_unlock(&g->lock);
+}
+
 /* macros for manipulating states, small version */
 #define states long
 #define states1 long /* for later use in regexec() decision */
@@ -73,7 +408,6 @@
 #define EQ(a, b) (( a ) == ( b ))
 #define STATEVARS long dummy /* dummy version */
 #define STATESETUP(m, n)     /* nothing */
-#define STATETEARDOWN(m)     /* nothing */
 #define SETUP(v) (( v ) = 0 )
 #define onestate long
 #define INIT(o, n) (( o ) = (unsigned long)1 << ( n ))
@@ -99,7 +433,6 @@
 #undef EQ
 #undef STATEVARS
 #undef STATESETUP
-#undef STATETEARDOWN
 #undef SETUP
 #undef onestate
 #undef INIT
@@ -125,18 +458,13 @@
 
 #define STATESETUP(m, nv)                                                     \
   {                                                                           \
-    ( m )->space = openbsd_reallocarray(                                      \
-      NULL, ( m )->g->nstates, ( nv ) );                                      \
-    if (( m )->space == NULL)                                                 \
+    assert(( nv ) <= 4);                                                      \
+    if (( ( m )->work = work_get(( m )->g)) == NULL)                          \
     return REG_ESPACE;                                                        \
+    ( m )->space = ( m )->work->space;                                        \
     ( m )->vn = 0;                                                            \
   }
 
-#define STATETEARDOWN(m)                                                      \
-  {                                                                           \
-    free(( m )->space);                                                       \
-  }
-
 #define SETUP(v) (( v ) = &m->space[m->vn++ *m->g->nstates] )
 #define onestate long
 #define INIT(o, n) (( o ) = ( n ))
@@ -152,6 +480,550 @@
 
 #include "engine.c"
 
+/*
+ * - lazy DFA - the fast() search without the NFA simulation
+ *
+ * For expressions without back references, the search done by fast() is
+ * run on a DFA whose states are built from the large state representation
+ * as they are first needed.  A DFA state is a set of NFA states plus the
+ * class of the previous character, which is all fast() looks at when it
+ * decides on the BOL, EOL, BOW and EOW steps, so once a transition is built
+ * each character costs one table lookup.  The coldp and match results are
+ * the same as fast() would return.
+ *
+ * Each cache holds a bounded number of states; when it fills, it's flushed
+ * and restarted, and after DFA_MAXFLUSH flushes in one search we give up
+ * and let the NFA do the search.  A regex_t may be used by several threads
+ * at once, so the re_guts holds a small pool of caches, each of which is
+ * used by one regexec() at a time.
+ */
+#define DFA_CACHEMEM  ( 1L << 20 ) /* target bytes per cache */
+#define DFA_MINSTATES 32           /* minimum DFA states per cache */
+#define DFA_MAXSTATES 4096         /* maximum DFA states per cache */
+#define DFA_MAXFLUSH  4            /* flushes per search before giving up */
+#define DFA_NCACHE    16           /* maximum caches per regex */
+
+#define DFA_UNKNOWN   0            /* transition not yet built */
+#define DFA_MATCH     ( -1 )       /* match found before the character */
+
+/* previous character classes */
+#define K_BOL   0 /* string start, BOL */
+#define K_NOBOL 1 /* string start, REG_NOTBOL */
+#define K_NL    2 /* newline, with REG_NEWLINE */
+#define K_WORD  3 /* word character */
+#define K_OTHER 4 /* anything else */
+
+#define DSET(d, s) ( &( d )->sets[(size_t)( s ) * g->nstates] )
+
+/*
+ * - dfa_kind - class of a previous character
+ */
+static int
+dfa_kind(struct re_guts *g, int c)
+{
+  if (c == '\n' && g->cflags & REG_NEWLINE)
+    {
+      return K_NL;
+    }
+
+  return ISWORD(c) ? K_WORD : K_OTHER;
+}
+
+/*
+ * - dfa_step - step() in the representation regexec() would have used
+ *
+ * The two representations don't quite agree when bef and aft are the same
+ * set, so use the small one if the matcher would have.
+ */
+static void
+dfa_step(struct re_guts *g, char *bef, int ch, char *aft)
+{
+  const sopno gf = g->firststate + 1;
+  const sopno gl = g->laststate;
+  unsigned long a;
+  unsigned long b;
+  sopno i;
+
+  if (g->nstates > CHAR_BIT * sizeof ( states1 ))
+    {
+      (void)lstep(g, gf, gl, bef, ch, aft);
+      return;
+    }
+
+  for (a = b = 0, i = 0; i < g->nstates; i++)
+    {
+      if (bef[i])
+        {
+          b |= (unsigned long)1 << i;
+        }
+
+      if (aft[i])
+        {
+          a |= (unsigned long)1 << i;
+        }
+    }
+
+  a = sstep(g, gf, gl, b, ch, a);
+  for (i = 0; i < g->nstates; i++)
+    {
+      aft[i] = ( a & ((unsigned long)1 << i )) != 0;
+    }
+}
+
+/*
+ * - dfa_flags - take the BOL, EOL, BOW and EOW steps between two characters
+ *
+ * This is the code at the top of the fast() loop; lastc is a character
+ * of the previous character's class.
+ */
+static void
+dfa_flags(struct re_guts *g, char *st, int kind, int c, int eflags)
+{
+  int flagch;
+  int lastc;
+  int i;
+
+  switch (kind)
+    {
+    case K_NOBOL:
+      eflags |= REG_NOTBOL;
+    /* FALLTHROUGH */
+    case K_BOL:
+      lastc = OUT;
+      break;
+
+    case K_NL:
+      lastc = '\n';
+      break;
+
+    case K_WORD:
+      lastc = 'a';
+      break;
+
+    default:
+      lastc = ' ';
+      break;
+    }
+
+  flagch = '\0';
+  i = 0;
+  if (( lastc == '\n' && g->cflags & REG_NEWLINE )
+      || ( lastc == OUT && !( eflags & REG_NOTBOL )))
+    {
+      flagch = BOL;
+      i = g->nbol;
+    }
+
+  if (( c == '\n' && g->cflags & REG_NEWLINE )
+      || ( c == OUT && !( eflags & REG_NOTEOL )))
+    {
+      flagch = ( flagch == BOL ) ? BOLEOL : EOL;
+      i += g->neol;
+    }
+
+  for (; i > 0; i--)
+    {
+      dfa_step(g, st, flagch, st);
+    }
+
+  if (( flagch == BOL || ( lastc != OUT && !ISWORD(lastc)))
+      && ( c != OUT && ISWORD(c)))
+    {
+      flagch = BOW;
+    }
+
+  if (( lastc != OUT && ISWORD(lastc))
+      && ( flagch == EOL || ( c != OUT && !ISWORD(c))))
+    {
+      flagch = EOW;
+    }
+
+  if (flagch == BOW || flagch == EOW)
+    {
+      dfa_step(g, st, flagch, st);
+    }
+}
+
+/*
+ * - dfa_state - find or add the DFA state for a set and class
+ */
+static int /* state number, or -1 if the cache is full */
+dfa_state(struct re_guts *g, struct re_dfa *d, const char *st, int kind)
+{
+  unsigned long h;
+  sopno i;
+  int s;
+  int hi;
+
+  h = 2166136261UL ^ (unsigned long)kind;
+  for (i = 0; i < g->nstates; i++)
+    {
+      h = ( h ^ (uch)st[i] ) * 16777619UL;
+    }
+
+  for (hi = (int)( h & d->hmask ); d->hash[hi] != 0; hi = ( hi + 1 ) & d->hmask)
+    {
+      s = d->hash[hi] - 1;
+      if (d->kind[s] == kind && memcmp(DSET(d, s), st, g->nstates) == 0)
+        {
+          return s;
+        }
+    }
+
+  if (d->nds == d->maxds)
+    {
+      return -1;
+    }
+
+  s = d->nds++;
+  memcpy(DSET(d, s), st, g->nstates);
+  memset(&d->trans[(size_t)s * NC], 0, NC * sizeof ( int ));
+  d->kind[s] = kind;
+  d->fresh[s] = memcmp(st, d->start, g->nstates) == 0;
+  d->acc[2 * s] = d->acc[2 * s + 1] = -1;
+  d->hash[hi] = s + 1;
+  return s;
+}
+
+/*
+ * - dfa_flush - empty a cache
+ */
+static void
+dfa_flush(struct re_dfa *d)
+{
+  d->nds = 0;
+  memset(d->hash, 0, ( d->hmask + 1 ) * sizeof ( int ));
+}
+
+/*
+ * - dfa_get - take a cache from the pool, allocating one if need be
+ */
+static struct re_dfa *
+dfa_get(struct re_guts *g)
+{
+  struct re_dfa *d;
+  size_t n;
+
+  if (pthread_mutex_lock(&g->lock) != 0)
+    {
+      return NULL;
+    }
+
+  if (( d = g->dfa ) != NULL)
+    {
+      g->dfa = d->next;
+    }
+  else if (g->ndfa < DFA_NCACHE)
+    {
+      g->ndfa++;
+    }
+  else
+    {
+      (void)pthread_mutex_unlock(&g->lock);
+      return NULL;
+    }
+
+  (void)pthread_mutex_unlock(&g->lock);
+  if (d != NULL)
+    {
+      return d;
+    }
+
+  if (( d = calloc(1, sizeof ( struct re_dfa ))) == NULL)
+    {
+      goto nospace;
+    }
+
+  n = DFA_CACHEMEM / ( NC * sizeof ( int ) + g->nstates + 4 );
+  d->maxds = n < DFA_MINSTATES ? DFA_MINSTATES
+             : n > DFA_MAXSTATES ? DFA_MAXSTATES : (int)n;
+  for (d->hmask = 1; d->hmask < 2 * d->maxds; d->hmask <<= 1)
+    {
+      continue;
+    }
+
+  d->hmask--;
+  d->hash = calloc(d->hmask + 1, sizeof ( int ));
+  d->trans = openbsd_reallocarray(NULL, (size_t)d->maxds * NC, sizeof ( int ));
+  d->sets = openbsd_reallocarray(NULL, d->maxds, g->nstates);
+  d->kind = malloc(d->maxds);
+  d->fresh = malloc(d->maxds);
+  d->acc = malloc(2 * d->maxds);
+  d->start = calloc(1, g->nstates);
+  d->tmp = malloc(g->nstates);
+  d->aft = malloc(g->nstates);
+  if (d->hash == NULL || d->trans == NULL || d->sets == NULL
+      || d->kind == NULL || d->fresh == NULL || d->acc == NULL
+      || d->start == NULL || d->tmp == NULL || d->aft == NULL)
+    {
+      free(d->hash);
+      free(d->trans);
+      free(d->sets);
+      free(d->kind);
+      free(d->fresh);
+      free(d->acc);
+      free(d->start);
+      free(d->tmp);
+      free(d->aft);
+      free(d);
+      goto nospace;
+    }
+
+  /* the fresh start set, as in fast() */
+  SET1(d->start, g->firststate + 1);
+  dfa_step(g, d->start, NOTHING, d->start);
+  return d;
+
+nospace:
+  if (pthread_mutex_lock(&g->lock) == 0)
+    {
+      g->ndfa--;
+      (void)pthread_mutex_unlock(&g->lock);
+    }
+
+  return NULL;
+}
+
+/*
+ * - dfa_put - return a cache to the pool
+ */
+static void
+dfa_put(struct re_guts *g, struct re_dfa *d)
+{
+  (void)pthread_mutex_lock(&g->lock);
+  d->next = g->dfa;
+  g->dfa = d;
+  (void)pthread_mutex_unlock(&g->lock);
+}
+
+/*
+ * - dfa_trans - build the transition from a state on a character
+ */
+static int /* DFA_MATCH, state number + 1, or DFA_UNKNOWN if full */
+dfa_trans(struct re_guts *g, struct re_dfa *d, int s, int c)
+{
+  int t;
+
+  memcpy(d->tmp, DSET(d, s), g->nstates);
+  dfa_flags(g, d->tmp, d->kind[s], c, 0);
+  if (ISSET(d->tmp, g->laststate))
+    {
+      t = DFA_MATCH;
+    }
+  else
+    {
+      memcpy(d->aft, d->start, g->nstates);
+      dfa_step(g, d->tmp, c, d->aft);
+      if (( t = dfa_state(g, d, d->aft, dfa_kind(g, c))) < 0)
+        {
+          return DFA_UNKNOWN;
+        }
+
+      t++;
+    }
+
+  d->trans[(size_t)s * NC + (uch)c] = t;
+  return t;
+}
+
+/*
+ * - dfast - fast() on the lazy DFA
+ */
+static int /* 1 if done, 0 if the NFA must do it */
+dfast(struct re_guts *g, int eflags, const char *offp, const char *beginp,
+      const char *start, const char *stop, const char **coldpp,
+      const char **endpp)
+{
+  struct re_dfa *d;
+  const char *coldp;
+  const char *p;
+  int nflush;
+  int kind;
+  int e;
+  int s;
+  int t;
+
+  if (eflags & REG_LARGE || ( d = dfa_get(g)) == NULL)
+    {
+      return 0;
+    }
+
+  if (start == offp || ( start == beginp && !( eflags & REG_NOTBOL )))
+    {
+      kind = ( eflags & REG_NOTBOL ) ? K_NOBOL : K_BOL;
+    }
+  else
+    {
+      kind = dfa_kind(g, *( start - 1 ));
+    }
+
+  if (( s = dfa_state(g, d, d->start, kind)) < 0)
+    {
+      dfa_flush(d);
+      s = dfa_state(g, d, d->start, kind);
+    }
+
+  coldp = NULL;
+  nflush = 0;
+  for (p = start;; p++)
+    {
+      if (d->fresh[s])
+        {
+          coldp = p;
+        }
+
+      if (p == stop)
+        {
+          e = ( eflags & REG_NOTEOL ) != 0;
+          if (d->acc[2 * s + e] < 0)
+            {
+              memcpy(d->tmp, DSET(d, s), g->nstates);
+              dfa_flags(g, d->tmp, d->kind[s], OUT, eflags & REG_NOTEOL);
+              d->acc[2 * s + e] = ISSET(d->tmp, g->laststate) != 0;
+            }
+
+          *endpp = d->acc[2 * s + e] ? p + 1 : NULL;
+          break;
+        }
+
+      if (( t = d->trans[(size_t)s * NC + (uch)*p] ) == DFA_UNKNOWN
+          && ( t = dfa_trans(g, d, s, *p)) == DFA_UNKNOWN)
+        {
+          /* full: keep this state, flush the rest, and try again */
+          if (++nflush > DFA_MAXFLUSH)
+            {
+              dfa_put(g, d);
+              return 0;
+            }
+
+          kind = d->kind[s];
+          memcpy(d->aft, DSET(d, s), g->nstates);
+          dfa_flush(d);
+          memcpy(d->tmp, d->aft, g->nstates);
+          s = dfa_state(g, d, d->tmp, kind);
+          t = dfa_trans(g, d, s, *p);
+        }
+
+      if (t == DFA_MATCH)
+        {
+          *endpp = p + 1;
+          break;
+        }
+
+      s = t - 1;
+    }
+
+  *coldpp = coldp;
+  dfa_put(g, d);
+  return 1;
+}
+
+/* now undo things */
+#undef states
+#undef CLEAR
+#undef SET0
+#undef SET1
+#undef ISSET
+#undef ASSIGN
+#undef EQ
+#undef STATEVARS
+#undef STATESETUP
+#undef SETUP
+#undef onestate
+#undef INIT
+#undef INC
+#undef ISSTATEIN
+#undef FWD
+#undef BACK
+#undef ISSETBACK
+#undef LNAMES
+
+/*
+ * - mfwd - make the character transitions of step() a word at a time
+ *
+ * Every state in [start, stop) that is in bef and takes ch puts the next
+ * state into aft; the cmask row for ch says which states take it.
+ */
+static void
+mfwd(struct re_guts *g, sopno start, sopno stop, const uint64_t *bef, int ch,
+     uint64_t *aft)
+{
+  const uint64_t *cm = &g->cmask[(size_t)(uch)ch * MWORDS(g)];
+  const size_t w0 = (size_t)start >> 6;
+  const size_t w1 = (size_t)( stop - 1 ) >> 6;
+  uint64_t carry = 0;
+  uint64_t v;
+  size_t w;
+
+  if (start >= stop)
+    {
+      return;
+    }
+
+  for (w = w0; w <= w1; w++)
+    {
+      v = bef[w] & cm[w];
+      if (w == w0)
+        {
+          v &= ~(uint64_t)0 << ( start & 63 );
+        }
+
+      if (w == w1 && ( stop & 63 ) != 0)
+        {
+          v &= ((uint64_t)1 << ( stop & 63 )) - 1;
+        }
+
+      aft[w] |= v << 1 | carry;
+      carry = v >> 63;
+    }
+
+  if (carry != 0) /* only from a state before stop, so below nstates */
+    {
+      aft[w1 + 1] |= carry;
+    }
+}
+
+/* macros for manipulating states, multi-word version */
+#define states uint64_t *
+#define CLEAR(v) memset(v, 0, MWORDS(m->g) * sizeof ( uint64_t ))
+#define SET0(v, n) (( v )[( n ) >> 6] &= ~((uint64_t)1 << (( n ) & 63 )))
+#define SET1(v, n) (( v )[( n ) >> 6] |= (uint64_t)1 << (( n ) & 63 ))
+#define ISSET(v, n) ((( v )[( n ) >> 6] >> (( n ) & 63 )) & 1 )
+#define ASSIGN(d, s) memcpy(d, s, MWORDS(m->g) * sizeof ( uint64_t ))
+#define EQ(a, b) ( memcmp(a, b, MWORDS(m->g) * sizeof ( uint64_t )) == 0 )
+
+#define STATEVARS                                                             \
+  long vn;                                                                    \
+  uint64_t *space
+
+#define STATESETUP(m, nv)                                                     \
+  {                                                                           \
+    assert(( nv ) <= 4);                                                      \
+    if (( ( m )->work = work_get(( m )->g)) == NULL)                          \
+    return REG_ESPACE;                                                        \
+    ( m )->space = (uint64_t *)(void *)( m )->work->space;                    \
+    ( m )->vn = 0;                                                            \
+  }
+
+#define SETUP(v) (( v ) = &m->space[m->vn++ *MWORDS(m->g)] )
+#define onestate long
+#define INIT(o, n) (( o ) = ( n ))
+#define INC(o) (( o )++ )
+#define ISSTATEIN(v, o) ISSET(v, o)
+/* some abbreviations; note that some of these know variable names! */
+/* do "if I'm here, I can also be there" etc without branches */
+#define FWD(dst, src, n)                                                      \
+  (( dst )[( here + ( n )) >> 6]                                              \
+     |= ISSET(src, here) << (( here + ( n )) & 63 ))
+#define BACK(dst, src, n)                                                     \
+  (( dst )[( here - ( n )) >> 6]                                              \
+     |= ISSET(src, here) << (( here - ( n )) & 63 ))
+#define ISSETBACK(v, n) ISSET(v, here - ( n ))
+/* function names */
+#define MNAMES /* flag */
+
+#include "engine.c"
+
 /*
  * - regexec - interface for matching
  *
@@ -184,12 +1056,42 @@ regexec(const regex_t *preg, const char *string, size_t nmatch,
 
   eflags = GOODFLAGS(eflags);
 
+  if (g->iflags & LITERAL && !( eflags & ( REG_LARGE | REG_BACKR )))
+    {
+      return litmatcher(g, string, nmatch, pmatch, eflags);
+    }
+
   if (g->nstates <= CHAR_BIT * sizeof ( states1 ) && !( eflags & REG_LARGE ))
     {
       return smatcher(g, string, nmatch, pmatch, eflags);
     }
+  else if (g->cmask != NULL && !( eflags & REG_LARGE ))
+    {
+      return mmatcher(g, string, nmatch, pmatch, eflags);
+    }
   else
     {
       return lmatcher(g, string, nmatch, pmatch, eflags);
     }
 }
+
+/*
+ * - regscan - find where a match could start its must string
+ *
+ * Every match contains the must string, so text before its first
+ * occurrence, or text without one, can be skipped without calling
+ * regexec().  Returns the first occurrence, the text itself if there
+ * is no must string, or NULL if there is no occurrence.
+ */
+const char *
+regscan(const regex_t *preg, const char *string, size_t len)
+{
+  struct re_guts *g = preg->re_g;
+
+  if (preg->re_magic != MAGIC1 || g->magic != MAGIC2 || g->must == NULL)
+    {
+      return string;
+    }
+
+  return mustfind(g, string, len);
+}
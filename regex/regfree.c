@@ -48,6 +48,7 @@
 #include <bsd_stdlib.h>
 #include <bsd_regex.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "utils.h"
 #include "bsd_regex2.h"
@@ -59,6 +60,8 @@ void
 regfree(regex_t *preg)
 {
         struct re_guts *g;
+        struct re_dfa *d;
+        struct re_work *w;
 
         if (preg->re_magic != MAGIC1)           /* oops */
                 return;                         /* nice to complain, but hard */
@@ -73,5 +76,28 @@ regfree(regex_t *preg)
         free(g->sets);
         free(g->setbits);
         free(g->must);
+        free(g->cmask);
+        free(g->cskip);
+        while ((d = g->dfa) != NULL) {
+                g->dfa = d->next;
+                free(d->hash);
+                free(d->trans);
+                free(d->sets);
+                free(d->kind);
+                free(d->fresh);
+                free(d->acc);
+                free(d->start);
+                free(d->tmp);
+                free(d->aft);
+                free(d);
+        }
+        while ((w = g->work) != NULL) {
+                g->work = w->next;
+                free(w->space);
+                free(w->pmatch);
+                free(w->lastpos);
+                free(w);
+        }
+        (void)pthread_mutex_destroy(&g->lock);
         free(g);
 }
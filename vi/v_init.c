@@ -83,8 +83,14 @@ v_screen_end(SCR *sp)
         if ((vip = VIP(sp)) == NULL)
                 return (0);
         free(vip->keyw);
+        free(vip->isrch_miss);
         free(vip->rep);
         free(vip->ps);
+        free(vip->wc_col);
+        free(vip->wc_pos);
+        free(vip->rs_row);
+        free(vip->rs_buf);
+        free(vip->rs_inv);
         free(HMAP);
         free(vip);
         sp->vi_private = NULL;
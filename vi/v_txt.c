@@ -40,7 +40,9 @@ static int       txt_fc(SCR *, TEXT *, int *);
 static int       txt_fc_col(SCR *, int, ARGS **);
 static int       txt_hex(SCR *, TEXT *);
 static int       txt_insch(SCR *, TEXT *, CHAR_T *, unsigned int);
+static int       txt_insrun(SCR *, TEXT *, size_t *, u_int32_t, u_int32_t);
 static int       txt_isrch(SCR *, VICMD *, TEXT *, u_int8_t *);
+static int       txt_isrch_lit(char *, size_t);
 static int       txt_map_end(SCR *);
 static int       txt_map_init(SCR *);
 static int       txt_margin(SCR *, TEXT *, TEXT *, int *, u_int32_t);
@@ -453,6 +455,7 @@ newtp:          if ((tp = text_init(sp, lp, len, len + 32)) == NULL)
         nochange = 0;
         FL_INIT(is_flags,
             LF_ISSET(TXT_SEARCHINCR) ? IS_RESTART | IS_RUNNING : 0);
+        vip->isrch_mlen = 0;
         filec_redraw = hexcnt = showmatch = 0;
 
         /* Initialize input flags. */
@@ -1328,6 +1331,19 @@ insl_ch:        if (txt_insch(sp, tp, &evp->e_c, flags))
                         }
                 }
 
+                /*
+                 * If more plain characters are already queued, e.g., text is
+                 * being pasted, insert them all at once instead of resolving
+                 * the line for each one.  Anything that needs the per-key
+                 * checks above stops the run.
+                 */
+                if (KEYS_WAITING(sp) && margin == 0 && quote == Q_NOTSET &&
+                    hexcnt == 0 && abb == AB_NOTSET && tp->owrite == 0 &&
+                    !LF_ISSET(TXT_CEDIT | TXT_FILEC | TXT_REPLAY) &&
+                    !FL_ISSET(is_flags, IS_RUNNING) && !(UNMAP_TST) &&
+                    txt_insrun(sp, tp, &rcol, ec_flags, flags))
+                        goto err;
+
                 /*
                  * If we've reached the end of the buffer, then we need to
                  * switch into insert mode.  This happens when there's a
@@ -2504,6 +2520,42 @@ txt_insch(SCR *sp, TEXT *tp, CHAR_T *chp, unsigned int flags)
         return (0);
 }
 
+/*
+ * txt_insrun --
+ *      Insert the run of plain characters at the front of the input queue.
+ */
+static int
+txt_insrun(SCR *sp, TEXT *tp,
+    size_t *rcolp, u_int32_t ec_flags, u_int32_t flags)
+{
+        EVENT *evp;
+        VI_PRIVATE *vip;
+        size_t len;
+        char *p;
+
+        evp = v_event_run(sp, &len, ec_flags);
+        if (len == 0)
+                return (0);
+
+        /* Record the characters for the dot command. */
+        if (LF_ISSET(TXT_RECORD)) {
+                vip = VIP(sp);
+                BINC_RET(sp, vip->rep,
+                    vip->rep_len, (*rcolp + len) * sizeof(EVENT));
+                memcpy(vip->rep + *rcolp, evp, len * sizeof(EVENT));
+                *rcolp += len;
+        }
+
+        /* Open a gap in front of any insert characters and fill it. */
+        BINC_RET(sp, tp->lb, tp->lb_len, tp->len + len);
+        if (tp->insert != 0)
+                memmove(tp->lb + tp->cno + len,
+                    tp->lb + tp->cno, tp->insert);
+        for (p = tp->lb + tp->cno, tp->cno += len, tp->len += len; len--;)
+                *p++ = (evp++)->e_c;
+        return (0);
+}
+
 /*
  * txt_isrch --
  *      Do an incremental search.
@@ -2512,8 +2564,10 @@ static int
 txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
 {
         MARK start;
+        VI_PRIVATE *vip;
         recno_t lno;
         unsigned int sf;
+        int lit;
 
         /* If it's a one-line screen, we don't do incrementals. */
         if (IS_ONELINE(sp)) {
@@ -2560,6 +2614,25 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
                 return (0);
         }
 
+        /*
+         * If more input is waiting, the pattern is about to change, wait
+         * for it.  The search picks up from the same place.
+         */
+        if (INPUT_WAITING(sp))
+                return (0);
+
+        /*
+         * If a literal pattern wasn't found, adding characters to it won't
+         * find it either.  Searches from the starting point can't, and if
+         * the search wrapped, no search can.
+         */
+        vip = VIP(sp);
+        lit = txt_isrch_lit(tp->lb + 1, tp->cno - 1);
+        if (lit && FL_ISSET(*is_flagsp, IS_RESTART) &&
+            vip->isrch_mlen != 0 && vip->isrch_mlen <= tp->cno &&
+            !memcmp(vip->isrch_miss, tp->lb, vip->isrch_mlen))
+                return (0);
+
         /*
          * Remember the input line and discard the special input map,
          * but don't overwrite the input line on the screen.
@@ -2579,10 +2652,10 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
          */
         if (FL_ISSET(*is_flagsp, IS_RESTART)) {
                 start = vp->m_start;
-                sf = SEARCH_SET;
+                sf = SEARCH_KEYS | SEARCH_SET;
         } else {
                 start = vp->m_final;
-                sf = SEARCH_INCR | SEARCH_SET;
+                sf = SEARCH_INCR | SEARCH_KEYS | SEARCH_SET;
         }
 
         if (tp->lb[0] == '/' ?
@@ -2594,10 +2667,20 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
                 sp->cno = vp->m_final.cno;
                 FL_CLR(*is_flagsp, IS_RESTART);
 
-                if (!KEYS_WAITING(sp) && vs_refresh(sp, 0))
+                if (!INPUT_WAITING(sp) && vs_refresh(sp, 0))
                         return (1);
-        } else
+        } else {
+                /* Remember a literal that wasn't found, unless cut short. */
+                if (lit && !INPUT_WAITING(sp) &&
+                    (FL_ISSET(*is_flagsp, IS_RESTART) ||
+                    O_ISSET(sp, O_WRAPSCAN))) {
+                        BINC_RET(sp,
+                            vip->isrch_miss, vip->isrch_mblen, tp->cno);
+                        memcpy(vip->isrch_miss, tp->lb, tp->cno);
+                        vip->isrch_mlen = tp->cno;
+                }
                 FL_SET(*is_flagsp, IS_RESTART);
+        }
 
         /* Reinstantiate the special input map. */
         if (txt_map_init(sp))
@@ -2624,6 +2707,20 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
         return (0);
 }
 
+/*
+ * txt_isrch_lit --
+ *      Return if an incremental search pattern is a literal string, i.e.,
+ *      has no characters that are special with any of the RE options.
+ */
+static int
+txt_isrch_lit(char *p, size_t len)
+{
+        for (; len > 0; ++p, --len)
+                if (strchr("\\^$.[]*~+?(){}|", *p) != NULL)
+                        return (0);
+        return (1);
+}
+
 /*
  * txt_resolve --
  *      Resolve the input text chain into the file.
@@ -219,10 +219,46 @@ typedef struct _smap {
         u_int8_t c_scoff;       /* 0-N: offset into the first character. */
         u_int8_t c_eclen;       /* 1-N: columns from the last character. */
         u_int8_t c_ecsize;      /* 1-N: size of the last character. */
+
+                                /* vs_line() search match cache. */
+#define SMAP_HLMAX      8       /* Matches cached per screen line. */
+        recno_t  c_hllno;       /* 1-N: line the matches are from. */
+        unsigned int c_hltag;   /* 1-N: VI_PRIVATE hl_tag when found. */
+        size_t   c_hloff;       /* 0-N: matches end after this offset. */
+        size_t   c_hl[SMAP_HLMAX][2];   /* Match start/end offsets. */
+        u_int8_t c_hlcnt;       /* 0-N: number of cached matches. */
+        u_int8_t c_hlon;        /* Matches were highlighted. */
 } SMAP;
                                 /* Macros to flush/test cached information. */
 #define SMAP_CACHE(smp)         ((smp)->c_ecsize != 0)
 #define SMAP_FLUSH(smp)         ((smp)->c_ecsize = 0)
+#define SMAP_HLCACHE(vip, smp, off)                                     \
+        ((smp)->c_hllno == (smp)->lno &&                                \
+        (smp)->c_hltag == (vip)->hl_tag && (smp)->c_hloff <= (off))
+
+/*
+ * Column checkpoints for the line in the width cache, so that finding a
+ * column in a long line starts from the last checkpoint before it rather
+ * than from the start of the line.  See vs_relative.c.
+ */
+#define VS_CKBYTES      4096    /* Bytes between checkpoints. */
+typedef struct _vs_ck {
+        size_t   off;           /* 0-N: byte offset in the line. */
+        size_t   scno;          /* 0-N: screen column before the byte. */
+        size_t   curoff;        /* vs_columns: column in the screen. */
+        size_t   screens;       /* vs_colpos: screens passed. */
+} VS_CK;
+
+/*
+ * Row shadow.  Vs_line builds each screen row in a buffer before handing it
+ * to the screen, and remembers a hash of what it wrote and the screen's
+ * write generation for the row afterward.  If neither has changed the next
+ * time the row is painted, the row is still on the screen and is skipped.
+ */
+typedef struct _vs_row {
+        u_int64_t hash;         /* Hash of the row's characters. */
+        u_long   gen;           /* Screen write generation, 0 if unknown. */
+} VS_ROW;
 
                                 /* Character search information. */
 typedef enum { CNOTSET, FSEARCH, fSEARCH, TSEARCH, tSEARCH } cdir_t;
@@ -275,6 +311,13 @@ typedef struct _vi_private {
         CHAR_T  lastckey;       /* Last search character. */
         cdir_t  csearchdir;     /* Character search direction. */
 
+        char   *isrch_miss;     /* Incremental search: literal not found. */
+        size_t  isrch_mlen;     /* Incremental search: its length. */
+        size_t  isrch_mblen;    /* Incremental search: buffer length. */
+
+        unsigned int hl_gen;    /* Highlighted search RE generation. */
+        unsigned int hl_tag;    /* Search match cache tag. */
+
         SMAP   *h_smap;         /* First slot of the line map. */
         SMAP   *t_smap;         /* Last slot of the line map. */
 
@@ -306,7 +349,29 @@ typedef struct _vi_private {
 
         recno_t ss_lno; /* 1-N: vi_opt_screens cached line number. */
         size_t  ss_screens;     /* vi_opt_screens cached return value. */
-#define VI_SCR_CFLUSH(vip)      ((vip)->ss_lno = OOBLNO)
+
+        recno_t wc_lno;         /* 1-N: width cache line number. */
+        EXF    *wc_ep;          /* Width cache file. */
+        u_long  wc_chg;         /* Width cache file change count. */
+        size_t  wc_scno;        /* vs_columns: line width, less any '$'. */
+        size_t  wc_last;        /* vs_columns: width before last char. */
+        VS_CK  *wc_col;         /* vs_columns: checkpoints. */
+        size_t  wc_ncol;        /* vs_columns: checkpoint count, or 0. */
+        VS_CK  *wc_pos;         /* vs_colpos: checkpoints. */
+        size_t  wc_npos;        /* vs_colpos: checkpoint count, or 0. */
+#define VI_SCR_CFLUSH(vip)      ((vip)->ss_lno = (vip)->wc_lno = OOBLNO)
+
+        VS_ROW *rs_row;         /* Row shadow, one per map slot. */
+        size_t  rs_nrow;        /* Row shadow slots. */
+        char   *rs_buf;         /* Row being painted: characters. */
+        size_t  rs_blen;        /* Row being painted: character space. */
+        char   *rs_inv;         /* Row being painted: inverse video. */
+        size_t  rs_ilen;        /* Row being painted: inverse space. */
+        size_t  rs_len;         /* Row being painted: length. */
+        int     rs_clr;         /* Row being painted: clear to EOL. */
+        u_long  rs_paint;       /* Refresh: rows written. */
+        u_long  rs_skip;        /* Refresh: rows left alone. */
+        u_long  rs_bytes;       /* Refresh: bytes written. */
 
         size_t  srows;          /* 1-N: rows in the terminal/window. */
         recno_t olno;           /* 1-N: old cursor file line. */
@@ -19,11 +19,30 @@
 #include <bitstring.h>
 #include <limits.h>
 #include <stdio.h>
+#include <bsd_stdlib.h>
 #include <bsd_string.h>
 
 #include "../common/common.h"
 #include "vi.h"
 
+/*
+ * Runs of plain characters are found 16 bytes at a time where SSE2 is
+ * available.
+ */
+#if defined(__GNUC__) && defined(__SSE2__) \
+    && ( defined(__x86_64__) || defined(__i386__))
+# include <immintrin.h>
+# define VS_SSE2
+#endif /* if defined(__GNUC__) && defined(__SSE2__) ... */
+
+static void     vs_hl_fill(SCR *, SMAP *, char *, size_t, size_t);
+static int      vs_hl_match(SCR *, char *, size_t, size_t, size_t *, size_t *);
+static int      vs_hl_next(SCR *,
+                    SMAP *, char *, size_t, size_t *, size_t *, size_t *);
+static size_t   vs_plain(const char *, size_t);
+static int      vs_row_add(SCR *, const char *, size_t, int);
+static void     vs_row_flush(SCR *, size_t);
+
 /*
  * vs_line --
  *      Update one line on the screen.
@@ -36,12 +55,14 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
         CHAR_T *kp;
         GS *gp;
         SMAP *tsmp;
+        VI_PRIVATE *vip;
         size_t chlen = 0, cno_cnt, cols_per_screen, len, nlen;
         size_t offset_in_char, offset_in_line, oldx, oldy;
         size_t scno, skip_cols, skip_screens;
+        size_t hl_eo, hl_i, hl_so, run;
         int ch = 0, dne, is_cached, is_partial, is_tab, no_draw;
-        int list_tab, list_dollar;
-        char *p, *cbp, *ecbp, cbuf[128];
+        int hl, hl_on, list_tab, list_dollar, plain;
+        char *lp, *p, *cbp, *ecbp, cbuf[128];
 
 #if defined(DEBUG) && 0
         TRACE(sp, "vs_line: row %u: line: %u off: %u\n",
@@ -78,11 +99,15 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
          * return to wherever we started from.
          */
         gp = sp->gp;
+        vip = VIP(sp);
+        vip->rs_len = 0;
+        vip->rs_clr = 0;
         (void)gp->scr_cursor(sp, &oldy, &oldx);
         (void)gp->scr_move(sp, smp - HMAP, 0);
 
         /* Get the line. */
         dne = db_get(sp, smp->lno, 0, &p, &len);
+        lp = p;
 
         /*
          * Special case if we're printing the info/mode line.  Skip printing
@@ -133,7 +158,8 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
                                     O_NUMBER_FMT, (unsigned long)smp->lno);
                                 if (nlen >= sizeof(cbuf))
                                         nlen = sizeof(cbuf) - 1;
-                                (void)gp->scr_addstr(sp, cbuf, nlen);
+                                if (vs_row_add(sp, cbuf, nlen, 0))
+                                        return (1);
                         }
                 }
         }
@@ -157,6 +183,7 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
                 /* Set line cache information. */
                 smp->c_sboff = smp->c_eboff = 0;
                 smp->c_scoff = smp->c_eclen = 0;
+                smp->c_hlon = 0;
 
                 /*
                  * Lots of special cases for empty lines, but they only apply
@@ -176,12 +203,14 @@ vs_line(SCR *sp, SMAP *smp, size_t *yp, size_t *xp)
                         } else
                                 if (list_dollar) {
                                         ch = '$';
-empty:                                  (void)gp->scr_addstr(sp,
-                                            KEY_NAME(sp, ch), KEY_LEN(sp, ch));
+empty:                                  if (vs_row_add(sp, KEY_NAME(sp, ch),
+                                            KEY_LEN(sp, ch), 0))
+                                                return (1);
                                 }
                 }
 
-                (void)gp->scr_clrtoeol(sp);
+                vip->rs_clr = 1;
+                vs_row_flush(sp, smp - HMAP);
                 (void)gp->scr_move(sp, oldy, oldx);
                 return (0);
         }
@@ -323,9 +352,84 @@ display:
 
         ecbp = (cbp = cbuf) + sizeof(cbuf) - 1;
 
+        /*
+         * If highlighting search matches, find the matches for this part of
+         * the line, unless they're cached from the last time it was painted.
+         * The colon command line is never highlighted.
+         */
+        hl = !is_cached && !no_draw && vip->hl_gen != 0 &&
+            vip->hl_gen == sp->re_gen && F_ISSET(sp, SC_RE_SEARCH) &&
+            (!F_ISSET(sp, SC_TINPUT_INFO) || smp != TMAP);
+        if (hl && !SMAP_HLCACHE(vip, smp, offset_in_line))
+                vs_hl_fill(sp, smp, lp, len, offset_in_line);
+        if (!is_cached)
+                smp->c_hlon = 0;
+        hl_i = hl_so = hl_eo = 0;
+        hl_on = 0;
+
+        /*
+         * Printable ASCII characters display as themselves, unless the
+         * noprint option says otherwise.
+         */
+        plain = !is_cached &&
+            (O_STR(sp, O_NOPRINT) == NULL || *O_STR(sp, O_NOPRINT) == '\0');
+
+#define FLUSH(gp, sp, cbp, cbuf) do {                                   \
+        if (vs_row_add((sp), (cbuf), (cbp) - (cbuf), hl_on))            \
+                return (1);                                             \
+        (cbp) = (cbuf);                                                 \
+} while (0)
+
         /* This is the loop that actually displays characters. */
         for (is_partial = 0, scno = 0;
             offset_in_line < len; ++offset_in_line, offset_in_char = 0) {
+                /* Turn highlighting on or off at match boundaries. */
+                if (hl) {
+                        while (offset_in_line >= hl_eo)
+                                if (!vs_hl_next(sp, smp,
+                                    lp, len, &hl_i, &hl_so, &hl_eo)) {
+                                        hl = 0;
+                                        break;
+                                }
+                        if ((hl && offset_in_line >= hl_so) != hl_on) {
+                                if (cbp > cbuf)
+                                        FLUSH(gp, sp, cbp, cbuf);
+                                hl_on = !hl_on;
+                                if (hl_on)
+                                        smp->c_hlon = 1;
+                        }
+                }
+
+                /*
+                 * Copy a run of printable ASCII characters into the row in
+                 * one piece.  The run stops short of the right-hand column,
+                 * the cursor character and the next highlighting boundary,
+                 * which are left to the code below.
+                 */
+                if (plain && offset_in_char == 0) {
+                        run = len - offset_in_line;
+                        if (run > cols_per_screen - scno - 1)
+                                run = cols_per_screen - scno - 1;
+                        if (cno_cnt && run > cno_cnt - 1)
+                                run = cno_cnt - 1;
+                        if (hl && run >
+                            (hl_on ? hl_eo : hl_so) - offset_in_line)
+                                run = (hl_on ? hl_eo : hl_so) - offset_in_line;
+                        if (run > 1 && (run = vs_plain(p, run)) > 1) {
+                                if (cbp > cbuf)
+                                        FLUSH(gp, sp, cbp, cbuf);
+                                if (vs_row_add(sp, p, run, hl_on))
+                                        return (1);
+                                if (cno_cnt)
+                                        cno_cnt -= run;
+                                scno += run;
+                                p += run;
+                                ch = (unsigned char)p[-1];
+                                offset_in_line += run - 1;
+                                continue;
+                        }
+                }
+
                 if ((ch = *(unsigned char *)p++) == '\t' && !list_tab) {
                         scno += chlen = TAB_OFF(scno) - offset_in_char;
                         is_tab = 1;
@@ -392,11 +496,6 @@ display:
                 if (is_cached)
                         continue;
 
-#define FLUSH(gp, sp, cbp, cbuf) do {                                   \
-        *(cbp) = '\0';                                                  \
-        (void)(gp)->scr_addstr((sp), (cbuf), (cbp) - (cbuf));           \
-        (cbp) = (cbuf);                                                 \
-} while (0)
                 /*
                  * Display the character.  We do tab expansion here because
                  * the screen interface doesn't have any way to set the tab
@@ -421,6 +520,12 @@ display:
                 }
         }
 
+        if (hl_on) {
+                if (cbp > cbuf)
+                        FLUSH(gp, sp, cbp, cbuf);
+                hl_on = 0;
+        }
+
         if (scno < cols_per_screen) {
                 /* If we didn't paint the whole line, update the cache. */
                 smp->c_ecsize = smp->c_eclen = KEY_LEN(sp, ch);
@@ -443,14 +548,263 @@ display:
 
                 /* If still didn't paint the whole line, clear the rest. */
                 if (scno < cols_per_screen)
-                        (void)gp->scr_clrtoeol(sp);
+                        vip->rs_clr = 1;
         }
 
         /* Flush any buffered characters. */
         if (cbp > cbuf)
                 FLUSH(gp, sp, cbp, cbuf);
 
-ret1:   (void)gp->scr_move(sp, oldy, oldx);
+ret1:   vs_row_flush(sp, smp - HMAP);
+        (void)gp->scr_move(sp, oldy, oldx);
+        return (0);
+}
+
+/*
+ * vs_plain --
+ *      Return the length of the run of printable ASCII characters at
+ *      the start of the string.
+ */
+static size_t
+vs_plain(const char *p, size_t len)
+{
+        size_t i;
+#ifdef VS_SSE2
+        __m128i v;
+        unsigned int m;
+
+        for (i = 0; i + 16 <= len; i += 16) {
+                v = _mm_loadu_si128((const __m128i *)(const void *)(p + i));
+                m = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)),
+                    _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f))));
+                if (m != 0xffff)
+                        return (i + __builtin_ctz(~m));
+        }
+#else
+        i = 0;
+#endif /* ifdef VS_SSE2 */
+        for (; i < len; ++i)
+                if ((unsigned char)p[i] < 0x20 || (unsigned char)p[i] > 0x7e)
+                        break;
+        return (i);
+}
+
+/*
+ * vs_row_add --
+ *      Append characters to the screen row being painted.
+ */
+static int
+vs_row_add(SCR *sp, const char *p, size_t len, int inverse)
+{
+        VI_PRIVATE *vip;
+
+        vip = VIP(sp);
+        BINC_RET(sp, vip->rs_buf, vip->rs_blen, vip->rs_len + len);
+        BINC_RET(sp, vip->rs_inv, vip->rs_ilen, vip->rs_len + len);
+        memcpy(vip->rs_buf + vip->rs_len, p, len);
+        memset(vip->rs_inv + vip->rs_len, inverse, len);
+        vip->rs_len += len;
+        return (0);
+}
+
+/*
+ * vs_row_flush --
+ *      Hand the screen row being painted to the screen, unless it is
+ *      exactly what was last handed to it for the row and the screen
+ *      hasn't written to the row since.
+ *
+ * Painting a row always starts at its first column, so writing the same
+ * characters to an untouched row again can't change it.  The info line is
+ * always written, the screen may use inverse video there.
+ */
+static void
+vs_row_flush(SCR *sp, size_t row)
+{
+        GS *gp;
+        VI_PRIVATE *vip;
+        VS_ROW *rp;
+        u_int64_t h;
+        u_long gen;
+        size_t i, j;
+
+        vip = VIP(sp);
+        if (vip->rs_len == 0 && !vip->rs_clr)
+                return;
+
+        /* Size the shadow to the map; a new shadow knows nothing. */
+        gp = sp->gp;
+        if (vip->rs_nrow < SIZE_HMAP(sp)) {
+                free(vip->rs_row);
+                vip->rs_nrow = (vip->rs_row =
+                    calloc(SIZE_HMAP(sp), sizeof(VS_ROW))) == NULL ?
+                    0 : SIZE_HMAP(sp);
+        }
+        rp = row < vip->rs_nrow && row < LASTLINE(sp) &&
+            gp->scr_rowgen != NULL ? vip->rs_row + row : NULL;
+
+        /* FNV-1a over the characters, their video and the clear. */
+        h = 0xcbf29ce484222325ULL;
+        for (i = 0; i < vip->rs_len; ++i) {
+                h = (h ^ (u_char)vip->rs_buf[i]) * 0x100000001b3ULL;
+                h = (h ^ (u_char)vip->rs_inv[i]) * 0x100000001b3ULL;
+        }
+        h = (h ^ (u_int64_t)vip->rs_clr) * 0x100000001b3ULL;
+
+        if (rp != NULL && rp->gen != 0 && rp->hash == h &&
+            !gp->scr_rowgen(sp, row, &gen) && gen == rp->gen) {
+                ++vip->rs_skip;
+                goto done;
+        }
+
+        for (i = 0; i < vip->rs_len; i = j) {
+                for (j = i + 1;
+                    j < vip->rs_len && vip->rs_inv[j] == vip->rs_inv[i]; ++j)
+                        continue;
+                if (vip->rs_inv[i])
+                        (void)gp->scr_attr(sp, SA_INVERSE, 1);
+                (void)gp->scr_addstr(sp, vip->rs_buf + i, j - i);
+                if (vip->rs_inv[i])
+                        (void)gp->scr_attr(sp, SA_INVERSE, 0);
+        }
+        if (vip->rs_clr)
+                (void)gp->scr_clrtoeol(sp);
+        ++vip->rs_paint;
+        vip->rs_bytes += vip->rs_len;
+
+        if (rp != NULL) {
+                rp->hash = h;
+                if (gp->scr_rowgen(sp, row, &rp->gen))
+                        rp->gen = 0;
+        }
+
+done:   vip->rs_len = 0;
+        vip->rs_clr = 0;
+}
+
+/*
+ * vs_hl_refresh --
+ *      Update search match highlighting after the search RE or the
+ *      hlsearch option changed, repainting only the screen lines whose
+ *      highlighting can differ.
+ *
+ * PUBLIC: int vs_hl_refresh(SCR *);
+ */
+int
+vs_hl_refresh(SCR *sp)
+{
+        SMAP *smp;
+        VI_PRIVATE *vip;
+        size_t len;
+        unsigned int gen;
+        char *p;
+
+        vip = VIP(sp);
+
+        /* The RE may need compiling, e.g., an option changed. */
+        gen = 0;
+        if (O_ISSET(sp, O_HLSEARCH) && sp->re != NULL) {
+                if (!F_ISSET(sp, SC_RE_SEARCH))
+                        (void)re_compile(sp, sp->re, sp->re_len,
+                            NULL, NULL, &sp->re_c, RE_C_SEARCH | RE_C_SILENT);
+                if (F_ISSET(sp, SC_RE_SEARCH))
+                        gen = sp->re_gen;
+        }
+        if (gen == vip->hl_gen)
+                return (0);
+        vip->hl_gen = gen;
+        ++vip->hl_tag;
+
+        /* If the screen is being repainted anyway, we're done. */
+        if (F_ISSET(sp, SC_SCR_REFORMAT | SC_SCR_REDRAW))
+                return (0);
+
+        /*
+         * A line that was highlighted has to be repainted.  A line that
+         * wasn't, only if one of the new matches is on it.
+         */
+        for (smp = HMAP; smp <= TMAP; ++smp) {
+                if (!smp->c_hlon) {
+                        if (gen == 0 ||
+                            db_get(sp, smp->lno, 0, &p, &len) || len == 0)
+                                continue;
+                        if (SMAP_CACHE(smp)) {
+                                vs_hl_fill(sp, smp, p, len, smp->c_sboff);
+                                if (smp->c_hlcnt == 0 ||
+                                    smp->c_hl[0][0] > smp->c_eboff)
+                                        continue;
+                        }
+                }
+                SMAP_FLUSH(smp);
+                if (vs_line(sp, smp, NULL, NULL))
+                        return (1);
+        }
+        return (0);
+}
+
+/*
+ * vs_hl_fill --
+ *      Cache the first search matches in a line that end after an offset.
+ */
+static void
+vs_hl_fill(SCR *sp, SMAP *smp, char *lp, size_t len, size_t off)
+{
+        size_t eo, from, so;
+
+        smp->c_hllno = smp->lno;
+        smp->c_hltag = VIP(sp)->hl_tag;
+        smp->c_hloff = off;
+        for (smp->c_hlcnt = 0, from = 0; smp->c_hlcnt < SMAP_HLMAX &&
+            vs_hl_match(sp, lp, len, from, &so, &eo); from = eo)
+                if (eo > off) {
+                        smp->c_hl[smp->c_hlcnt][0] = so;
+                        smp->c_hl[smp->c_hlcnt][1] = eo;
+                        ++smp->c_hlcnt;
+                }
+}
+
+/*
+ * vs_hl_next --
+ *      Return the search match following the current one, from the cache
+ *      while it lasts.
+ */
+static int
+vs_hl_next(SCR *sp, SMAP *smp,
+    char *lp, size_t len, size_t *ip, size_t *sop, size_t *eop)
+{
+        if (*ip < smp->c_hlcnt) {
+                *sop = smp->c_hl[*ip][0];
+                *eop = smp->c_hl[*ip][1];
+                ++*ip;
+                return (1);
+        }
+        if (smp->c_hlcnt < SMAP_HLMAX)
+                return (0);
+        return (vs_hl_match(sp, lp, len, *eop, sop, eop));
+}
+
+/*
+ * vs_hl_match --
+ *      Find the next non-empty search match in a line.
+ */
+static int
+vs_hl_match(SCR *sp, char *lp, size_t len, size_t from, size_t *sop,
+    size_t *eop)
+{
+        regmatch_t match[1];
+
+        for (; from < len; from = match[0].rm_eo + 1) {
+                match[0].rm_so = from;
+                match[0].rm_eo = len;
+                if (regexec(&sp->re_c, lp, 1, match,
+                    (from == 0 ? 0 : REG_NOTBOL) | REG_STARTEND) != 0)
+                        return (0);
+                if (match[0].rm_so < match[0].rm_eo) {
+                        *sop = match[0].rm_so;
+                        *eop = match[0].rm_eo;
+                        return (1);
+                }
+        }
         return (0);
 }
 
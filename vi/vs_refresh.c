@@ -419,6 +419,10 @@ adjust: if (!O_ISSET(sp, O_LEFTRIGHT) &&
                 }
         }
 
+        /* Update search match highlighting, the RE may have changed. */
+        if (vs_hl_refresh(sp))
+                return (1);
+
         /*
          * If the screen needs to be repainted, skip cursor optimization.
          * However, in the code above we skipped leftright scrolling on
@@ -748,8 +752,14 @@ number: if (O_ISSET(sp, O_NUMBER) &&
                         (void)vs_column(sp, &sp->rcm);
         }
 
-        if (LF_ISSET(UPDATE_SCREEN))
+        if (LF_ISSET(UPDATE_SCREEN)) {
+#ifdef DEBUG
+                TRACE(sp, "vs_paint: %lu rows, %lu bytes, %lu rows skipped\n",
+                    vip->rs_paint, vip->rs_bytes, vip->rs_skip);
+#endif /* ifdef DEBUG */
+                vip->rs_paint = vip->rs_bytes = vip->rs_skip = 0;
                 (void)gp->scr_refresh(sp, F_ISSET(vip, VIP_N_EX_PAINT));
+        }
 
         /* 12: Clear the flags that are handled by this routine. */
         F_CLR(sp, SC_SCR_CENTER | SC_SCR_REDRAW | SC_SCR_REFORMAT | SC_SCR_TOP);
@@ -866,7 +876,7 @@ vs_modeline(SCR *sp)
         cols = sp->cols - 1;
         if (O_ISSET(sp, O_RULER)) {
             vs_column(sp, &curcol);
-            if (!(db_last(sp, &last))) {
+            if (!db_partial(sp) && !db_last(sp, &last)) {
                   if (last > 1) {
                     len = snprintf(buf, sizeof(buf), "%lu:%lu  %2lu%%",
                         (unsigned long)sp->lno, (unsigned long)curcol + 1,
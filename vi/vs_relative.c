@@ -19,11 +19,16 @@
 #include <bitstring.h>
 #include <limits.h>
 #include <stdio.h>
+#include <bsd_stdlib.h>
 #include <bsd_string.h>
 
 #include "../common/common.h"
 #include "vi.h"
 
+static VI_PRIVATE *vs_wc(SCR *, recno_t);
+static VS_CK *vs_ckcolumns(SCR *, recno_t, char *, size_t);
+static VS_CK *vs_ckcolpos(SCR *, recno_t, char *, size_t, size_t);
+
 /*
  * vs_column --
  *      Return the logical column of the cursor in the line.
@@ -97,7 +102,8 @@ vs_screens(SCR *sp, recno_t lno, size_t *cnop)
 size_t
 vs_columns(SCR *sp, char *lp, recno_t lno, size_t *cnop, size_t *diffp)
 {
-        size_t chlen, cno, curoff, last, len, scno;
+        VS_CK *ck;
+        size_t chlen, cno, curoff, last, len, scno, start;
         int ch, leftright, listset;
         char *p;
 
@@ -114,10 +120,13 @@ vs_columns(SCR *sp, char *lp, recno_t lno, size_t *cnop, size_t *diffp)
         }
 
         /* Need the line to go any further. */
+        ck = NULL;
         if (lp == NULL) {
                 (void)db_get(sp, lno, 0, &lp, &len);
                 if (len == 0)
                         goto done;
+                if (lp != NULL && len > VS_CKBYTES)
+                        ck = vs_ckcolumns(sp, lno, lp, len);
         }
 
         /* Missing or empty lines are easy. */
@@ -136,6 +145,28 @@ done:           if (diffp != NULL)              /* XXX */
          */
         p = lp;
         curoff = 0;
+        start = 0;
+
+        /*
+         * Long lines have the width cached, and checkpoints to start from
+         * when looking for a character.
+         */
+        if (ck != NULL) {
+                if (cnop == NULL) {
+                        scno = VIP(sp)->wc_scno;
+                        last = VIP(sp)->wc_last;
+                        len = 0;
+                } else {
+                        start = *cnop / VS_CKBYTES;
+                        if (start >= VIP(sp)->wc_ncol)
+                                start = VIP(sp)->wc_ncol - 1;
+                        ck += start;
+                        start = ck->off;
+                        p = lp + start;
+                        scno = ck->scno;
+                        curoff = ck->curoff;
+                }
+        }
 
         /* Macro to return the display length of any signal character. */
 #define CHLEN(val) (ch = *(unsigned char *)p++) == '\t' &&                     \
@@ -166,7 +197,7 @@ done:           if (diffp != NULL)              /* XXX */
                         TAB_RESET;
                 }
         else
-                for (cno = *cnop;; --cno) {
+                for (cno = *cnop - start;; --cno) {
                         chlen = CHLEN(curoff);
                         last = scno;
                         scno += chlen;
@@ -226,6 +257,7 @@ vs_rcm(SCR *sp, recno_t lno, int islast)
 size_t
 vs_colpos(SCR *sp, recno_t lno, size_t cno)
 {
+        VS_CK *ck;
         size_t chlen, curoff, len, llen, off, scno;
         int ch, leftright, listset;
         char *lp, *p;
@@ -244,7 +276,20 @@ vs_colpos(SCR *sp, recno_t lno, size_t cno)
         /* Discard screen (logical) lines. */
         off = cno / sp->cols;
         cno %= sp->cols;
-        for (scno = 0, p = lp, len = llen; off--;) {
+        scno = 0;
+        p = lp;
+        len = llen;
+
+        /* In a long line, start from the last checkpoint before them. */
+        if (off != 0 && llen > VS_CKBYTES &&
+            (ck = vs_ckcolpos(sp, lno, lp, llen, off)) != NULL) {
+                p = lp + ck->off;
+                len = llen - ck->off;
+                scno = ck->scno;
+                off -= ck->screens;
+        }
+
+        for (; off--;) {
                 for (; len && scno < sp->cols; --len)
                         scno += CHLEN(scno);
 
@@ -295,3 +340,139 @@ vs_colpos(SCR *sp, recno_t lno, size_t cno)
         /* No such character; return the start of the last character. */
         return (llen - 1);
 }
+
+/*
+ * vs_wc --
+ *      Return the vi private area, with the width cache emptied unless
+ *      it's for this line and nothing has changed since it was filled.
+ */
+static VI_PRIVATE *
+vs_wc(SCR *sp, recno_t lno)
+{
+        VI_PRIVATE *vip;
+
+        vip = VIP(sp);
+        if (vip->wc_lno != lno ||
+            vip->wc_ep != sp->ep || vip->wc_chg != sp->ep->c_chg) {
+                vip->wc_lno = lno;
+                vip->wc_ep = sp->ep;
+                vip->wc_chg = sp->ep->c_chg;
+                vip->wc_ncol = vip->wc_npos = 0;
+        }
+        return (vip);
+}
+
+/*
+ * vs_ckcolumns --
+ *      Return the vs_columns checkpoints for a line, one every VS_CKBYTES
+ *      bytes, filling them in and caching the line width if need be.
+ */
+static VS_CK *
+vs_ckcolumns(SCR *sp, recno_t lno, char *lp, size_t len)
+{
+        VI_PRIVATE *vip;
+        VS_CK *ck;
+        size_t chlen, curoff, last, n, off, scno;
+        int ch, leftright, listset;
+        char *p;
+
+        vip = vs_wc(sp, lno);
+        if (vip->wc_ncol != 0)
+                return (vip->wc_col);
+
+        n = (len - 1) / VS_CKBYTES + 1;
+        if ((ck = openbsd_reallocarray(vip->wc_col,
+            n, sizeof(VS_CK))) == NULL)
+                return (NULL);
+        vip->wc_col = ck;
+
+        /* The same walk as vs_columns, noting where it is at each one. */
+        listset = O_ISSET(sp, O_LIST);
+        leftright = O_ISSET(sp, O_LEFTRIGHT);
+        scno = last = O_ISSET(sp, O_NUMBER) ? O_NUMBER_LENGTH : 0;
+        curoff = 0;
+        for (p = lp, off = 0; off < len; ++off) {
+                if (off % VS_CKBYTES == 0) {
+                        ck->off = off;
+                        ck->scno = scno;
+                        ck->curoff = curoff;
+                        ++ck;
+                }
+                chlen = CHLEN(curoff);
+                last = scno;
+                scno += chlen;
+                TAB_RESET;
+        }
+
+        vip->wc_scno = scno;
+        vip->wc_last = last;
+        vip->wc_ncol = n;
+        return (vip->wc_col);
+}
+
+/*
+ * vs_ckcolpos --
+ *      Return the last vs_colpos checkpoint before a number of screens
+ *      have been discarded, filling the checkpoints in if need be.
+ */
+static VS_CK *
+vs_ckcolpos(SCR *sp, recno_t lno, char *lp, size_t len, size_t screens)
+{
+        VI_PRIVATE *vip;
+        VS_CK *ck;
+        size_t hi, lo, mid, n, next, nscr, off, scno;
+        int ch, leftright, listset;
+        char *p;
+
+        vip = vs_wc(sp, lno);
+        if (vip->wc_npos == 0) {
+                if ((ck = openbsd_reallocarray(vip->wc_pos,
+                    len / VS_CKBYTES + 1, sizeof(VS_CK))) == NULL)
+                        return (NULL);
+                vip->wc_pos = ck;
+
+                /*
+                 * The same walk as vs_colpos, discarding screens to the end
+                 * of the line.  A checkpoint is taken at the first character
+                 * after each VS_CKBYTES boundary that starts a screen or is
+                 * within one, so vs_colpos can take up from there.
+                 */
+                listset = O_ISSET(sp, O_LIST);
+                leftright = O_ISSET(sp, O_LEFTRIGHT);
+                ck->off = ck->scno = ck->curoff = ck->screens = 0;
+                next = VS_CKBYTES;
+                for (n = 1, nscr = scno = 0, p = lp, off = 0;;) {
+                        for (; off < len && scno < sp->cols; ++off) {
+                                if (off >= next) {
+                                        ck[n].off = off;
+                                        ck[n].scno = scno;
+                                        ck[n].curoff = 0;
+                                        ck[n].screens = nscr;
+                                        ++n;
+                                        next = off - off % VS_CKBYTES +
+                                            VS_CKBYTES;
+                                }
+                                scno += CHLEN(scno);
+                        }
+                        if (off == len)
+                                break;
+                        if (leftright && ch == '\t')
+                                scno = 0;
+                        else
+                                scno -= sp->cols;
+                        ++nscr;
+                }
+                vip->wc_npos = n;
+        }
+
+        /* The last checkpoint with fewer screens discarded. */
+        ck = vip->wc_pos;
+        for (lo = 0, hi = vip->wc_npos; hi - lo > 1;) {
+                mid = lo + (hi - lo) / 2;
+                if (ck[mid].screens < screens)
+                        lo = mid;
+                else
+                        hi = mid;
+        }
+        return (&ck[lo]);
+}
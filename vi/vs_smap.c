@@ -30,6 +30,9 @@ static int      vs_insertln(SCR *, int);
 static int      vs_sm_delete(SCR *, recno_t);
 static int      vs_sm_down(SCR *, MARK *, recno_t, scroll_t, SMAP *);
 static int      vs_sm_erase(SCR *);
+static void     vs_sm_hlchange(SCR *, recno_t, recno_t, lnop_t);
+static int      vs_sm_ndown(SCR *, recno_t);
+static int      vs_sm_nup(SCR *, recno_t);
 static int      vs_sm_insert(SCR *, recno_t);
 static int      vs_sm_reset(SCR *, recno_t);
 static int      vs_sm_up(SCR *, MARK *, recno_t, scroll_t, SMAP *);
@@ -50,6 +53,9 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
 
         vip = VIP(sp);
 
+        /* Any change may change line widths. */
+        VI_SCR_CFLUSH(vip);
+
         /*
          * XXX
          * Very nasty special case.  The historic vi code displays a single
@@ -73,6 +79,7 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
                 ++lno;
                 op = LINE_INSERT;
         }
+        vs_sm_hlchange(sp, lno, 1, op);
 
         /* Ignore the change if the line is after the map. */
         if (lno > TMAP->lno)
@@ -155,6 +162,124 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
         return (0);
 }
 
+/*
+ * vs_change_range --
+ *      Make a change of cnt lines to the screen.  Changes before the map
+ *      renumber it, changes that overlap it rebuild it, instead of
+ *      scrolling the screen once per line.
+ *
+ * PUBLIC: int vs_change_range(SCR *, recno_t, recno_t, lnop_t);
+ */
+int
+vs_change_range(SCR *sp, recno_t lno, recno_t cnt, lnop_t op)
+{
+        VI_PRIVATE *vip;
+        SMAP *p;
+        recno_t last;
+        size_t n;
+
+        if (cnt == 1 || op == LINE_RESET)
+                return (vs_change(sp, lno, op));
+
+        vip = VIP(sp);
+        VI_SCR_CFLUSH(vip);
+
+        /* Appending is the same as inserting, if the line is incremented. */
+        if (op == LINE_APPEND) {
+                ++lno;
+                op = LINE_INSERT;
+        }
+        vs_sm_hlchange(sp, lno, cnt, op);
+
+        /* Ignore the change if the lines are after the map. */
+        if (lno > TMAP->lno)
+                return (0);
+
+        /* If the lines are before the map, renumber the map. */
+        if (op == LINE_INSERT ?
+            lno < HMAP->lno : lno + cnt <= HMAP->lno) {
+                for (p = HMAP, n = sp->t_rows; n--; ++p)
+                        if (op == LINE_INSERT)
+                                p->lno += cnt;
+                        else
+                                p->lno -= cnt;
+                if (sp->lno >= lno) {
+                        if (op == LINE_INSERT)
+                                sp->lno += cnt;
+                        else
+                                sp->lno = sp->lno >= lno + cnt ?
+                                    sp->lno - cnt : lno;
+                }
+                F_SET(vip, VIP_N_RENUMBER);
+                return (0);
+        }
+
+        /*
+         * If the top line of the screen was deleted, the line that followed
+         * the deleted lines, or the last line of the file, is the new top.
+         */
+        if (op == LINE_DELETE && lno < HMAP->lno) {
+                HMAP->lno = lno;
+                HMAP->coff = 0;
+                HMAP->soff = 1;
+        }
+        if (HMAP->lno > 1 && !db_exist(sp, HMAP->lno)) {
+                if (db_last(sp, &last))
+                        return (1);
+                HMAP->lno = last == 0 ? 1 : last;
+                HMAP->coff = 0;
+                HMAP->soff = 1;
+        }
+
+        F_SET(vip, VIP_N_REFRESH | VIP_N_RENUMBER | VIP_CUR_INVALID);
+        VI_SCR_CFLUSH(vip);
+
+        /* Don't touch the screen if ex output is on it, see vs_change. */
+        if (!F_ISSET(sp, SC_TINPUT_INFO) &&
+            (F_ISSET(sp, SC_SCR_EXWROTE) || vip->totalcount > 1))
+                F_SET(vip, VIP_N_EX_REDRAW);
+        else
+                F_SET(sp, SC_SCR_REFORMAT);
+        return (0);
+}
+
+/*
+ * vs_sm_hlchange --
+ *      Keep the search matches cached in the map in step with a change of
+ *      cnt lines at lno.  Matches for changed or deleted lines are thrown
+ *      away, and matches for lines after them renumbered, so the lines the
+ *      change only moves keep theirs.  Every slot is checked, not only the
+ *      ones in use: slots are reused as the screen scrolls.
+ */
+static void
+vs_sm_hlchange(SCR *sp, recno_t lno, recno_t cnt, lnop_t op)
+{
+        SMAP *p;
+        size_t n;
+
+        for (p = HMAP, n = SIZE_HMAP(sp); n--; ++p) {
+                if (p->c_hllno == OOBLNO || p->c_hllno < lno)
+                        continue;
+                switch (op) {
+                case LINE_DELETE:
+                        if (p->c_hllno < lno + cnt)
+                                p->c_hllno = OOBLNO;
+                        else
+                                p->c_hllno -= cnt;
+                        break;
+                case LINE_INSERT:
+                        p->c_hllno += cnt;
+                        break;
+                case LINE_RESET:
+                        if (p->c_hllno < lno + cnt)
+                                p->c_hllno = OOBLNO;
+                        break;
+                default:
+                        abort();
+                }
+        }
+}
+
 /*
  * vs_sm_fill --
  *      Fill in the screen map, placing the specified line at the
@@ -572,6 +697,7 @@ vs_sm_up(SCR *sp, MARK *rp, recno_t count, scroll_t scmd, SMAP *smp)
 {
         int cursor_set, echanged, zset;
         SMAP *ssmp, s1, s2;
+        recno_t n;
 
         /*
          * Check to see if movement is possible.
@@ -650,18 +776,20 @@ vs_sm_up(SCR *sp, MARK *rp, recno_t count, scroll_t scmd, SMAP *smp)
                         return (0);
         }
 
-        for (echanged = zset = 0; count; --count) {
+        /*
+         * Count the logical lines that can be scrolled, then scroll the
+         * screen up all of them at once.
+         */
+        for (echanged = zset = 0, s2 = *TMAP, n = 0; count; --count, ++n) {
                 /* Decide what would show up on the screen. */
-                if (vs_sm_next(sp, TMAP, &s1))
+                if (vs_sm_next(sp, &s2, &s1))
                         return (1);
 
                 /* If the line doesn't exist, we're done. */
-                if (TMAP->lno != s1.lno && !db_exist(sp, s1.lno))
+                if (s2.lno != s1.lno && !db_exist(sp, s1.lno))
                         break;
+                s2 = s1;
 
-                /* Scroll the screen cursor up one logical line. */
-                if (vs_sm_1up(sp))
-                        return (1);
                 switch (scmd) {
                 case CNTRL_E:
                         if (smp > HMAP)
@@ -682,6 +810,8 @@ vs_sm_up(SCR *sp, MARK *rp, recno_t count, scroll_t scmd, SMAP *smp)
                         break;
                 }
         }
+        if (n != 0 && vs_sm_nup(sp, n))
+                return (1);
 
         if (cursor_set)
                 return(0);
@@ -767,6 +897,50 @@ vs_sm_1up(SCR *sp)
         return (vs_line(sp, TMAP, NULL, NULL));
 }
 
+/*
+ * vs_sm_nup --
+ *      Scroll the SMAP up cnt lines, all of which exist, and display
+ *      only the lines that appear at the bottom of the screen.
+ */
+static int
+vs_sm_nup(SCR *sp, recno_t cnt)
+{
+        size_t i, rows;
+
+        rows = LASTLINE(sp);
+        if (IS_ONELINE(sp) || sp->gp->scr_scroll == NULL) {
+                for (; cnt; --cnt)
+                        if (vs_sm_1up(sp))
+                                return (1);
+                return (0);
+        }
+
+        (void)sp->gp->scr_move(sp, 0, 0);
+        if (cnt < rows) {
+                if (vs_deleteln(sp, cnt))
+                        return (1);
+                memmove(HMAP, HMAP + cnt, (rows - cnt) * sizeof(SMAP));
+                i = rows - cnt;
+        } else {
+                /* Nothing stays, the new top line is past the old bottom. */
+                if (vs_deleteln(sp, rows))
+                        return (1);
+                for (cnt -= rows - 1; cnt; --cnt)
+                        if (vs_sm_next(sp, TMAP, TMAP))
+                                return (1);
+                HMAP[0] = *TMAP;
+                if (vs_line(sp, HMAP, NULL, NULL))
+                        return (1);
+                i = 1;
+        }
+        /* vs_sm_next() flushes the cache. */
+        for (; i < rows; ++i)
+                if (vs_sm_next(sp, HMAP + i - 1, HMAP + i) ||
+                    vs_line(sp, HMAP + i, NULL, NULL))
+                        return (1);
+        return (0);
+}
+
 /*
  * vs_deleteln --
  *      Delete a line a la curses, make sure to put the information
@@ -783,6 +957,12 @@ vs_deleteln(SCR *sp, int cnt)
                 (void)gp->scr_clrtoeol(sp);
         else {
                 (void)gp->scr_cursor(sp, &oldy, &oldx);
+                if (gp->scr_scroll != NULL && oldy < LASTLINE(sp)) {
+                        if ((size_t)cnt > LASTLINE(sp) - oldy)
+                                cnt = LASTLINE(sp) - oldy;
+                        return (gp->scr_scroll(sp,
+                            oldy, LASTLINE(sp) - 1, cnt));
+                }
                 while (cnt--) {
                         (void)gp->scr_deleteln(sp);
                         (void)gp->scr_move(sp, LASTLINE(sp), 0);
@@ -802,6 +982,7 @@ vs_sm_down(SCR *sp, MARK *rp, recno_t count, scroll_t scmd, SMAP *smp)
 {
         SMAP *ssmp, s1, s2;
         int cursor_set, ychanged, zset;
+        recno_t n;
 
         /* Check to see if movement is possible. */
         if (HMAP->lno == 1 &&
@@ -858,15 +1039,18 @@ vs_sm_down(SCR *sp, MARK *rp, recno_t count, scroll_t scmd, SMAP *smp)
                         return (0);
         }
 
-        for (ychanged = zset = 0; count; --count) {
+        /*
+         * Count the logical lines that can be scrolled, then scroll the
+         * screen down all of them at once.
+         */
+        for (ychanged = zset = 0, s1 = *HMAP, n = 0; count; --count, ++n) {
                 /* If the line doesn't exist, we're done. */
-                if (HMAP->lno == 1 &&
-                    (O_ISSET(sp, O_LEFTRIGHT) || HMAP->soff == 1))
+                if (s1.lno == 1 &&
+                    (O_ISSET(sp, O_LEFTRIGHT) || s1.soff == 1))
                         break;
-
-                /* Scroll the screen and cursor down one logical line. */
-                if (vs_sm_1down(sp))
+                if (vs_sm_prev(sp, &s1, &s1))
                         return (1);
+
                 switch (scmd) {
                 case CNTRL_Y:
                         if (smp < TMAP)
@@ -887,6 +1071,8 @@ vs_sm_down(SCR *sp, MARK *rp, recno_t count, scroll_t scmd, SMAP *smp)
                         break;
                 }
         }
+        if (n != 0 && vs_sm_ndown(sp, n))
+                return (1);
 
         if (scmd != CNTRL_Y && cursor_set)
                 return(0);
@@ -993,6 +1179,50 @@ vs_sm_1down(SCR *sp)
         return (vs_line(sp, HMAP, NULL, NULL));
 }
 
+/*
+ * vs_sm_ndown --
+ *      Scroll the SMAP down cnt lines, all of which exist, and display
+ *      only the lines that appear at the top of the screen.
+ */
+static int
+vs_sm_ndown(SCR *sp, recno_t cnt)
+{
+        size_t i, rows;
+
+        rows = LASTLINE(sp);
+        if (IS_ONELINE(sp) || sp->gp->scr_scroll == NULL) {
+                for (; cnt; --cnt)
+                        if (vs_sm_1down(sp))
+                                return (1);
+                return (0);
+        }
+
+        (void)sp->gp->scr_move(sp, 0, 0);
+        if (cnt < rows) {
+                if (vs_insertln(sp, cnt))
+                        return (1);
+                memmove(HMAP + cnt, HMAP, (rows - cnt) * sizeof(SMAP));
+                i = cnt;
+        } else {
+                /* Nothing stays, the new bottom line is before the old top. */
+                if (vs_insertln(sp, rows))
+                        return (1);
+                for (cnt -= rows - 1; cnt; --cnt)
+                        if (vs_sm_prev(sp, HMAP, HMAP))
+                                return (1);
+                *TMAP = HMAP[0];
+                if (vs_line(sp, TMAP, NULL, NULL))
+                        return (1);
+                i = rows - 1;
+        }
+        /* vs_sm_prev() flushes the cache. */
+        for (; i > 0; --i)
+                if (vs_sm_prev(sp, HMAP + i, HMAP + i - 1) ||
+                    vs_line(sp, HMAP + i - 1, NULL, NULL))
+                        return (1);
+        return (0);
+}
+
 /*
  * vs_insertln --
  *      Insert a line a la curses, make sure to put the information
@@ -1010,6 +1240,12 @@ vs_insertln(SCR *sp, int cnt)
                 (void)gp->scr_clrtoeol(sp);
         } else {
                 (void)gp->scr_cursor(sp, &oldy, &oldx);
+                if (gp->scr_scroll != NULL && oldy < LASTLINE(sp)) {
+                        if ((size_t)cnt > LASTLINE(sp) - oldy)
+                                cnt = LASTLINE(sp) - oldy;
+                        return (gp->scr_scroll(sp,
+                            oldy, LASTLINE(sp) - 1, -cnt));
+                }
                 while (cnt--) {
                         (void)gp->scr_move(sp, LASTLINE(sp) - 1, 0);
                         (void)gp->scr_deleteln(sp);